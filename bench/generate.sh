@@ -0,0 +1,69 @@
+#!/bin/sh
+# writes a synthetic C project with a configurable amount of DWARF to DIR
+# usage: generate.sh DIR [CUS] [STRUCTS] [ENUMS] [FUNCTIONS] [DEPTH] [MACROS]
+#   STRUCTS, ENUMS, FUNCTIONS and MACROS are per CU, DEPTH is the nesting of lexical blocks
+set -e
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 DIR [CUS] [STRUCTS] [ENUMS] [FUNCTIONS] [DEPTH] [MACROS]" >&2
+    exit 1
+fi
+
+dir=$1
+mkdir -p "$dir"
+rm -f "$dir"/unit*.c "$dir"/*.o
+
+awk -v dir="$dir" -v cus="${2:-200}" -v structs="${3:-20}" -v enums="${4:-10}" \
+    -v functions="${5:-40}" -v depth="${6:-4}" -v macros="${7:-100}" '
+BEGIN {
+    for (u = 0; u < cus; u++) {
+        file = sprintf("%s/unit%d.c", dir, u)
+
+        for (m = 0; m < macros; m++) {
+            printf("#define UNIT%d_MACRO%d (%d + %d)\n", u, m, u, m) > file
+        }
+
+        for (e = 0; e < enums; e++) {
+            printf("enum unit%d_enum%d { UNIT%d_E%d_A, UNIT%d_E%d_B, UNIT%d_E%d_C, UNIT%d_E%d_D };\n", u, e, u, e, u, e, u, e, u, e) > file
+        }
+
+        for (s = 0; s < structs; s++) {
+            printf("struct unit%d_struct%d {\n    int a;\n    long b;\n    char name[16];\n    double (*callback)(int, double);\n", u, s) > file
+            if (s > 0) {
+                printf("    struct unit%d_struct%d* previous;\n", u, s - 1) > file
+            }
+            if (enums > 0) {
+                printf("    enum unit%d_enum%d kind;\n", u, s % enums) > file
+            }
+            printf("};\n") > file
+        }
+
+        for (f = 0; f < functions; f++) {
+            if (structs > 0) {
+                printf("int unit%d_function%d(struct unit%d_struct%d* item, int count)\n{\n    int total0 = count;\n", u, f, u, f % structs) > file
+            } else {
+                printf("int unit%d_function%d(int* item, int count)\n{\n    int total0 = count;\n", u, f) > file
+            }
+
+            for (d = 1; d <= depth; d++) {
+                printf("%*s{\n%*sint total%d = total%d + %d;\n", d * 4, "", d * 4 + 4, "", d, d - 1, d) > file
+            }
+            printf("%*scount = total%d;\n", depth * 4 + 4, "", depth) > file
+            for (d = depth; d >= 1; d--) {
+                printf("%*s}\n", d * 4, "") > file
+            }
+
+            if (structs > 0) {
+                printf("    return item->a + count;\n}\n") > file
+            } else {
+                printf("    return *item + count;\n}\n") > file
+            }
+        }
+
+        close(file)
+    }
+
+    file = sprintf("%s/unit_main.c", dir)
+    printf("int main(void)\n{\n    return 0;\n}\n") > file
+    close(file)
+}'
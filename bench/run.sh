@@ -0,0 +1,46 @@
+#!/bin/sh
+# builds the synthetic corpus and times the dumper on it
+# usage: run.sh [DUMPER]
+#   BENCH_DIR, BENCH_CUS, BENCH_STRUCTS, BENCH_ENUMS, BENCH_FUNCTIONS, BENCH_DEPTH, BENCH_MACROS
+#   and BENCH_JOBS override the defaults
+set -e
+
+here=$(dirname "$0")
+dumper=${1:-./selfdwarfdumper}
+dir=${BENCH_DIR:-/tmp/selfdwarfdumper-bench}
+jobs=${BENCH_JOBS:-$(nproc)}
+
+"$here/generate.sh" "$dir" "${BENCH_CUS:-200}" "${BENCH_STRUCTS:-20}" "${BENCH_ENUMS:-10}" \
+    "${BENCH_FUNCTIONS:-40}" "${BENCH_DEPTH:-4}" "${BENCH_MACROS:-100}"
+
+ls "$dir"/unit*.c | xargs -P "$jobs" -I{} sh -c 'cc -g3 -O0 -c "$1" -o "${1%.c}.o"' _ {}
+cc "$dir"/unit*.o -o "$dir/corpus"
+
+info_bytes=$(printf '%d' "0x$(objdump -h "$dir/corpus" | awk '$2 == ".debug_info" { print $3 }')")
+dies=$("$dumper" --format=ndjson --no-strings "$dir/corpus" | grep -c '"record":"die"')
+
+echo "corpus: $dir/corpus, $dies DIEs, $info_bytes bytes of .debug_info"
+
+# one line per run: wall time, DIEs/s, MB/s of .debug_info, then --timing and --peak-rss
+measure()
+{
+    label=$1
+    shift
+
+    start=$(date +%s%N)
+    "$dumper" --timing --peak-rss "$@" "$dir/corpus" > /dev/null 2> "$dir/stderr"
+    end=$(date +%s%N)
+
+    awk -v label="$label" -v ns=$((end - start)) -v dies="$dies" -v bytes="$info_bytes" '
+        { phases = phases ", " $0 }
+        END {
+            seconds = ns / 1e9
+            printf("%s: %.3f s, %.0f DIEs/s, %.1f MB/s%s\n", label, seconds, dies / seconds, bytes / seconds / 1048576, phases)
+        }' "$dir/stderr"
+}
+
+measure "text -j1" -j1
+measure "text -j$jobs" -j"$jobs"
+measure "ndjson -j1" --format=ndjson -j1
+measure "lines -j1" --lines -j1
+measure "types -j1" --resolve-types -j1
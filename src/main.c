@@ -1,11 +1,30 @@
+#define _GNU_SOURCE
+
 #include <errno.h>
 #include <fcntl.h>
+#include <fnmatch.h>
+#include <gelf.h>
+#include <getopt.h>
+#include <limits.h>
+#include <link.h>
 #include <libdwarf/dwarf.h>
 #include <libdwarf/libdwarf.h>
 #include <libelf.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <regex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "selflocation.h"
+#include "selfsym.h"
 
 #define TESTMACRO 0
 #define STR(a) #a
@@ -42,848 +61,7775 @@ void ArrayFree(struct Array* a)
     a->size = 0;
 }
 
-struct SourceFiles {
-    char** Files;
-    Dwarf_Signed Count;
+// offset -> pointer hash map, open addressing with linear probing
+struct OffsetMap {
+    Dwarf_Off* Keys; // offset + 1, 0 marks an empty slot
+    void** Values;
+    size_t Size;
+    size_t Used;
 };
 
-static Dwarf_Debug GlobalDwarfDebug;
-static Dwarf_Error GlobalDwarfError;
-static struct SourceFiles GlobalSourceFiles;
-
-struct Array GlobalArray;
-
-void HandleDwarfEnumerationType(Dwarf_Die Die);
-void HandleDwarfEnumerator(Dwarf_Die Die);
-void HandleDwarfBaseType(Dwarf_Die Die);
-void HandleDwarfTypedef(Dwarf_Die Die);
-void HandleDwarfArrayType(Dwarf_Die Die);
-void HandleDwarfSubrangeType(Dwarf_Die Die);
-void HandleDwarfPointerType(Dwarf_Die Die);
-void HandleDwarfSubroutineType(Dwarf_Die Die);
-void HandleDwarfStructureType(Dwarf_Die Die);
-void HandleDwarfMember(Dwarf_Die Die);
-void HandleDwarfFormalParameter(Dwarf_Die Die);
-void HandleDwarfLexicalBlock(Dwarf_Die Die);
-void HandleDwarfSubprogram(Dwarf_Die Die);
-void HandleDwarfVariable(Dwarf_Die Die);
-
-void (*TagFunctions[75])(Dwarf_Die Die) = {
-    [DW_TAG_enumeration_type] = HandleDwarfEnumerationType,
-    [DW_TAG_enumerator] = HandleDwarfEnumerator,
-    [DW_TAG_base_type] = HandleDwarfBaseType,
-    [DW_TAG_typedef] = HandleDwarfTypedef,
-    [DW_TAG_array_type] = HandleDwarfArrayType,
-    [DW_TAG_subrange_type] = HandleDwarfSubrangeType,
-    [DW_TAG_pointer_type] = HandleDwarfPointerType,
-    [DW_TAG_subroutine_type] = HandleDwarfSubroutineType,
-    [DW_TAG_formal_parameter] = HandleDwarfFormalParameter,
-    [DW_TAG_structure_type] = HandleDwarfStructureType,
-    [DW_TAG_member] = HandleDwarfMember,
-    [DW_TAG_lexical_block] = HandleDwarfLexicalBlock,
-    [DW_TAG_subprogram] = HandleDwarfSubprogram,
-    [DW_TAG_variable] = HandleDwarfVariable,
-};
+void OffsetMapInit(struct OffsetMap* Map, size_t InitialSize)
+{
+    size_t Size = 16;
+    while (Size < InitialSize * 2) {
+        Size *= 2;
+    }
+
+    Map->Keys = (Dwarf_Off*)calloc(Size, sizeof(Dwarf_Off));
+    Map->Values = (void**)calloc(Size, sizeof(void*));
+    Map->Size = Size;
+    Map->Used = 0;
+}
 
-void GetAllSourceFiles(Dwarf_Die Die)
+size_t OffsetMapSlot(struct OffsetMap* Map, Dwarf_Off Key)
 {
-    dwarf_srcfiles(Die, &GlobalSourceFiles.Files, &GlobalSourceFiles.Count, 0);
+    Dwarf_Off Hash = Key * 0x9e3779b97f4a7c15ull;
+    size_t Slot = (Hash ^ (Hash >> 32)) & (Map->Size - 1);
 
-    fprintf(stdout, "Detected files:\n");
-    for (int Index = 0; Index < GlobalSourceFiles.Count; Index++) {
-        fprintf(stdout, "\t%s\n", GlobalSourceFiles.Files[Index]);
+    while (Map->Keys[Slot] != 0 && Map->Keys[Slot] != Key + 1) {
+        Slot = (Slot + 1) & (Map->Size - 1);
     }
+
+    return Slot;
 }
 
-char* GetTagString(Dwarf_Die Die, Dwarf_Half AttributeCode)
+void* OffsetMapFind(struct OffsetMap* Map, Dwarf_Off Key)
 {
-    int Result = 0;
+    size_t Slot = OffsetMapSlot(Map, Key);
+    return Map->Keys[Slot] == 0 ? 0 : Map->Values[Slot];
+}
 
-    char* Value = 0;
-    Dwarf_Attribute Attribute = 0;
+void OffsetMapInsert(struct OffsetMap* Map, Dwarf_Off Key, void* Value)
+{
+    if ((Map->Used + 1) * 2 > Map->Size) {
+        struct OffsetMap Grown;
+        OffsetMapInit(&Grown, Map->Size);
+
+        for (size_t Index = 0; Index < Map->Size; Index++) {
+            if (Map->Keys[Index] != 0) {
+                size_t Slot = OffsetMapSlot(&Grown, Map->Keys[Index] - 1);
+                Grown.Keys[Slot] = Map->Keys[Index];
+                Grown.Values[Slot] = Map->Values[Index];
+                Grown.Used++;
+            }
+        }
 
-    Result = dwarf_attr(Die, AttributeCode, &Attribute, 0);
-    if (Result != DW_DLV_OK) {
-        return 0;
+        free(Map->Keys);
+        free(Map->Values);
+        *Map = Grown;
     }
 
-    Result = dwarf_formstring(Attribute, &Value, 0);
-    if (Result != DW_DLV_OK) {
-        return 0;
+    size_t Slot = OffsetMapSlot(Map, Key);
+    if (Map->Keys[Slot] == 0) {
+        Map->Keys[Slot] = Key + 1;
+        Map->Used++;
     }
 
-    return Value;
+    Map->Values[Slot] = Value;
 }
 
-Dwarf_Unsigned GetTagUnsignedData(Dwarf_Die Die, Dwarf_Half AttributeCode)
+void OffsetMapFree(struct OffsetMap* Map)
 {
-    int Result = 0;
+    free(Map->Keys);
+    free(Map->Values);
+    Map->Keys = 0;
+    Map->Values = 0;
+    Map->Size = 0;
+    Map->Used = 0;
+}
 
-    Dwarf_Unsigned Value = 0;
-    Dwarf_Attribute Attribute = 0;
+enum OutputFormat {
+    FORMAT_TEXT,
+    FORMAT_NDJSON, // one JSON object per line, see OutputRecordBegin()
+};
 
-    Result = dwarf_attr(Die, AttributeCode, &Attribute, 0);
-    if (Result != DW_DLV_OK) {
-        return 0;
-    }
+// read-only after argument parsing, shared by all workers
+struct DumpOptions {
+    enum OutputFormat Format;
+    int SkipStrings;
+    size_t MemoryBudget; // bytes of RSS, 0 for no limit
+    int ReportPeakRSS;
+    int MaxDepth;
+    const char* ColumnsPath;
+    const char* SymbolizePath; // addresses to resolve, "-" for stdin
+    int PrintLines;
+    int ReportTiming;
+    const char* AddressToLinePath; // addresses to resolve through the line tables, "-" for stdin
+    const char* LineToAddress; // FILE:LINE
+    int ResolveTypes;
+    const char* CacheDirectory;
+    const char* FindName;
+    const char* FindAddress; // hex
+    int Stats; // 1 for a text summary, 2 for JSON
+    const char* DebugDirectory; // root of the build-id tree, /usr/lib/debug by default
+    int DecodeLocations;
+    int Layout;
+    int DedupTypes;
+};
 
-    Result = dwarf_formudata(Attribute, &Value, 0);
-    if (Result != DW_DLV_OK) {
-        return 0;
-    }
+static struct DumpOptions GlobalOptions = { .MaxDepth = 256 };
 
-    return Value;
+// formatted output, collected in a large buffer and written out with writev()
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define OUTPUT_MEMORY_SIZE (1 << 16)
+
+struct Output {
+    int FileDescriptor; // -1 keeps everything in memory
+    int Error; // errno of the first failed write, later writes are dropped
+    Dwarf_Unsigned Written; // bytes that went out to FileDescriptor
+    char* Buffer;
+    size_t Used;
+    size_t Size;
+};
+
+void OutputInit(struct Output* Output, int FileDescriptor)
+{
+    Output->FileDescriptor = FileDescriptor;
+    Output->Error = 0;
+    Output->Written = 0;
+    Output->Size = FileDescriptor < 0 ? OUTPUT_MEMORY_SIZE : OUTPUT_BUFFER_SIZE;
+    Output->Buffer = (char*)malloc(Output->Size);
+    Output->Used = 0;
 }
 
-Dwarf_Off GetTagRef(Dwarf_Die Die, Dwarf_Half AttributeCode)
+void OutputWriteAll(struct Output* Output, struct iovec* Vector, int Count)
 {
-    int Result = 0;
+    while (Count > 0 && Output->Error == 0) {
+        ssize_t Written = writev(Output->FileDescriptor, Vector, Count);
+        if (Written < 0) {
+            if (errno != EINTR) {
+                Output->Error = errno;
+            }
+            continue;
+        }
 
-    Dwarf_Off Value = 0;
-    Dwarf_Attribute Attribute = 0;
+        Output->Written += Written;
+        while (Count > 0 && (size_t)Written >= Vector->iov_len) {
+            Written -= Vector->iov_len;
+            Vector++;
+            Count--;
+        }
 
-    Result = dwarf_attr(Die, AttributeCode, &Attribute, 0);
-    if (Result != DW_DLV_OK) {
-        return 0;
+        if (Count > 0) {
+            Vector->iov_base = (char*)Vector->iov_base + Written;
+            Vector->iov_len -= Written;
+        }
     }
+}
 
-    Result = dwarf_formref(Attribute, &Value, 0);
-    if (Result != DW_DLV_OK) {
-        return 0;
+int OutputFlush(struct Output* Output)
+{
+    if (Output->FileDescriptor >= 0 && Output->Used > 0) {
+        struct iovec Vector = { Output->Buffer, Output->Used };
+        OutputWriteAll(Output, &Vector, 1);
+        Output->Used = 0;
     }
 
-    return Value;
+    return Output->Error == 0 ? 0 : -1;
 }
 
-Dwarf_Bool GetTagFlag(Dwarf_Die Die, Dwarf_Half AttributeCode)
+// bytes written so far, flushed or not
+Dwarf_Unsigned OutputPosition(struct Output* Output)
 {
-    int Result = 0;
+    return Output->Written + Output->Used;
+}
 
-    Dwarf_Bool Value = 0;
-    Dwarf_Attribute Attribute = 0;
+void OutputFree(struct Output* Output)
+{
+    free(Output->Buffer);
+    Output->Buffer = 0;
+    Output->Used = 0;
+    Output->Size = 0;
+}
 
-    Result = dwarf_attr(Die, AttributeCode, &Attribute, 0);
-    if (Result != DW_DLV_OK) {
-        return 0;
+void OutputBytes(struct Output* Output, const char* Data, size_t Length)
+{
+    if (Output->Size - Output->Used >= Length) {
+        memcpy(Output->Buffer + Output->Used, Data, Length);
+        Output->Used += Length;
+        return;
     }
 
-    Result = dwarf_formflag(Attribute, &Value, 0);
-    if (Result != DW_DLV_OK) {
-        return 0;
+    if (Output->FileDescriptor < 0) {
+        while (Output->Size - Output->Used < Length) {
+            Output->Size *= 2;
+        }
+        Output->Buffer = (char*)realloc(Output->Buffer, Output->Size);
+    } else if (Length >= Output->Size / 2) {
+        // big blocks (rendered CUs) go straight out behind what is buffered
+        struct iovec Vector[2] = { { Output->Buffer, Output->Used }, { (void*)Data, Length } };
+        OutputWriteAll(Output, Vector, 2);
+        Output->Used = 0;
+        return;
+    } else {
+        OutputFlush(Output);
     }
 
-    return Value;
+    memcpy(Output->Buffer + Output->Used, Data, Length);
+    Output->Used += Length;
 }
 
-Dwarf_Addr GetTagAddress(Dwarf_Die Die, Dwarf_Half AttributeCode)
+#define OutputLiteral(Output, Literal) OutputBytes(Output, Literal, sizeof(Literal) - 1)
+
+void OutputString(struct Output* Output, const char* String)
 {
-    int Result = 0;
+    if (String == 0) {
+        OutputLiteral(Output, "(null)");
+        return;
+    }
 
-    Dwarf_Addr Value = 0;
-    Dwarf_Attribute Attribute = 0;
+    OutputBytes(Output, String, strlen(String));
+}
 
-    Result = dwarf_attr(Die, AttributeCode, &Attribute, 0);
-    if (Result != DW_DLV_OK) {
-        return 0;
-    }
+void OutputUnsigned(struct Output* Output, Dwarf_Unsigned Value)
+{
+    char Digits[20];
+    char* Cursor = Digits + sizeof(Digits);
 
-    Result = dwarf_formaddr(Attribute, &Value, 0);
-    if (Result != DW_DLV_OK) {
-        return 0;
-    }
+    do {
+        *--Cursor = '0' + Value % 10;
+        Value /= 10;
+    } while (Value != 0);
 
-    return Value;
+    OutputBytes(Output, Cursor, Digits + sizeof(Digits) - Cursor);
 }
 
-Dwarf_Unsigned GetTagExprLoc(Dwarf_Die Die, Dwarf_Half AttributeCode, Dwarf_Ptr Pointer)
+// lowercase, zero padded to MinDigits like %0.8x but for the whole 64 bits
+void OutputHex(struct Output* Output, Dwarf_Unsigned Value, int MinDigits)
 {
-    Dwarf_Unsigned Length = 0;
-    Dwarf_Attribute Attribute = 0;
+    char Digits[16];
+    char* Cursor = Digits + sizeof(Digits);
 
-    int Result = dwarf_attr(Die, AttributeCode, &Attribute, 0);
-    if (Result != DW_DLV_OK) {
-        return 0;
-    }
+    do {
+        *--Cursor = "0123456789abcdef"[Value & 0xf];
+        Value >>= 4;
+    } while (Value != 0);
 
-    Result = dwarf_formexprloc(Attribute, &Length, &Pointer, &GlobalDwarfError);
-    if (Result != DW_DLV_OK) {
-        return 0;
+    while (Digits + sizeof(Digits) - Cursor < MinDigits) {
+        *--Cursor = '0';
     }
 
-    return Length;
+    OutputBytes(Output, Cursor, Digits + sizeof(Digits) - Cursor);
 }
 
-void DwarfGetChildInfo(Dwarf_Die ChildDie)
+// bytes that have to be escaped in a JSON string, everything else is copied in runs
+static const char JsonEscapes[256] = {
+    [0x00] = 'u', [0x01] = 'u', [0x02] = 'u', [0x03] = 'u', [0x04] = 'u', [0x05] = 'u', [0x06] = 'u', [0x07] = 'u',
+    [0x08] = 'b', [0x09] = 't', [0x0a] = 'n', [0x0b] = 'u', [0x0c] = 'f', [0x0d] = 'r', [0x0e] = 'u', [0x0f] = 'u',
+    [0x10] = 'u', [0x11] = 'u', [0x12] = 'u', [0x13] = 'u', [0x14] = 'u', [0x15] = 'u', [0x16] = 'u', [0x17] = 'u',
+    [0x18] = 'u', [0x19] = 'u', [0x1a] = 'u', [0x1b] = 'u', [0x1c] = 'u', [0x1d] = 'u', [0x1e] = 'u', [0x1f] = 'u',
+    ['"'] = '"', ['\\'] = '\\',
+};
+
+void OutputJsonString(struct Output* Output, const char* String)
 {
-    int Result = 0;
+    if (String == 0) {
+        OutputLiteral(Output, "null");
+        return;
+    }
 
-    do {
-        Dwarf_Half Tag;
-        Result = dwarf_tag(ChildDie, &Tag, &GlobalDwarfError);
-        if (Result != DW_DLV_OK) {
-            fprintf(stdout, "dwarf_tag() error: %s\n", dwarf_errmsg(GlobalDwarfError));
-            exit(1);
+    OutputLiteral(Output, "\"");
+
+    const char* Run = String;
+    for (const char* Cursor = String;; Cursor++) {
+        char Escape = JsonEscapes[(unsigned char)*Cursor];
+        if (Escape == 0) {
+            continue;
         }
 
-        switch (Tag) {
-            case DW_TAG_enumeration_type:
-            case DW_TAG_enumerator:
-            case DW_TAG_subprogram:
-            case DW_TAG_variable:
-            case DW_TAG_formal_parameter:
-            case DW_TAG_lexical_block:
-            case DW_TAG_structure_type:
-            case DW_TAG_member:
-            case DW_TAG_array_type:
-            case DW_TAG_subrange_type:
-            case DW_TAG_pointer_type:
-            case DW_TAG_subroutine_type:
-            case DW_TAG_typedef:
-            case DW_TAG_base_type:
-                TagFunctions[Tag](ChildDie);
-                break;
-            default:
-                break;
+        if (*Cursor == 0) {
+            OutputBytes(Output, Run, Cursor - Run);
+            break;
         }
-    } while (dwarf_siblingof(GlobalDwarfDebug, ChildDie, &ChildDie, 0) == 0);
-}
 
-void HandleDwarfEnumerationType(Dwarf_Die Die)
-{
-    const char* Name = GetTagString(Die, DW_AT_name);
-    Dwarf_Unsigned Encoding = GetTagUnsignedData(Die, DW_AT_encoding);
-    Dwarf_Unsigned Size = GetTagUnsignedData(Die, DW_AT_byte_size);
-    Dwarf_Unsigned Line = GetTagUnsignedData(Die, DW_AT_decl_line);
-    Dwarf_Unsigned File = GetTagUnsignedData(Die, DW_AT_decl_file);
-    Dwarf_Unsigned Column = GetTagUnsignedData(Die, DW_AT_decl_column);
-    Dwarf_Off Type = GetTagRef(Die, DW_AT_type);
-    Dwarf_Off Sibling = GetTagRef(Die, DW_AT_sibling);
+        OutputBytes(Output, Run, Cursor - Run);
+        Run = Cursor + 1;
 
-    Dwarf_Bool HasChildren = 0;
-    Dwarf_Die ChildDie = 0;
-    if (dwarf_child(Die, &ChildDie, &GlobalDwarfError) == DW_DLV_OK) {
-        HasChildren = 1;
+        char Sequence[6] = { '\\', Escape, '0', '0', '0', '0' };
+        if (Escape == 'u') {
+            Sequence[4] = "0123456789abcdef"[(unsigned char)*Cursor >> 4];
+            Sequence[5] = "0123456789abcdef"[*Cursor & 0xf];
+            OutputBytes(Output, Sequence, 6);
+        } else {
+            OutputBytes(Output, Sequence, 2);
+        }
     }
 
-    const char* FileName = File == 0 ? "(null)" : GlobalSourceFiles.Files[File - 1];
+    OutputLiteral(Output, "\"");
+}
+
+// NDJSON records are flat, "record" names the kind and relations are offsets
+void OutputRecordBegin(struct Output* Output, const char* Record)
+{
+    OutputLiteral(Output, "{\"record\":\"");
+    OutputString(Output, Record);
+    OutputLiteral(Output, "\"");
+}
 
-    fprintf(stdout, "DW_TAG_enumeration_type - Children: %d\n"
-                    "\tDW_AT_name: %s\n"
-                    "\tDW_AT_encoding: %llu\n"
-                    "\tDW_AT_byte_size: %llu\n"
-                    "\tDW_AT_decl_file: %s\n"
-                    "\tDW_AT_decl_line: %d\n"
-                    "\tDW_AT_decl_column: %llu\n"
-                    "\tDW_AT_type: <0x%0.8x>\n"
-                    "\tDW_AT_sibling: 0x%0.8x\n",
-            HasChildren, Name, Encoding, Size, FileName, Line, Column, Type, Sibling);
+void OutputRecordEnd(struct Output* Output)
+{
+    OutputLiteral(Output, "}\n");
+}
 
-    if (HasChildren) {
-        DwarfGetChildInfo(ChildDie);
+// text that only exists to lay out the text format
+void OutputSeparator(struct Output* Output, const char* Text)
+{
+    if (GlobalOptions.Format == FORMAT_TEXT) {
+        OutputString(Output, Text);
     }
 }
 
-void HandleDwarfEnumerator(Dwarf_Die Die)
+// one DIE is a tag line followed by "\tNAME: VALUE" lines, or one record with a key per field
+void OutputTag(struct Output* Output, const char* Tag)
 {
-    const char* Name = GetTagString(Die, DW_AT_name);
-    Dwarf_Unsigned Value = GetTagUnsignedData(Die, DW_AT_const_value);
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputLiteral(Output, ",\"tag\":\"");
+        OutputString(Output, Tag);
+        OutputLiteral(Output, "\"");
+        return;
+    }
 
-    fprintf(stdout, "DW_TAG_enumerator\n"
-                    "\tDW_AT_name: %s\n"
-                    "\tDW_AT_const_value: %llu\n",
-            Name, Value);
+    OutputString(Output, Tag);
+    OutputLiteral(Output, "\n");
 }
 
-void HandleDwarfBaseType(Dwarf_Die Die)
+void OutputTagWithChildren(struct Output* Output, const char* Tag, Dwarf_Bool HasChildren)
 {
-    char* Name = GetTagString(Die, DW_AT_name);
-    Dwarf_Off Type = GetTagRef(Die, DW_AT_type);
-    Dwarf_Unsigned Size = GetTagUnsignedData(Die, DW_AT_byte_size);
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputTag(Output, Tag);
+        OutputLiteral(Output, ",\"children\":");
+        OutputUnsigned(Output, HasChildren);
+        return;
+    }
 
-    fprintf(stdout, "DW_TAG_base_type\n"
-                    "\tDW_AT_name: %s\n"
-                    "\tDW_AT_type: <0x%0.8x>\n"
-                    "\tDW_AT_byte_size: %llu\n",
-            Name, Type, Size);
+    OutputString(Output, Tag);
+    OutputLiteral(Output, " - Children: ");
+    OutputUnsigned(Output, HasChildren);
+    OutputLiteral(Output, "\n");
 }
 
-void HandleDwarfTypedef(Dwarf_Die Die)
+void OutputFieldName(struct Output* Output, const char* Name)
 {
-    char* Name = GetTagString(Die, DW_AT_name);
-    Dwarf_Unsigned File = GetTagUnsignedData(Die, DW_AT_decl_file);
-    Dwarf_Unsigned Line = GetTagUnsignedData(Die, DW_AT_decl_line);
-    Dwarf_Unsigned Column = GetTagUnsignedData(Die, DW_AT_decl_column);
-    Dwarf_Off Type = GetTagRef(Die, DW_AT_type);
-
-    const char* FileName = File == 0 ? "(null)" : GlobalSourceFiles.Files[File - 1];
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputLiteral(Output, ",\"");
+        OutputString(Output, Name);
+        OutputLiteral(Output, "\":");
+        return;
+    }
 
-    fprintf(stdout, "DW_TAG_typedef\n"
-                    "\tDW_AT_name: %s\n"
-                    "\tDW_AT_decl_file: %s\n"
-                    "\tDW_AT_decl_line: %d\n"
-                    "\tDW_AT_decl_column: %llu\n"
-                    "\tDW_AT_type: <0x%0.8x>\n",
-            Name, FileName, Line, Column, Type);
+    OutputLiteral(Output, "\t");
+    OutputString(Output, Name);
+    OutputLiteral(Output, ": ");
 }
 
-void HandleDwarfArrayType(Dwarf_Die Die)
+void OutputFieldEnd(struct Output* Output)
 {
-    Dwarf_Off Type = GetTagRef(Die, DW_AT_type);
-    Dwarf_Off Sibling = GetTagRef(Die, DW_AT_sibling);
+    if (GlobalOptions.Format == FORMAT_TEXT) {
+        OutputLiteral(Output, "\n");
+    }
+}
 
-    Dwarf_Bool HasChildren = 0;
-    Dwarf_Die ChildDie = 0;
-    if (dwarf_child(Die, &ChildDie, &GlobalDwarfError) == DW_DLV_OK) {
-        HasChildren = 1;
+void OutputFieldString(struct Output* Output, const char* Name, const char* Value)
+{
+    OutputFieldName(Output, Name);
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputJsonString(Output, Value);
+    } else {
+        OutputString(Output, Value);
     }
+    OutputFieldEnd(Output);
+}
 
-    fprintf(stdout, "DW_TAG_array_type - Children: %d\n"
-                    "\tDW_AT_type: <0x%0.8x>\n"
-                    "\tDW_AT_sibling: %llu\n",
-            HasChildren, Type, Sibling);
+void OutputFieldUnsigned(struct Output* Output, const char* Name, Dwarf_Unsigned Value)
+{
+    OutputFieldName(Output, Name);
+    OutputUnsigned(Output, Value);
+    OutputFieldEnd(Output);
+}
 
-    if (HasChildren) {
-        DwarfGetChildInfo(ChildDie);
+// addresses stay strings in JSON, doubles would lose the upper bits
+void OutputFieldHex(struct Output* Output, const char* Name, Dwarf_Unsigned Value)
+{
+    OutputFieldName(Output, Name);
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputLiteral(Output, "\"0x");
+        OutputHex(Output, Value, 8);
+        OutputLiteral(Output, "\"");
+    } else {
+        OutputLiteral(Output, "0x");
+        OutputHex(Output, Value, 8);
     }
+    OutputFieldEnd(Output);
 }
 
-void HandleDwarfSubrangeType(Dwarf_Die Die)
+void OutputFieldRef(struct Output* Output, const char* Name, Dwarf_Off Value)
 {
-    Dwarf_Off Type = GetTagRef(Die, DW_AT_type);
-    Dwarf_Unsigned UpperBound = GetTagUnsignedData(Die, DW_AT_upper_bound);
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputFieldUnsigned(Output, Name, Value);
+        return;
+    }
 
-    fprintf(stdout, "DW_TAG_subrange_type\n"
-                    "\tDW_AT_type: <0x%0.8x>\n"
-                    "\tDW_AT_upper_bound: %llu\n",
-            Type, UpperBound);
+    OutputFieldName(Output, Name);
+    OutputLiteral(Output, "<0x");
+    OutputHex(Output, Value, 8);
+    OutputLiteral(Output, ">\n");
 }
 
-void HandleDwarfPointerType(Dwarf_Die Die)
+// deduplicated NUL separated strings, offset 0 is the empty string and stands for none
+struct StringTable {
+    char* Strings;
+    size_t Used;
+    size_t Size;
+    struct OffsetMap Index; // string hash -> offset in Strings
+};
+
+void StringTableInit(struct StringTable* Table)
 {
-    Dwarf_Unsigned Size = GetTagUnsignedData(Die, DW_AT_byte_size);
-    Dwarf_Off Type = GetTagRef(Die, DW_AT_type);
+    Table->Size = 1 << 16;
+    Table->Strings = (char*)malloc(Table->Size);
+    Table->Strings[0] = 0;
+    Table->Used = 1;
+    OffsetMapInit(&Table->Index, 4096);
+}
 
-    fprintf(stdout, "DW_TAG_pointer_type\n"
-                    "\tDW_AT_byte_size: %llu\n"
-                    "\tDW_AT_type: <0x%0.8x>\n",
-            Size, Type);
+void StringTableFree(struct StringTable* Table)
+{
+    free(Table->Strings);
+    Table->Strings = 0;
+    Table->Used = 0;
+    Table->Size = 0;
+    OffsetMapFree(&Table->Index);
 }
 
-void HandleDwarfSubroutineType(Dwarf_Die Die)
+// identical strings share one copy, a hash collision only costs a duplicate
+Dwarf_Unsigned StringTableIntern(struct StringTable* Table, const char* String)
 {
-    Dwarf_Off Sibling = GetTagRef(Die, DW_AT_sibling);
+    if (String == 0 || *String == 0) {
+        return 0;
+    }
+
+    Dwarf_Unsigned Hash = 0xcbf29ce484222325ull;
+    size_t Length = 0;
+    for (; String[Length] != 0; Length++) {
+        Hash = (Hash ^ (unsigned char)String[Length]) * 0x100000001b3ull;
+    }
+    Hash >>= 1; // OffsetMap stores Key + 1
+
+    Dwarf_Unsigned Offset = (Dwarf_Unsigned)(uintptr_t)OffsetMapFind(&Table->Index, Hash);
+    if (Offset != 0 && strcmp(Table->Strings + Offset, String) == 0) {
+        return Offset;
+    }
 
-    Dwarf_Bool HasChildren = 0;
-    Dwarf_Die ChildDie = 0;
-    if (dwarf_child(Die, &ChildDie, &GlobalDwarfError) == DW_DLV_OK) {
-        HasChildren = 1;
+    while (Table->Size - Table->Used < Length + 1) {
+        Table->Size *= 2;
+        Table->Strings = (char*)realloc(Table->Strings, Table->Size);
     }
 
-    fprintf(stdout, "DW_TAG_subroutine_type - Children: %d\n"
-                    "\tDW_AT_sibling: 0x%0.8x\n",
-            HasChildren, Sibling);
+    Dwarf_Unsigned NewOffset = Table->Used;
+    memcpy(Table->Strings + NewOffset, String, Length + 1);
+    Table->Used += Length + 1;
 
-    if (HasChildren) {
-        DwarfGetChildInfo(ChildDie);
+    if (Offset == 0) {
+        OffsetMapInsert(&Table->Index, Hash, (void*)(uintptr_t)NewOffset);
     }
+
+    return NewOffset;
 }
 
-void HandleDwarfStructureType(Dwarf_Die Die)
-{
-    char* Name = GetTagString(Die, DW_AT_name);
-    Dwarf_Unsigned Size = GetTagUnsignedData(Die, DW_AT_byte_size);
-    Dwarf_Unsigned File = GetTagUnsignedData(Die, DW_AT_decl_file);
-    Dwarf_Unsigned Line = GetTagUnsignedData(Die, DW_AT_decl_line);
-    Dwarf_Unsigned Column = GetTagUnsignedData(Die, DW_AT_decl_column);
-    Dwarf_Off Sibling = GetTagRef(Die, DW_AT_sibling);
+// imported macro units, shared by all the workers of a file
+struct MacroUnit {
+    Dwarf_Unsigned Offset;
+    char* Buffer;
+    size_t Size;
+    struct Array Imports; // units this one imports, in order, filled by whoever parses it
+    int Parsed;
+    int Emitted; // ndjson: written after the first CU importing it
+};
 
-    Dwarf_Bool HasChildren = 0;
-    Dwarf_Die ChildDie = 0;
-    if (dwarf_child(Die, &ChildDie, &GlobalDwarfError) == DW_DLV_OK) {
-        HasChildren = 1;
-    }
+struct MacroCache {
+    struct OffsetMap Units;
+    Dwarf_Unsigned References;
+    pthread_mutex_t Lock;
+    pthread_cond_t Parsed;
+};
 
-    const char* FileName = File == 0 ? "(null)" : GlobalSourceFiles.Files[File - 1];
+void MacroCacheInit(struct MacroCache* Cache)
+{
+    OffsetMapInit(&Cache->Units, 64);
+    Cache->References = 0;
+    pthread_mutex_init(&Cache->Lock, 0);
+    pthread_cond_init(&Cache->Parsed, 0);
+}
+
+// returns 1 when the unit was not seen before, the caller then has to parse it
+int MacroCacheReference(struct MacroCache* Cache, Dwarf_Unsigned Offset)
+{
+    int IsNew = 0;
 
-    fprintf(stdout, "DW_TAG_structure_type - Children: %d\n"
-                    "\tDW_AT_name: %s\n"
-                    "\tDW_AT_byte_size: %llu\n"
-                    "\tDW_AT_decl_file: %s\n"
-                    "\tDW_AT_decl_line: %d\n"
-                    "\tDW_AT_decl_column: %llu\n"
-                    "\tDW_AT_sibling: %llu\n",
-            HasChildren, Name, Size, FileName, Line, Column, Sibling);
+    pthread_mutex_lock(&Cache->Lock);
 
-    if (HasChildren) {
-        DwarfGetChildInfo(ChildDie);
+    Cache->References++;
+    if (OffsetMapFind(&Cache->Units, Offset) == 0) {
+        struct MacroUnit* Unit = (struct MacroUnit*)calloc(1, sizeof(struct MacroUnit));
+        Unit->Offset = Offset;
+        ArrayInit(&Unit->Imports, 4);
+        OffsetMapInsert(&Cache->Units, Offset, Unit);
+        IsNew = 1;
     }
+
+    pthread_mutex_unlock(&Cache->Lock);
+
+    return IsNew;
 }
 
-void HandleDwarfMember(Dwarf_Die Die)
+struct MacroUnit* MacroCacheFind(struct MacroCache* Cache, Dwarf_Unsigned Offset)
 {
-    char* Name = GetTagString(Die, DW_AT_name);
-    Dwarf_Unsigned File = GetTagUnsignedData(Die, DW_AT_decl_file);
-    Dwarf_Unsigned Line = GetTagUnsignedData(Die, DW_AT_decl_line);
-    Dwarf_Unsigned Column = GetTagUnsignedData(Die, DW_AT_decl_column);
-    Dwarf_Off Type = GetTagRef(Die, DW_AT_type);
-    Dwarf_Unsigned MemberLocation = GetTagUnsignedData(Die, DW_AT_data_member_location);
+    pthread_mutex_lock(&Cache->Lock);
+    struct MacroUnit* Unit = (struct MacroUnit*)OffsetMapFind(&Cache->Units, Offset);
+    pthread_mutex_unlock(&Cache->Lock);
 
-    const char* FileName = File == 0 ? "(null)" : GlobalSourceFiles.Files[File - 1];
+    return Unit;
+}
 
-    fprintf(stdout, "DW_TAG_member\n"
-                    "\tDW_AT_name: %s\n"
-                    "\tDW_AT_decl_file: %s\n"
-                    "\tDW_AT_decl_line: %d\n"
-                    "\tDW_AT_decl_column: %llu\n"
-                    "\tDW_AT_type: <0x%0.8x>\n"
-                    "\tDW_AT_data_member_location: %llu\n",
-            Name, FileName, Line, Column, Type, MemberLocation);
+// stores what the parser of Unit rendered and wakes up a writer waiting for it
+void MacroCacheParsed(struct MacroCache* Cache, struct MacroUnit* Unit, char* Buffer, size_t Size)
+{
+    pthread_mutex_lock(&Cache->Lock);
+    Unit->Buffer = Buffer;
+    Unit->Size = Size;
+    Unit->Parsed = 1;
+    pthread_cond_broadcast(&Cache->Parsed);
+    pthread_mutex_unlock(&Cache->Lock);
 }
 
-void HandleDwarfLexicalBlock(Dwarf_Die Die)
+// ndjson, after a CU is written: the units it imports that no earlier CU did and, breadth first,
+// the units those import; called in CU order this is the same output for any -j, since it only
+// depends on which CUs were written before and never on which worker parsed a unit
+void MacroCacheEmit(struct MacroCache* Cache, struct Array* Imports, struct Output* Output)
 {
-    Dwarf_Addr LowPC = GetTagAddress(Die, DW_AT_low_pc);
-    Dwarf_Unsigned HighPC = GetTagUnsignedData(Die, DW_AT_high_pc);
-    Dwarf_Off Sibling = GetTagRef(Die, DW_AT_sibling);
+    struct Array Pending;
+    ArrayInit(&Pending, 16);
 
-    Dwarf_Bool HasChildren = 0;
-    Dwarf_Die ChildDie = 0;
-    if (dwarf_child(Die, &ChildDie, &GlobalDwarfError) == DW_DLV_OK) {
-        HasChildren = 1;
+    pthread_mutex_lock(&Cache->Lock);
+
+    for (size_t Index = 0; Index < Imports->used; Index++) {
+        struct MacroUnit* Unit = (struct MacroUnit*)OffsetMapFind(&Cache->Units, Imports->array[Index]);
+        if (Unit != 0 && !Unit->Emitted) {
+            Unit->Emitted = 1;
+            ArrayInsert(&Pending, Unit->Offset);
+        }
     }
 
-    fprintf(stdout, "DW_TAG_lexical_block - Children: %d\n"
-                    "\tDW_AT_low_pc: 0x%0.8x\n"
-                    "\tDW_AT_high_pc: %llu\n"
-                    "\tDW_AT_sibling: 0x%0.8x\n",
-            HasChildren, LowPC, HighPC, Sibling);
+    for (size_t Index = 0; Index < Pending.used; Index++) {
+        struct MacroUnit* Unit = (struct MacroUnit*)OffsetMapFind(&Cache->Units, Pending.array[Index]);
+
+        // a worker further ahead may still be parsing it
+        while (!Unit->Parsed) {
+            pthread_cond_wait(&Cache->Parsed, &Cache->Lock);
+        }
+
+        for (size_t Import = 0; Import < Unit->Imports.used; Import++) {
+            struct MacroUnit* Child = (struct MacroUnit*)OffsetMapFind(&Cache->Units, Unit->Imports.array[Import]);
+            if (Child != 0 && !Child->Emitted) {
+                Child->Emitted = 1;
+                ArrayInsert(&Pending, Child->Offset);
+            }
+        }
+
+        char* Buffer = Unit->Buffer;
+        size_t Size = Unit->Size;
+        Unit->Buffer = 0;
 
-    if (HasChildren) {
-        DwarfGetChildInfo(ChildDie);
+        pthread_mutex_unlock(&Cache->Lock);
+        OutputBytes(Output, Buffer, Size);
+        free(Buffer);
+        pthread_mutex_lock(&Cache->Lock);
     }
+
+    pthread_mutex_unlock(&Cache->Lock);
+    ArrayFree(&Pending);
 }
 
-void HandleDwarfFormalParameter(Dwarf_Die Die)
+int MacroUnitCompare(const void* A, const void* B)
 {
-    char* Name = GetTagString(Die, DW_AT_name);
-    Dwarf_Unsigned File = GetTagUnsignedData(Die, DW_AT_decl_file);
-    Dwarf_Unsigned Line = GetTagUnsignedData(Die, DW_AT_decl_line);
-    Dwarf_Unsigned Column = GetTagUnsignedData(Die, DW_AT_decl_column);
-    Dwarf_Off Type = GetTagRef(Die, DW_AT_type);
-    Dwarf_Ptr LocationPointer = 0;
-    Dwarf_Unsigned Location = GetTagExprLoc(Die, DW_AT_location, LocationPointer);
-
-    const char* FileName = File == 0 ? "(null)" : GlobalSourceFiles.Files[File - 1];
+    Dwarf_Unsigned OffsetA = (*(struct MacroUnit**)A)->Offset;
+    Dwarf_Unsigned OffsetB = (*(struct MacroUnit**)B)->Offset;
 
-    fprintf(stdout, "DW_TAG_formal_parameter\n"
-                    "\tDW_AT_name: %s\n"
-                    "\tDW_AT_decl_file: %s\n"
-                    "\tDW_AT_decl_line: %d\n"
-                    "\tDW_AT_decl_column: %llu\n"
-                    "\tDW_AT_type: <0x%0.8x>\n"
-                    "\tDW_AT_location: %llu\n",
-            Name, FileName, Line, Column, Type, Location);
+    return OffsetA < OffsetB ? -1 : OffsetA > OffsetB;
 }
 
-void HandleDwarfSubprogram(Dwarf_Die Die)
+// prints every unit once, in .debug_macro order, and frees the cache; ndjson units were written
+// by MacroCacheEmit() and have no buffer left
+void MacroCachePrint(struct MacroCache* Cache, struct Output* Output)
 {
-    Dwarf_Bool External = GetTagFlag(Die, DW_AT_external);
-    const char* Name = GetTagString(Die, DW_AT_name);
-    Dwarf_Unsigned Line = GetTagUnsignedData(Die, DW_AT_decl_line);
-    Dwarf_Unsigned File = GetTagUnsignedData(Die, DW_AT_decl_file);
-    Dwarf_Unsigned Column = GetTagUnsignedData(Die, DW_AT_decl_column);
-    const char* LinkageName = GetTagString(Die, DW_AT_linkage_name);
-    Dwarf_Off Type = GetTagRef(Die, DW_AT_type);
-    Dwarf_Addr LowPC = GetTagAddress(Die, DW_AT_low_pc);
-    Dwarf_Unsigned HighPC = GetTagUnsignedData(Die, DW_AT_high_pc);
-    Dwarf_Ptr FrameBasePointer = 0;
-    Dwarf_Unsigned FrameBase = GetTagExprLoc(Die, DW_AT_frame_base, FrameBasePointer);
-    Dwarf_Off Sibling = GetTagRef(Die, DW_AT_sibling);
+    struct MacroUnit** Units = (struct MacroUnit**)calloc(Cache->Units.Used + 1, sizeof(struct MacroUnit*));
+    size_t Count = 0;
 
-    Dwarf_Bool HasChildren = 0;
-    Dwarf_Die ChildDie = 0;
-    if (dwarf_child(Die, &ChildDie, &GlobalDwarfError) == DW_DLV_OK) {
-        HasChildren = 1;
+    for (size_t Index = 0; Index < Cache->Units.Size; Index++) {
+        if (Cache->Units.Keys[Index] != 0) {
+            Units[Count++] = (struct MacroUnit*)Cache->Units.Values[Index];
+        }
     }
 
-    const char* FileName = File == 0 ? "(null)" : GlobalSourceFiles.Files[File - 1];
+    qsort(Units, Count, sizeof(struct MacroUnit*), MacroUnitCompare);
 
-    fprintf(stdout, "DW_TAG_subprogram - Children: %d\n"
-                    "\tDW_AT_external: %d\n"
-                    "\tDW_AT_name: %s\n"
-                    "\tDW_AT_decl_file: %s\n"
-                    "\tDW_AT_decl_line: %d\n"
-                    "\tDW_AT_decl_column: %llu\n"
-                    "\tDW_AT_linkage_name: %s\n"
-                    "\tDW_AT_type: <0x%0.8x>\n"
-                    "\tDW_AT_low_pc: 0x%0.8x\n"
-                    "\tDW_AT_high_pc: %llu\n"
-                    "\tDW_AT_frame_base: 0x%0.8x\n"
-                    "\tDW_AT_sibling: 0x%0.8x\n",
-            HasChildren, External, Name, FileName, Line, Column, LinkageName, Type, LowPC, HighPC, FrameBase, Sibling);
+    if (Count > 0 && GlobalOptions.Format == FORMAT_TEXT) {
+        OutputLiteral(Output, "Imported macro units: ");
+        OutputUnsigned(Output, Count);
+        OutputLiteral(Output, " unique, ");
+        OutputUnsigned(Output, Cache->References);
+        OutputLiteral(Output, " imports, ");
+        OutputUnsigned(Output, Cache->References - Count);
+        OutputLiteral(Output, " duplicate parses avoided\n\n");
+    }
 
-    if (HasChildren) {
-        DwarfGetChildInfo(ChildDie);
+    for (size_t Index = 0; Index < Count; Index++) {
+        if (Units[Index]->Buffer != 0) {
+            OutputBytes(Output, Units[Index]->Buffer, Units[Index]->Size);
+            OutputSeparator(Output, "\n");
+        }
+        free(Units[Index]->Buffer);
+        ArrayFree(&Units[Index]->Imports);
+        free(Units[Index]);
     }
-}
 
-void HandleDwarfVariable(Dwarf_Die Die)
-{
-    const char* Name = GetTagString(Die, DW_AT_name);
-    Dwarf_Unsigned Line = GetTagUnsignedData(Die, DW_AT_decl_line);
-    Dwarf_Unsigned File = GetTagUnsignedData(Die, DW_AT_decl_file);
-    Dwarf_Unsigned Column = GetTagUnsignedData(Die, DW_AT_decl_column);
-    Dwarf_Off Type = GetTagRef(Die, DW_AT_type);
-    Dwarf_Bool External = GetTagFlag(Die, DW_AT_external);
+    free(Units);
+    OffsetMapFree(&Cache->Units);
+    pthread_cond_destroy(&Cache->Parsed);
+    pthread_mutex_destroy(&Cache->Lock);
+}
 
-    Dwarf_Ptr LocationPointer = 0;
-    Dwarf_Unsigned Location = GetTagExprLoc(Die, DW_AT_location, LocationPointer);
+struct SourceFiles {
+    char** Files;
+    Dwarf_Signed Count;
+    Dwarf_Unsigned Base; // the file number of Files[0]: 1 up to DWARF 4, 0 from DWARF 5 on
+};
 
-    const char* FileName = File == 0 ? "(null)" : GlobalSourceFiles.Files[File - 1];
+// where file number File (DW_AT_decl_file, a line table row) sits in a CU's file list, -1 for none
+Dwarf_Signed SourceFileSlot(Dwarf_Unsigned Base, Dwarf_Signed Count, Dwarf_Unsigned File)
+{
+    if (File < Base || File - Base >= (Dwarf_Unsigned)Count) {
+        return -1;
+    }
 
-    fprintf(stdout, "DW_TAG_variable\n"
-                    "\tDW_AT_name: %s\n"
-                    "\tDW_AT_decl_file: %s\n"
-                    "\tDW_AT_decl_line: %d\n"
-                    "\tDW_AT_decl_column: %llu\n"
-                    "\tDW_AT_external: %d\n"
-                    "\tDW_AT_type: <0x%0.8x>\n"
-                    "\tDW_AT_location: %llu\n",
-            Name, FileName, Line, Column, Type, External, Location);
+    return (Dwarf_Signed)(File - Base);
 }
 
-void HandleDwarfCompilationUnit(Dwarf_Die CUDie)
-{
-    char* Producer = GetTagString(CUDie, DW_AT_producer);
-    Dwarf_Unsigned Language = GetTagUnsignedData(CUDie, DW_AT_language);
-    char* Name = GetTagString(CUDie, DW_AT_name);
-    char* Directory = GetTagString(CUDie, DW_AT_comp_dir);
-    Dwarf_Off MacroOffset = GetTagRef(CUDie, DW_AT_macros);
+struct WalkerEntry {
+    Dwarf_Die Die;
+    Dwarf_Off Offset;
+    Dwarf_Half Tag; // the parent of Stack[N] is Stack[N - 1]
+    Dwarf_Off DuplicateOf; // with --dedup-types, the first copy of this type
+};
 
-    fprintf(stdout, "Producer: %s\n"
-                    "Language: %d\n"
-                    "File: %s/%s\n"
-                    "Macro Offset and Information: 0x%0.8x\n",
-            Producer, Language, Directory, Name, MacroOffset);
-}
-
-void HandleMacroDefUndef(Dwarf_Macro_Context MacroContext, Dwarf_Half MacroOperator, int Index, const char* TagName)
+// the whole file mapped once and parsed with elf_memory(), libdwarf is handed pointers into the
+// mapping instead of reading every debug section into the heap; the mapping is private and
+// writable so libelf may fix things up in place, pages stay shared with the page cache until then
+struct ElfImage {
+    unsigned char* Data; // 0 when the file is read through dwarf_init() instead
+    size_t Size;
+    Elf* Elf;
+    int Class;
+    int ByteOrder;
+    size_t SectionCount;
+    size_t StringTableIndex;
+    Dwarf_Obj_Access_Interface Interface;
+};
+
+int ElfImageSectionInfo(void* Object, Dwarf_Half Index, Dwarf_Obj_Access_Section* Section, int* Error)
 {
-    Dwarf_Unsigned MLine = 0;
-    Dwarf_Unsigned MIndex = 0;
-    Dwarf_Unsigned MOffset = 0;
-    Dwarf_Half MFormsCount = 0;
-    const char* MacroString = 0;
+    struct ElfImage* Image = (struct ElfImage*)Object;
+    GElf_Shdr Header;
 
-    int Result = dwarf_get_macro_defundef(MacroContext, Index, &MLine, &MIndex, &MOffset, &MFormsCount, &MacroString, 0);
-    if (Result != DW_DLV_OK) {
-        exit(1);
+    Elf_Scn* Scn = elf_getscn(Image->Elf, Index);
+    if (Scn == 0 || gelf_getshdr(Scn, &Header) == 0) {
+        *Error = DW_DLE_ELF_SECT_ERR;
+        return DW_DLV_ERROR;
     }
 
-    fprintf(stdout, "\t[%d] 0x%0.2x %s line:%d %s\n", Index, MacroOperator, TagName, MLine, MacroString);
+    const char* Name = elf_strptr(Image->Elf, Image->StringTableIndex, Header.sh_name);
+
+    Section->addr = Header.sh_addr;
+    Section->type = Header.sh_type;
+    Section->size = Header.sh_size;
+    Section->name = Name == 0 ? "" : Name;
+    Section->link = Header.sh_link;
+    Section->info = Header.sh_info;
+    Section->entrysize = Header.sh_entsize;
+
+    return DW_DLV_OK;
 }
 
-void HandleMacroStartFile(Dwarf_Macro_Context MacroContext, Dwarf_Half MacroOperator, int Index, const char* TagName)
+Dwarf_Endianness ElfImageByteOrder(void* Object)
 {
-    Dwarf_Unsigned MLine = 0;
-    Dwarf_Unsigned MIndex = 0;
-    const char* MacroString = 0;
+    return ((struct ElfImage*)Object)->ByteOrder == ELFDATA2MSB ? DW_OBJECT_MSB : DW_OBJECT_LSB;
+}
 
-    int Result = dwarf_get_macro_startend_file(MacroContext, Index, &MLine, &MIndex, &MacroString, 0);
-    if (Result != DW_DLV_OK) {
-        exit(1);
-    }
+// the default offset size, DWARF64 units still announce themselves in their initial length
+Dwarf_Small ElfImageLengthSize(void* Object)
+{
+    (void)Object;
+    return 4;
+}
 
-    fprintf(stdout, "\t[%d] 0x%0.2x %s line:%d file number: %d %s\n", Index, MacroOperator, TagName, MLine, MIndex, MacroString);
+Dwarf_Small ElfImagePointerSize(void* Object)
+{
+    return ((struct ElfImage*)Object)->Class == ELFCLASS64 ? 8 : 4;
 }
 
-void HandleMacroEndFile(Dwarf_Macro_Context MacroContext, Dwarf_Half MacroOperator, int Index, const char* TagName)
+Dwarf_Unsigned ElfImageSectionCount(void* Object)
 {
-    Dwarf_Unsigned MLine = 0;
-    Dwarf_Unsigned MIndex = 0;
-    const char* MacroString = 0;
+    return ((struct ElfImage*)Object)->SectionCount;
+}
 
-    int Result = dwarf_get_macro_startend_file(MacroContext, Index, &MLine, &MIndex, &MacroString, 0);
-    if (Result != DW_DLV_OK) {
-        exit(1);
+int ElfImageLoadSection(void* Object, Dwarf_Half Index, Dwarf_Small** Data, int* Error)
+{
+    struct ElfImage* Image = (struct ElfImage*)Object;
+    GElf_Shdr Header;
+
+    Elf_Scn* Scn = elf_getscn(Image->Elf, Index);
+    if (Scn == 0 || gelf_getshdr(Scn, &Header) == 0) {
+        *Error = DW_DLE_ELF_SECT_ERR;
+        return DW_DLV_ERROR;
     }
 
-    fprintf(stdout, "\t[%d] 0x%0.2x %s\n", Index, MacroOperator, TagName);
+    if (Header.sh_type == SHT_NOBITS) {
+        return DW_DLV_NO_ENTRY;
+    }
+
+    if (Header.sh_offset > Image->Size || Header.sh_size > Image->Size - Header.sh_offset) {
+        *Error = DW_DLE_ELF_SECT_ERR;
+        return DW_DLV_ERROR;
+    }
+
+    *Data = Image->Data + Header.sh_offset;
+    return DW_DLV_OK;
 }
 
-void HandleMacroImport(Dwarf_Macro_Context MacroContext, Dwarf_Half MacroOperator, int Index, const char* TagName)
-{
-    Dwarf_Unsigned MLine = 0;
-    Dwarf_Unsigned MOffset = 0;
+static const Dwarf_Obj_Access_Methods ElfImageMethods = {
+    .get_section_info = ElfImageSectionInfo,
+    .get_byte_order = ElfImageByteOrder,
+    .get_length_size = ElfImageLengthSize,
+    .get_pointer_size = ElfImagePointerSize,
+    .get_section_count = ElfImageSectionCount,
+    .load_section = ElfImageLoadSection,
+    .relocate_a_section = 0,
+};
 
-    int Result = dwarf_get_macro_import(MacroContext, Index, &MOffset, 0);
-    if (Result != DW_DLV_OK) {
-        exit(1);
+void ElfImageClose(struct ElfImage* Image)
+{
+    if (Image->Elf != 0) {
+        elf_end(Image->Elf);
     }
 
-    ArrayInsert(&GlobalArray, MOffset);
+    if (Image->Data != 0) {
+        munmap(Image->Data, Image->Size);
+    }
 
-    fprintf(stdout, "\t[%d] 0x%0.2x %s offset 0x%0.8x\n", Index, MacroOperator, TagName, MOffset);
+    memset(Image, 0, sizeof(*Image));
 }
 
-void HandleDwarfCompilationUnitMacros(Dwarf_Die CUDie)
+// -1 when the file needs dwarf_init(): relocatable objects, whose debug sections want
+// relocations applied, and compressed debug sections, which would have to be inflated anyway
+int ElfImageOpen(struct ElfImage* Image, int FileDescriptor)
 {
-    Dwarf_Unsigned Version = 0;
-    Dwarf_Macro_Context MacroContext = 0;
-    Dwarf_Unsigned MacroUnitOffset = 0;
-    Dwarf_Unsigned MacroOpsCount = 0;
-    Dwarf_Unsigned MacroOpsDataLength = 0;
+    struct stat Status;
+    GElf_Ehdr Header;
 
-    int Result = dwarf_get_macro_context(CUDie, &Version, &MacroContext, &MacroUnitOffset, &MacroOpsCount, &MacroOpsDataLength, 0);
-    if (Result != DW_DLV_OK) {
-        fprintf(stderr, "dwarf_get_macro_context() error\n");
-        exit(1);
+    memset(Image, 0, sizeof(*Image));
+
+    if (fstat(FileDescriptor, &Status) != 0 || Status.st_size == 0) {
+        return -1;
     }
 
-    fprintf(stdout, "Macro data from CU-DIE at .debug_info offset 0x%0.8x:\n"
-                    "Macro Version: %d\n"
-                    "MacroInformationEntries count: %d, bytes length: %d\n",
-            MacroUnitOffset, Version, MacroOpsCount, MacroOpsDataLength);
+    void* Data = mmap(0, Status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, FileDescriptor, 0);
+    if (Data == MAP_FAILED) {
+        return -1;
+    }
 
-    for (int Index = 0; Index < MacroOpsCount; Index++) {
-        Dwarf_Unsigned SectionOffset = 0;
-        Dwarf_Half MacroOperator = 0;
-        Dwarf_Half FormsCount = 0;
-        const Dwarf_Small* FormCodeArray = 0;
-        const char* MacroName = 0;
+    Image->Data = (unsigned char*)Data;
+    Image->Size = Status.st_size;
+    Image->Elf = elf_memory((char*)Data, Status.st_size);
 
-        Result = dwarf_get_macro_op(MacroContext, Index, &SectionOffset, &MacroOperator, &FormsCount, &FormCodeArray, 0);
-        if (Result != DW_DLV_OK) {
+    if (Image->Elf == 0 || elf_kind(Image->Elf) != ELF_K_ELF || gelf_getehdr(Image->Elf, &Header) == 0 || Header.e_type == ET_REL
+        || elf_getshdrnum(Image->Elf, &Image->SectionCount) != 0 || elf_getshdrstrndx(Image->Elf, &Image->StringTableIndex) != 0) {
+        ElfImageClose(Image);
+        return -1;
+    }
+
+    Elf_Scn* Section = 0;
+    while ((Section = elf_nextscn(Image->Elf, Section)) != 0) {
+        GElf_Shdr SectionHeader;
+        if (gelf_getshdr(Section, &SectionHeader) == 0) {
+            continue;
+        }
+
+        const char* Name = elf_strptr(Image->Elf, Image->StringTableIndex, SectionHeader.sh_name);
+        if (Name == 0) {
+            continue;
+        }
+
+        if (strncmp(Name, ".zdebug", 7) == 0 || (strncmp(Name, ".debug", 6) == 0 && (SectionHeader.sh_flags & SHF_COMPRESSED))) {
+            ElfImageClose(Image);
+            return -1;
+        }
+    }
+
+    Image->Class = Header.e_ident[EI_CLASS];
+    Image->ByteOrder = Header.e_ident[EI_DATA];
+    Image->Interface.object = Image;
+    Image->Interface.methods = &ElfImageMethods;
+
+    return 0;
+}
+
+// a libdwarf handle over a .dwo or .dwp file, mapped like the main file when possible
+struct DebugHandle {
+    int FileDescriptor;
+    struct ElfImage Image;
+    Dwarf_Debug Debug;
+};
+
+int DebugHandleOpen(struct DebugHandle* Handle, const char* Path)
+{
+    Dwarf_Error Error = 0;
+    int Result = DW_DLV_ERROR;
+
+    memset(Handle, 0, sizeof(*Handle));
+
+    Handle->FileDescriptor = open(Path, O_RDONLY);
+    if (Handle->FileDescriptor < 0) {
+        return -1;
+    }
+
+    if (ElfImageOpen(&Handle->Image, Handle->FileDescriptor) == 0) {
+        Result = dwarf_object_init_b(&Handle->Image.Interface, 0, 0, DW_GROUPNUMBER_ANY, &Handle->Debug, &Error);
+        if (Result != DW_DLV_OK) {
+            ElfImageClose(&Handle->Image);
+        }
+    }
+
+    if (Result != DW_DLV_OK) {
+        Result = dwarf_init(Handle->FileDescriptor, DW_DLC_READ, 0, 0, &Handle->Debug, &Error);
+    }
+
+    if (Result != DW_DLV_OK) {
+        close(Handle->FileDescriptor);
+        Handle->FileDescriptor = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+void DebugHandleClose(struct DebugHandle* Handle)
+{
+    if (Handle->Image.Data != 0) {
+        dwarf_object_finish(Handle->Debug, 0);
+        ElfImageClose(&Handle->Image);
+    } else {
+        dwarf_finish(Handle->Debug, 0);
+    }
+
+    close(Handle->FileDescriptor);
+    Handle->FileDescriptor = -1;
+}
+
+// all the state needed to dump one file, one per worker
+struct DwarfContext {
+    int FileDescriptor;
+    Elf* Elf; // Image.Elf when the file is mapped
+    struct ElfImage Image;
+    Dwarf_Debug Debug;
+    Dwarf_Error Error;
+    struct SourceFiles SourceFiles;
+    struct Array ImportedMacros; // units this context has to parse
+    struct Array MacroImports; // every unit the current CU imports itself, in order
+    struct MacroUnit* MacroUnit; // the imported unit being parsed, 0 while the CU's own are
+    struct MacroCache* MacroCache;
+    struct WalkerEntry* WalkStack; // WalkDepthLimit entries
+    int WalkDepthLimit;
+    struct Output* Output;
+    struct DieColumns* Columns; // set in --columns mode, DIEs become rows instead of text
+    struct SymbolIndex* Symbols; // set in --symbolize mode, functions and blocks become ranges
+    struct LineTable* Lines; // set in --addr2line and --line2addr mode, only line tables are read
+    struct NameIndex* Names; // set while --find builds its fallback index, named DIEs become entries
+    struct LayoutTable* Layouts; // set in --layout mode, only struct definitions are read
+    struct DumpStats* Stats; // with --stats
+    const char* ObjectPath; // the file given, its .dwp sits next to it
+    struct DebugHandle* Package; // the .dwp, opened for the first skeleton unit
+    int PackageMissing;
+    struct OffsetMap TypeNames; // .debug_info offset -> struct TypeName, with --resolve-types
+    struct OffsetMap Locations; // DIE offset * 2 + is frame base -> struct LocationList
+    struct OffsetMap TypeHashes; // .debug_info offset * 2 + is reference -> hash, with --dedup-types and --layout
+    struct OffsetMap TypeCanonical; // structural hash -> offset of the first copy printed, kept across .dwo files
+    int DiffHashing; // diff mode, see DiffIgnoredAttribute() and TypeHashReference()
+    Dwarf_Off UnitOffset; // CU being printed
+    Dwarf_Unsigned MacroUnitOffset; // .debug_macro unit being printed
+    struct Array* Boundaries; // output positions after .debug_str and after every CU, for the cache
+    int Failed; // library builds: a libdwarf error the walk could not get past, see DwarfContextFail()
+};
+
+// a libdwarf error the dump cannot continue after: the tool reports it and exits, the library
+// must not take its host process down and only marks the context failed
+void DwarfContextFail(struct DwarfContext* Context, const char* Call)
+{
+#ifdef SELFDWARF_LIBRARY
+    (void)Call;
+    Context->Failed = 1;
+#else
+    fprintf(stderr, "%s error: %s\n", Call, dwarf_errmsg(Context->Error));
+    exit(1);
+#endif
+}
+
+// every attribute of one DIE from a single dwarf_attrlist() walk, indexed by DW_AT_*
+#define ATTRIBUTE_TABLE_SIZE (DW_AT_loclists_base + 1)
+
+struct DieAttributes {
+    Dwarf_Attribute Table[ATTRIBUTE_TABLE_SIZE];
+    Dwarf_Attribute* List;
+    Dwarf_Signed Count;
+};
+
+#define TAG_TABLE_SIZE 75
+
+void HandleDwarfEnumerationType(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren);
+void HandleDwarfEnumerator(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren);
+void HandleDwarfBaseType(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren);
+void HandleDwarfTypedef(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren);
+void HandleDwarfArrayType(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren);
+void HandleDwarfSubrangeType(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren);
+void HandleDwarfPointerType(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren);
+void HandleDwarfSubroutineType(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren);
+void HandleDwarfStructureType(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren);
+void HandleDwarfMember(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren);
+void HandleDwarfFormalParameter(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren);
+void HandleDwarfLexicalBlock(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren);
+void HandleDwarfSubprogram(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren);
+void HandleDwarfVariable(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren);
+
+void (*TagFunctions[TAG_TABLE_SIZE])(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren) = {
+    [DW_TAG_enumeration_type] = HandleDwarfEnumerationType,
+    [DW_TAG_enumerator] = HandleDwarfEnumerator,
+    [DW_TAG_base_type] = HandleDwarfBaseType,
+    [DW_TAG_typedef] = HandleDwarfTypedef,
+    [DW_TAG_array_type] = HandleDwarfArrayType,
+    [DW_TAG_subrange_type] = HandleDwarfSubrangeType,
+    [DW_TAG_pointer_type] = HandleDwarfPointerType,
+    [DW_TAG_subroutine_type] = HandleDwarfSubroutineType,
+    [DW_TAG_formal_parameter] = HandleDwarfFormalParameter,
+    [DW_TAG_structure_type] = HandleDwarfStructureType,
+    [DW_TAG_member] = HandleDwarfMember,
+    [DW_TAG_lexical_block] = HandleDwarfLexicalBlock,
+    [DW_TAG_subprogram] = HandleDwarfSubprogram,
+    [DW_TAG_variable] = HandleDwarfVariable,
+};
+
+// tags whose children are visited too
+Dwarf_Bool TagDescends[TAG_TABLE_SIZE] = {
+    [DW_TAG_enumeration_type] = 1,
+    [DW_TAG_array_type] = 1,
+    [DW_TAG_subroutine_type] = 1,
+    [DW_TAG_structure_type] = 1,
+    [DW_TAG_lexical_block] = 1,
+    [DW_TAG_subprogram] = 1,
+};
+
+// wall clock spent per phase, for --timing
+struct TimingStats {
+    Dwarf_Unsigned WalkNanoseconds;
+    Dwarf_Unsigned LineNanoseconds;
+    Dwarf_Unsigned LineRows;
+};
+
+static struct TimingStats GlobalTimingStats;
+
+Dwarf_Unsigned TimingNow()
+{
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+
+    return (Dwarf_Unsigned)Now.tv_sec * 1000000000ull + Now.tv_nsec;
+}
+
+// --stats counters, kept per context so workers never share them and summed into GlobalStats
+// when the context is closed; Context->Stats is 0 without --stats
+enum StatsPhase {
+    PHASE_OPEN,
+    PHASE_STRINGS,
+    PHASE_SOURCE_FILES,
+    PHASE_UNIT_HEADER,
+    PHASE_MACROS,
+    PHASE_MACRO_IMPORTS,
+    PHASE_LINES,
+    PHASE_WALK,
+    PHASE_COUNT,
+};
+
+static const char* StatsPhaseNames[PHASE_COUNT] = {
+    [PHASE_OPEN] = "open",
+    [PHASE_STRINGS] = "debug_str",
+    [PHASE_SOURCE_FILES] = "source_files",
+    [PHASE_UNIT_HEADER] = "cu_header",
+    [PHASE_MACROS] = "macros",
+    [PHASE_MACRO_IMPORTS] = "macro_imports",
+    [PHASE_LINES] = "lines",
+    [PHASE_WALK] = "die_walk",
+};
+
+#define STATS_VENDOR_TAGS 256
+
+struct DumpStats {
+    Dwarf_Unsigned PhaseNanoseconds[PHASE_COUNT];
+    Dwarf_Unsigned Tags[TAG_TABLE_SIZE];
+    Dwarf_Unsigned VendorTags[STATS_VENDOR_TAGS]; // from DW_TAG_lo_user
+    Dwarf_Unsigned OtherTags;
+    Dwarf_Unsigned Units;
+    Dwarf_Unsigned AttributeLists;
+    Dwarf_Unsigned Attributes;
+    Dwarf_Unsigned DwarfCalls; // DIE navigation and attribute list calls
+    Dwarf_Unsigned BytesWritten;
+};
+
+static struct DumpStats GlobalStats;
+
+Dwarf_Unsigned StatsBegin(struct DwarfContext* Context)
+{
+    return Context->Stats != 0 ? TimingNow() : 0;
+}
+
+void StatsEnd(struct DwarfContext* Context, enum StatsPhase Phase, Dwarf_Unsigned Start)
+{
+    if (Context->Stats != 0) {
+        Context->Stats->PhaseNanoseconds[Phase] += TimingNow() - Start;
+    }
+}
+
+void StatsCountTag(struct DumpStats* Stats, Dwarf_Half Tag)
+{
+    if (Tag < TAG_TABLE_SIZE) {
+        Stats->Tags[Tag]++;
+    } else if (Tag >= DW_TAG_lo_user && Tag - DW_TAG_lo_user < STATS_VENDOR_TAGS) {
+        Stats->VendorTags[Tag - DW_TAG_lo_user]++;
+    } else {
+        Stats->OtherTags++;
+    }
+}
+
+void StatsMerge(struct DumpStats* Total, struct DumpStats* Stats)
+{
+    Dwarf_Unsigned* Into = (Dwarf_Unsigned*)Total;
+    Dwarf_Unsigned* From = (Dwarf_Unsigned*)Stats;
+
+    for (size_t Index = 0; Index < sizeof(struct DumpStats) / sizeof(Dwarf_Unsigned); Index++) {
+        __atomic_fetch_add(&Into[Index], From[Index], __ATOMIC_RELAXED);
+    }
+}
+
+// bytes that reached a file or stdout
+void StatsCountOutput(struct Output* Output)
+{
+    if (GlobalOptions.Stats) {
+        __atomic_fetch_add(&GlobalStats.BytesWritten, Output->Written, __ATOMIC_RELAXED);
+    }
+}
+
+void StatsPrintTag(struct Output* Output, int Json, Dwarf_Half Tag, Dwarf_Unsigned Count, int* First)
+{
+    const char* Name = 0;
+    char Unknown[32];
+
+    if (Count == 0) {
+        return;
+    }
+
+    if (dwarf_get_TAG_name(Tag, &Name) != DW_DLV_OK) {
+        snprintf(Unknown, sizeof(Unknown), "0x%x", Tag);
+        Name = Unknown;
+    }
+
+    int Skipped = Tag >= TAG_TABLE_SIZE || TagFunctions[Tag] == 0;
+
+    if (Json) {
+        OutputString(Output, *First ? "" : ",");
+        OutputJsonString(Output, Name);
+        OutputLiteral(Output, ":{\"count\":");
+        OutputUnsigned(Output, Count);
+        OutputString(Output, Skipped ? ",\"skipped\":true}" : "}");
+    } else {
+        OutputLiteral(Output, "\t");
+        OutputString(Output, Name);
+        OutputLiteral(Output, ": ");
+        OutputUnsigned(Output, Count);
+        OutputString(Output, Skipped ? " (skipped)\n" : "\n");
+    }
+    *First = 0;
+}
+
+// the summary on stderr, one JSON object with --stats=json
+void StatsPrint(struct DumpStats* Stats, int Json)
+{
+    struct Output Output;
+    Dwarf_Unsigned Dies = Stats->OtherTags;
+    int First = 1;
+
+    for (int Tag = 0; Tag < TAG_TABLE_SIZE; Tag++) {
+        Dies += Stats->Tags[Tag];
+    }
+    for (int Tag = 0; Tag < STATS_VENDOR_TAGS; Tag++) {
+        Dies += Stats->VendorTags[Tag];
+    }
+
+    OutputInit(&Output, STDERR_FILENO);
+
+    if (Json) {
+        OutputLiteral(&Output, "{\"record\":\"stats\",\"phases_ns\":{");
+        for (int Phase = 0; Phase < PHASE_COUNT; Phase++) {
+            OutputString(&Output, Phase == 0 ? "\"" : ",\"");
+            OutputString(&Output, StatsPhaseNames[Phase]);
+            OutputLiteral(&Output, "\":");
+            OutputUnsigned(&Output, Stats->PhaseNanoseconds[Phase]);
+        }
+        OutputLiteral(&Output, "},\"units\":");
+        OutputUnsigned(&Output, Stats->Units);
+        OutputLiteral(&Output, ",\"dies\":");
+        OutputUnsigned(&Output, Dies);
+        OutputLiteral(&Output, ",\"attribute_lists\":");
+        OutputUnsigned(&Output, Stats->AttributeLists);
+        OutputLiteral(&Output, ",\"attributes\":");
+        OutputUnsigned(&Output, Stats->Attributes);
+        OutputLiteral(&Output, ",\"libdwarf_calls\":");
+        OutputUnsigned(&Output, Stats->DwarfCalls);
+        OutputLiteral(&Output, ",\"bytes_written\":");
+        OutputUnsigned(&Output, Stats->BytesWritten);
+        OutputLiteral(&Output, ",\"other_tags\":");
+        OutputUnsigned(&Output, Stats->OtherTags);
+        OutputLiteral(&Output, ",\"tags\":{");
+    } else {
+        OutputLiteral(&Output, "Phases (summed over workers):\n");
+        for (int Phase = 0; Phase < PHASE_COUNT; Phase++) {
+            char Seconds[32];
+            snprintf(Seconds, sizeof(Seconds), "%.6f s\n", Stats->PhaseNanoseconds[Phase] / 1e9);
+            OutputLiteral(&Output, "\t");
+            OutputString(&Output, StatsPhaseNames[Phase]);
+            OutputLiteral(&Output, ": ");
+            OutputString(&Output, Seconds);
+        }
+        OutputLiteral(&Output, "CUs: ");
+        OutputUnsigned(&Output, Stats->Units);
+        OutputLiteral(&Output, ", DIEs: ");
+        OutputUnsigned(&Output, Dies);
+        OutputLiteral(&Output, ", attribute lists: ");
+        OutputUnsigned(&Output, Stats->AttributeLists);
+        OutputLiteral(&Output, ", attributes: ");
+        OutputUnsigned(&Output, Stats->Attributes);
+        OutputLiteral(&Output, ", libdwarf calls: ");
+        OutputUnsigned(&Output, Stats->DwarfCalls);
+        OutputLiteral(&Output, ", bytes written: ");
+        OutputUnsigned(&Output, Stats->BytesWritten);
+        OutputLiteral(&Output, "\nDIEs per tag:\n");
+    }
+
+    for (int Tag = 0; Tag < TAG_TABLE_SIZE; Tag++) {
+        StatsPrintTag(&Output, Json, Tag, Stats->Tags[Tag], &First);
+    }
+    for (int Tag = 0; Tag < STATS_VENDOR_TAGS; Tag++) {
+        StatsPrintTag(&Output, Json, DW_TAG_lo_user + Tag, Stats->VendorTags[Tag], &First);
+    }
+
+    if (Json) {
+        OutputLiteral(&Output, "}}\n");
+    } else if (Stats->OtherTags != 0) {
+        OutputLiteral(&Output, "\tother: ");
+        OutputUnsigned(&Output, Stats->OtherTags);
+        OutputLiteral(&Output, " (skipped)\n");
+    }
+
+    OutputFlush(&Output);
+    OutputFree(&Output);
+}
+
+// the CU's file list for DW_AT_decl_file, released by DwarfReleaseCompilationUnit()
+void DwarfLoadSourceFiles(struct DwarfContext* Context, Dwarf_Die Die)
+{
+    Dwarf_Half Version = 0;
+    Dwarf_Half OffsetSize = 0;
+
+    if (dwarf_srcfiles(Die, &Context->SourceFiles.Files, &Context->SourceFiles.Count, 0) != DW_DLV_OK) {
+        Context->SourceFiles.Files = 0;
+        Context->SourceFiles.Count = 0;
+    }
+
+    dwarf_get_version_of_die(Die, &Version, &OffsetSize);
+    Context->SourceFiles.Base = Version >= 5 ? 0 : 1;
+}
+
+void GetAllSourceFiles(struct DwarfContext* Context, Dwarf_Die Die)
+{
+    DwarfLoadSourceFiles(Context, Die);
+
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        for (int Index = 0; Index < Context->SourceFiles.Count; Index++) {
+            OutputRecordBegin(Context->Output, "file");
+            OutputFieldUnsigned(Context->Output, "cu", Context->UnitOffset);
+            OutputFieldUnsigned(Context->Output, "index", Index + Context->SourceFiles.Base);
+            OutputFieldString(Context->Output, "name", Context->SourceFiles.Files[Index]);
+            OutputRecordEnd(Context->Output);
+        }
+        return;
+    }
+
+    OutputLiteral(Context->Output, "Detected files:\n");
+    for (int Index = 0; Index < Context->SourceFiles.Count; Index++) {
+        OutputLiteral(Context->Output, "\t");
+        OutputString(Context->Output, Context->SourceFiles.Files[Index]);
+        OutputLiteral(Context->Output, "\n");
+    }
+}
+
+const char* SourceFileName(struct DwarfContext* Context, Dwarf_Unsigned File)
+{
+    Dwarf_Signed Slot = SourceFileSlot(Context->SourceFiles.Base, Context->SourceFiles.Count, File);
+
+    return Slot < 0 ? 0 : Context->SourceFiles.Files[Slot];
+}
+
+void DieAttributesLoad(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes)
+{
+    memset(Attributes->Table, 0, sizeof(Attributes->Table));
+
+    if (dwarf_attrlist(Die, &Attributes->List, &Attributes->Count, &Context->Error) != DW_DLV_OK) {
+        Attributes->List = 0;
+        Attributes->Count = 0;
+        return;
+    }
+
+    if (Context->Stats != 0) {
+        Context->Stats->AttributeLists++;
+        Context->Stats->Attributes += Attributes->Count;
+        Context->Stats->DwarfCalls += 1 + Attributes->Count;
+    }
+
+    for (Dwarf_Signed Index = 0; Index < Attributes->Count; Index++) {
+        Dwarf_Half AttributeCode = 0;
+        if (dwarf_whatattr(Attributes->List[Index], &AttributeCode, 0) == DW_DLV_OK && AttributeCode < ATTRIBUTE_TABLE_SIZE) {
+            Attributes->Table[AttributeCode] = Attributes->List[Index];
+        }
+    }
+}
+
+void DieAttributesFree(struct DwarfContext* Context, struct DieAttributes* Attributes)
+{
+    for (Dwarf_Signed Index = 0; Index < Attributes->Count; Index++) {
+        dwarf_dealloc(Context->Debug, Attributes->List[Index], DW_DLA_ATTR);
+    }
+
+    if (Attributes->List != 0) {
+        dwarf_dealloc(Context->Debug, Attributes->List, DW_DLA_LIST);
+    }
+
+    Attributes->List = 0;
+    Attributes->Count = 0;
+}
+
+Dwarf_Attribute GetTagAttribute(struct DieAttributes* Attributes, Dwarf_Half AttributeCode)
+{
+    return AttributeCode < ATTRIBUTE_TABLE_SIZE ? Attributes->Table[AttributeCode] : 0;
+}
+
+char* GetTagString(struct DieAttributes* Attributes, Dwarf_Half AttributeCode)
+{
+    int Result = 0;
+
+    char* Value = 0;
+    Dwarf_Attribute Attribute = GetTagAttribute(Attributes, AttributeCode);
+    if (Attribute == 0) {
+        return 0;
+    }
+
+    Result = dwarf_formstring(Attribute, &Value, 0);
+    if (Result != DW_DLV_OK) {
+        return 0;
+    }
+
+    return Value;
+}
+
+Dwarf_Unsigned GetTagUnsignedData(struct DieAttributes* Attributes, Dwarf_Half AttributeCode)
+{
+    int Result = 0;
+
+    Dwarf_Unsigned Value = 0;
+    Dwarf_Attribute Attribute = GetTagAttribute(Attributes, AttributeCode);
+    if (Attribute == 0) {
+        return 0;
+    }
+
+    Result = dwarf_formudata(Attribute, &Value, 0);
+    if (Result != DW_DLV_OK) {
+        return 0;
+    }
+
+    return Value;
+}
+
+Dwarf_Off GetTagRef(struct DieAttributes* Attributes, Dwarf_Half AttributeCode)
+{
+    int Result = 0;
+
+    Dwarf_Off Value = 0;
+    Dwarf_Attribute Attribute = GetTagAttribute(Attributes, AttributeCode);
+    if (Attribute == 0) {
+        return 0;
+    }
+
+    Result = dwarf_formref(Attribute, &Value, 0);
+    if (Result != DW_DLV_OK) {
+        return 0;
+    }
+
+    return Value;
+}
+
+// .debug_info offset, where GetTagRef() is relative to the CU
+Dwarf_Off GetTagGlobalRef(struct DieAttributes* Attributes, Dwarf_Half AttributeCode)
+{
+    int Result = 0;
+
+    Dwarf_Off Value = 0;
+    Dwarf_Attribute Attribute = GetTagAttribute(Attributes, AttributeCode);
+    if (Attribute == 0) {
+        return 0;
+    }
+
+    Result = dwarf_global_formref(Attribute, &Value, 0);
+    if (Result != DW_DLV_OK) {
+        return 0;
+    }
+
+    return Value;
+}
+
+Dwarf_Bool GetTagFlag(struct DieAttributes* Attributes, Dwarf_Half AttributeCode)
+{
+    int Result = 0;
+
+    Dwarf_Bool Value = 0;
+    Dwarf_Attribute Attribute = GetTagAttribute(Attributes, AttributeCode);
+    if (Attribute == 0) {
+        return 0;
+    }
+
+    Result = dwarf_formflag(Attribute, &Value, 0);
+    if (Result != DW_DLV_OK) {
+        return 0;
+    }
+
+    return Value;
+}
+
+Dwarf_Addr GetTagAddress(struct DieAttributes* Attributes, Dwarf_Half AttributeCode)
+{
+    int Result = 0;
+
+    Dwarf_Addr Value = 0;
+    Dwarf_Attribute Attribute = GetTagAttribute(Attributes, AttributeCode);
+    if (Attribute == 0) {
+        return 0;
+    }
+
+    Result = dwarf_formaddr(Attribute, &Value, 0);
+    if (Result != DW_DLV_OK) {
+        return 0;
+    }
+
+    return Value;
+}
+
+// DW_AT_high_pc as an address, DWARF 4 and later usually store it as a length from low_pc
+Dwarf_Addr GetTagHighPC(struct DieAttributes* Attributes, Dwarf_Addr LowPC)
+{
+    Dwarf_Addr Value = 0;
+    Dwarf_Attribute Attribute = GetTagAttribute(Attributes, DW_AT_high_pc);
+    if (Attribute == 0) {
+        return 0;
+    }
+
+    if (dwarf_formaddr(Attribute, &Value, 0) != DW_DLV_OK) {
+        Value = LowPC + GetTagUnsignedData(Attributes, DW_AT_high_pc);
+    }
+
+    return Value;
+}
+
+// length of a DW_FORM_exprloc block, Pointer gets its bytes; 0 for location lists
+Dwarf_Unsigned GetTagExprLoc(struct DwarfContext* Context, struct DieAttributes* Attributes, Dwarf_Half AttributeCode, Dwarf_Ptr* Pointer)
+{
+    Dwarf_Unsigned Length = 0;
+
+    Dwarf_Attribute Attribute = GetTagAttribute(Attributes, AttributeCode);
+    if (Attribute == 0) {
+        return 0;
+    }
+
+    int Result = dwarf_formexprloc(Attribute, &Length, Pointer, &Context->Error);
+    if (Result != DW_DLV_OK) {
+        return 0;
+    }
+
+    return Length;
+}
+
+// columnar DIE export, one fixed-width array per attribute plus a string table
+#define COLUMNS_MAGIC "SDDCOLS1"
+#define COLUMNS_VERSION 1
+
+enum ColumnId {
+    COLUMN_TAG,
+    COLUMN_OFFSET,
+    COLUMN_PARENT,
+    COLUMN_NAME,
+    COLUMN_TYPE,
+    COLUMN_DECL_FILE,
+    COLUMN_DECL_LINE,
+    COLUMN_DECL_COLUMN,
+    COLUMN_LOW_PC,
+    COLUMN_HIGH_PC,
+    COLUMN_BYTE_SIZE,
+    COLUMN_COUNT,
+};
+
+// bytes per row of every column
+static const uint32_t ColumnWidths[COLUMN_COUNT] = {
+    [COLUMN_TAG] = 2,
+    [COLUMN_OFFSET] = 8,
+    [COLUMN_PARENT] = 8,
+    [COLUMN_NAME] = 8,
+    [COLUMN_TYPE] = 8,
+    [COLUMN_DECL_FILE] = 8,
+    [COLUMN_DECL_LINE] = 4,
+    [COLUMN_DECL_COLUMN] = 4,
+    [COLUMN_LOW_PC] = 8,
+    [COLUMN_HIGH_PC] = 8,
+    [COLUMN_BYTE_SIZE] = 8,
+};
+
+// file layout, all in host byte order (Version reads as 0x01000000 on a mismatch):
+// header, then every column 8 byte aligned at its Offset, then the string table.
+// NAME and DECL_FILE are offsets into the string table, 0 is the empty string and means none.
+// TYPE and PARENT are .debug_info offsets like OFFSET, PARENT of a CU is ~0.
+struct ColumnsHeader {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t ColumnCount;
+    uint64_t Rows;
+    uint64_t StringsOffset;
+    uint64_t StringsSize;
+    struct {
+        uint32_t Id;
+        uint32_t Width;
+        uint64_t Offset;
+    } Columns[COLUMN_COUNT];
+};
+
+struct DieColumns {
+    char* Data[COLUMN_COUNT];
+    size_t Rows;
+    size_t Capacity;
+    struct StringTable Strings;
+    uint64_t* Files; // string offsets of the current CU's decl_file names
+    size_t FileCount;
+    Dwarf_Unsigned FileBase;
+};
+
+void DieColumnsInit(struct DieColumns* Columns)
+{
+    memset(Columns, 0, sizeof(*Columns));
+
+    Columns->Capacity = 4096;
+    for (int Id = 0; Id < COLUMN_COUNT; Id++) {
+        Columns->Data[Id] = (char*)malloc(Columns->Capacity * ColumnWidths[Id]);
+    }
+
+    StringTableInit(&Columns->Strings);
+}
+
+void DieColumnsFree(struct DieColumns* Columns)
+{
+    for (int Id = 0; Id < COLUMN_COUNT; Id++) {
+        free(Columns->Data[Id]);
+    }
+
+    StringTableFree(&Columns->Strings);
+    free(Columns->Files);
+}
+
+void DieColumnsSet(struct DieColumns* Columns, enum ColumnId Id, Dwarf_Unsigned Value)
+{
+    char* Data = Columns->Data[Id];
+    size_t Row = Columns->Rows;
+
+    switch (ColumnWidths[Id]) {
+        case 2:
+            ((uint16_t*)Data)[Row] = (uint16_t)Value;
+            break;
+        case 4:
+            ((uint32_t*)Data)[Row] = (uint32_t)Value;
+            break;
+        default:
+            ((uint64_t*)Data)[Row] = Value;
+            break;
+    }
+}
+
+// decl_file names of a new CU, interned once instead of once per DIE
+void DieColumnsSetFiles(struct DieColumns* Columns, struct SourceFiles* SourceFiles)
+{
+    Columns->Files = (uint64_t*)realloc(Columns->Files, (SourceFiles->Count + 1) * sizeof(uint64_t));
+    Columns->FileCount = SourceFiles->Count;
+    Columns->FileBase = SourceFiles->Base;
+
+    for (Dwarf_Signed Index = 0; Index < SourceFiles->Count; Index++) {
+        Columns->Files[Index] = StringTableIntern(&Columns->Strings, SourceFiles->Files[Index]);
+    }
+}
+
+void DieColumnsAppend(struct DieColumns* Columns, Dwarf_Half Tag, Dwarf_Off Offset, Dwarf_Off Parent, struct DieAttributes* Attributes)
+{
+    if (Columns->Rows == Columns->Capacity) {
+        Columns->Capacity *= 2;
+        for (int Id = 0; Id < COLUMN_COUNT; Id++) {
+            Columns->Data[Id] = (char*)realloc(Columns->Data[Id], Columns->Capacity * ColumnWidths[Id]);
+        }
+    }
+
+    Dwarf_Unsigned File = GetTagUnsignedData(Attributes, DW_AT_decl_file);
+    Dwarf_Addr LowPC = GetTagAddress(Attributes, DW_AT_low_pc);
+    Dwarf_Addr HighPC = GetTagHighPC(Attributes, LowPC);
+
+    DieColumnsSet(Columns, COLUMN_TAG, Tag);
+    DieColumnsSet(Columns, COLUMN_OFFSET, Offset);
+    DieColumnsSet(Columns, COLUMN_PARENT, Parent);
+    DieColumnsSet(Columns, COLUMN_NAME, StringTableIntern(&Columns->Strings, GetTagString(Attributes, DW_AT_name)));
+    DieColumnsSet(Columns, COLUMN_TYPE, GetTagGlobalRef(Attributes, DW_AT_type));
+    Dwarf_Signed Slot = SourceFileSlot(Columns->FileBase, Columns->FileCount, File);
+    DieColumnsSet(Columns, COLUMN_DECL_FILE, Slot < 0 ? 0 : Columns->Files[Slot]);
+    DieColumnsSet(Columns, COLUMN_DECL_LINE, GetTagUnsignedData(Attributes, DW_AT_decl_line));
+    DieColumnsSet(Columns, COLUMN_DECL_COLUMN, GetTagUnsignedData(Attributes, DW_AT_decl_column));
+    DieColumnsSet(Columns, COLUMN_LOW_PC, LowPC);
+    DieColumnsSet(Columns, COLUMN_HIGH_PC, HighPC);
+    DieColumnsSet(Columns, COLUMN_BYTE_SIZE, GetTagUnsignedData(Attributes, DW_AT_byte_size));
+
+    Columns->Rows++;
+}
+
+int DieColumnsWrite(struct DieColumns* Columns, const char* Path)
+{
+    static const char Padding[8] = { 0 };
+    struct ColumnsHeader Header;
+    uint64_t Offset = sizeof(Header);
+
+    memset(&Header, 0, sizeof(Header));
+    memcpy(Header.Magic, COLUMNS_MAGIC, sizeof(Header.Magic));
+    Header.Version = COLUMNS_VERSION;
+    Header.ColumnCount = COLUMN_COUNT;
+    Header.Rows = Columns->Rows;
+
+    for (int Id = 0; Id < COLUMN_COUNT; Id++) {
+        Header.Columns[Id].Id = Id;
+        Header.Columns[Id].Width = ColumnWidths[Id];
+        Header.Columns[Id].Offset = Offset;
+        Offset += (Columns->Rows * ColumnWidths[Id] + 7) & ~(uint64_t)7;
+    }
+
+    Header.StringsOffset = Offset;
+    Header.StringsSize = Columns->Strings.Used;
+
+    int FileDescriptor = open(Path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (FileDescriptor < 0) {
+        fprintf(stderr, "open() error: %s: %s\n", Path, strerror(errno));
+        return -1;
+    }
+
+    struct Output Output;
+    OutputInit(&Output, FileDescriptor);
+    OutputBytes(&Output, (const char*)&Header, sizeof(Header));
+
+    for (int Id = 0; Id < COLUMN_COUNT; Id++) {
+        size_t Size = Columns->Rows * ColumnWidths[Id];
+        OutputBytes(&Output, Columns->Data[Id], Size);
+        OutputBytes(&Output, Padding, -Size & 7);
+    }
+
+    OutputBytes(&Output, Columns->Strings.Strings, Columns->Strings.Used);
+
+    int Result = OutputFlush(&Output);
+    if (Result != 0) {
+        fprintf(stderr, "write() error: %s: %s\n", Path, strerror(Output.Error));
+    }
+
+    OutputFree(&Output);
+    if (close(FileDescriptor) != 0) {
+        Result = -1;
+    }
+
+    return Result;
+}
+
+// PC -> function index for --symbolize, built from subprogram and lexical block ranges
+struct SymbolRange {
+    Dwarf_Addr Low;
+    Dwarf_Addr High;
+    Dwarf_Unsigned Name; // offsets into the index's string table
+    Dwarf_Unsigned File;
+    Dwarf_Unsigned Line;
+};
+
+struct SymbolIndex {
+    struct SymbolRange* Ranges; // as found, nested and overlapping
+    size_t RangeCount;
+    size_t RangeSize;
+    struct SymbolRange* Segments; // disjoint and sorted, each owned by its innermost range
+    size_t SegmentCount;
+    struct StringTable Strings;
+    struct OffsetMap Owners; // DIE offset -> 1 + index of its first range, blocks inherit from it
+    Dwarf_Unsigned* Files; // string offsets of the current CU's decl_file names
+    size_t FileCount;
+    Dwarf_Unsigned FileBase;
+    Dwarf_Addr UnitBase; // CU low_pc, base of its DW_AT_ranges lists
+};
+
+void SymbolIndexInit(struct SymbolIndex* Index)
+{
+    memset(Index, 0, sizeof(*Index));
+
+    Index->RangeSize = 4096;
+    Index->Ranges = (struct SymbolRange*)malloc(Index->RangeSize * sizeof(struct SymbolRange));
+    StringTableInit(&Index->Strings);
+    OffsetMapInit(&Index->Owners, 4096);
+}
+
+void SymbolIndexFree(struct SymbolIndex* Index)
+{
+    free(Index->Ranges);
+    free(Index->Segments);
+    free(Index->Files);
+    StringTableFree(&Index->Strings);
+    OffsetMapFree(&Index->Owners);
+}
+
+void SymbolIndexSetUnit(struct SymbolIndex* Index, struct SourceFiles* SourceFiles, Dwarf_Addr UnitBase)
+{
+    Index->Files = (Dwarf_Unsigned*)realloc(Index->Files, (SourceFiles->Count + 1) * sizeof(Dwarf_Unsigned));
+    Index->FileCount = SourceFiles->Count;
+    Index->FileBase = SourceFiles->Base;
+    Index->UnitBase = UnitBase;
+
+    // blocks only look up functions of their own CU
+    OffsetMapFree(&Index->Owners);
+    OffsetMapInit(&Index->Owners, 4096);
+
+    for (Dwarf_Signed Count = 0; Count < SourceFiles->Count; Count++) {
+        Index->Files[Count] = StringTableIntern(&Index->Strings, SourceFiles->Files[Count]);
+    }
+}
+
+void SymbolIndexAddRange(struct SymbolIndex* Index, struct SymbolRange* Symbol, Dwarf_Addr Low, Dwarf_Addr High)
+{
+    if (High <= Low) {
+        return;
+    }
+
+    if (Index->RangeCount == Index->RangeSize) {
+        Index->RangeSize *= 2;
+        Index->Ranges = (struct SymbolRange*)realloc(Index->Ranges, Index->RangeSize * sizeof(struct SymbolRange));
+    }
+
+    struct SymbolRange* Range = &Index->Ranges[Index->RangeCount++];
+    *Range = *Symbol;
+    Range->Low = Low;
+    Range->High = High;
+}
+
+// DW_AT_ranges of a hot/cold split function or a scattered block: a .debug_ranges offset up to
+// DWARF 4, a .debug_rnglists offset or DW_FORM_rnglistx index from DWARF 5 on
+void SymbolIndexAddRangeList(struct DwarfContext* Context, struct SymbolIndex* Index, struct SymbolRange* Symbol, Dwarf_Attribute Attribute, Dwarf_Die Die)
+{
+    Dwarf_Half Form = 0;
+    Dwarf_Half Version = 0;
+    Dwarf_Half OffsetSize = 0;
+    Dwarf_Unsigned Value = 0;
+
+    dwarf_whatform(Attribute, &Form, 0);
+    dwarf_get_version_of_die(Die, &Version, &OffsetSize);
+
+    if (Form == DW_FORM_rnglistx || Version >= 5) {
+        Dwarf_Rnglists_Head Head = 0;
+        Dwarf_Unsigned Count = 0;
+        Dwarf_Unsigned ListOffset = 0;
+
+        int Result = Form == DW_FORM_rnglistx ? dwarf_formudata(Attribute, &Value, 0) : dwarf_global_formref(Attribute, &Value, 0);
+        if (Result != DW_DLV_OK || dwarf_rnglists_get_rle_head(Attribute, Form, Value, &Head, &Count, &ListOffset, 0) != DW_DLV_OK) {
+            return;
+        }
+
+        // cooked entries are absolute, base address entries are already folded into them
+        for (Dwarf_Unsigned Entry = 0; Entry < Count; Entry++) {
+            unsigned Length = 0;
+            unsigned Kind = 0;
+            Dwarf_Unsigned Raw1 = 0;
+            Dwarf_Unsigned Raw2 = 0;
+            Dwarf_Bool Unavailable = 0;
+            Dwarf_Unsigned Low = 0;
+            Dwarf_Unsigned High = 0;
+
+            if (dwarf_get_rnglists_entry_fields_a(Head, Entry, &Length, &Kind, &Raw1, &Raw2, &Unavailable, &Low, &High, 0) != DW_DLV_OK) {
+                break;
+            }
+            if (Kind == DW_RLE_end_of_list) {
+                break;
+            }
+            if (Kind == DW_RLE_base_address || Kind == DW_RLE_base_addressx || Unavailable) {
+                continue;
+            }
+
+            SymbolIndexAddRange(Index, Symbol, Low, High);
+        }
+
+        dwarf_dealloc_rnglists_head(Head);
+        return;
+    }
+
+    Dwarf_Ranges* Ranges = 0;
+    Dwarf_Signed Count = 0;
+    Dwarf_Unsigned Bytes = 0;
+    Dwarf_Addr Base = Index->UnitBase;
+
+    if (dwarf_global_formref(Attribute, &Value, 0) != DW_DLV_OK || dwarf_get_ranges_a(Context->Debug, Value, Die, &Ranges, &Count, &Bytes, 0) != DW_DLV_OK) {
+        return;
+    }
+
+    for (Dwarf_Signed Range = 0; Range < Count; Range++) {
+        if (Ranges[Range].dwr_type == DW_RANGES_END) {
+            break;
+        }
+
+        if (Ranges[Range].dwr_type == DW_RANGES_ADDRESS_SELECTION) {
+            Base = Ranges[Range].dwr_addr2;
+            continue;
+        }
+
+        SymbolIndexAddRange(Index, Symbol, Base + Ranges[Range].dwr_addr1, Base + Ranges[Range].dwr_addr2);
+    }
+
+    dwarf_ranges_dealloc(Context->Debug, Ranges, Count);
+}
+
+// out of line and concrete instances keep their name on the declaration
+void SymbolIndexResolveName(struct DwarfContext* Context, struct SymbolIndex* Index, struct DieAttributes* Attributes, struct SymbolRange* Symbol)
+{
+    const char* Name = GetTagString(Attributes, DW_AT_name);
+    if (Name == 0) {
+        Name = GetTagString(Attributes, DW_AT_linkage_name);
+    }
+
+    if (Name != 0) {
+        Symbol->Name = StringTableIntern(&Index->Strings, Name);
+        return;
+    }
+
+    Dwarf_Off Origin = GetTagGlobalRef(Attributes, DW_AT_specification);
+    if (Origin == 0) {
+        Origin = GetTagGlobalRef(Attributes, DW_AT_abstract_origin);
+    }
+
+    Dwarf_Die OriginDie = 0;
+    if (Origin == 0 || dwarf_offdie_b(Context->Debug, Origin, 1, &OriginDie, 0) != DW_DLV_OK) {
+        return;
+    }
+
+    struct DieAttributes OriginAttributes;
+    DieAttributesLoad(Context, OriginDie, &OriginAttributes);
+
+    const char* OriginName = GetTagString(&OriginAttributes, DW_AT_name);
+    if (OriginName == 0) {
+        OriginName = GetTagString(&OriginAttributes, DW_AT_linkage_name);
+    }
+    Symbol->Name = StringTableIntern(&Index->Strings, OriginName);
+
+    if (Symbol->Line == 0) {
+        Dwarf_Signed Slot = SourceFileSlot(Index->FileBase, Index->FileCount, GetTagUnsignedData(&OriginAttributes, DW_AT_decl_file));
+        Symbol->File = Slot < 0 ? 0 : Index->Files[Slot];
+        Symbol->Line = GetTagUnsignedData(&OriginAttributes, DW_AT_decl_line);
+    }
+
+    DieAttributesFree(Context, &OriginAttributes);
+    dwarf_dealloc(Context->Debug, OriginDie, DW_DLA_DIE);
+}
+
+void SymbolIndexAppend(struct DwarfContext* Context, struct SymbolIndex* Index, struct WalkerEntry* Entry, Dwarf_Off Parent, struct DieAttributes* Attributes)
+{
+    struct SymbolRange Symbol = { 0 };
+
+    if (Entry->Tag == DW_TAG_subprogram) {
+        Dwarf_Signed Slot = SourceFileSlot(Index->FileBase, Index->FileCount, GetTagUnsignedData(Attributes, DW_AT_decl_file));
+        Symbol.File = Slot < 0 ? 0 : Index->Files[Slot];
+        Symbol.Line = GetTagUnsignedData(Attributes, DW_AT_decl_line);
+        SymbolIndexResolveName(Context, Index, Attributes, &Symbol);
+    } else {
+        // a block belongs to the function around it
+        size_t Owner = (size_t)(uintptr_t)OffsetMapFind(&Index->Owners, Parent);
+        if (Owner == 0) {
+            return;
+        }
+        Symbol = Index->Ranges[Owner - 1];
+    }
+
+    size_t First = Index->RangeCount;
+
+    if (GetTagAttribute(Attributes, DW_AT_ranges) != 0) {
+        SymbolIndexAddRangeList(Context, Index, &Symbol, GetTagAttribute(Attributes, DW_AT_ranges), Entry->Die);
+    } else {
+        Dwarf_Addr LowPC = GetTagAddress(Attributes, DW_AT_low_pc);
+        SymbolIndexAddRange(Index, &Symbol, LowPC, GetTagHighPC(Attributes, LowPC));
+    }
+
+    if (Index->RangeCount > First) {
+        OffsetMapInsert(&Index->Owners, Entry->Offset, (void*)(uintptr_t)(First + 1));
+    }
+}
+
+// outer ranges first, so a range always comes after the ones containing it
+int SymbolRangeCompare(const void* A, const void* B)
+{
+    const struct SymbolRange* RangeA = (const struct SymbolRange*)A;
+    const struct SymbolRange* RangeB = (const struct SymbolRange*)B;
+
+    if (RangeA->Low != RangeB->Low) {
+        return RangeA->Low < RangeB->Low ? -1 : 1;
+    }
+
+    return RangeA->High > RangeB->High ? -1 : RangeA->High < RangeB->High;
+}
+
+void SymbolIndexEmit(struct SymbolIndex* Index, Dwarf_Addr Low, Dwarf_Addr High, struct SymbolRange* Owner)
+{
+    if (High <= Low) {
+        return;
+    }
+
+    struct SymbolRange* Last = Index->SegmentCount == 0 ? 0 : &Index->Segments[Index->SegmentCount - 1];
+    if (Last != 0 && Last->High == Low && Last->Name == Owner->Name && Last->File == Owner->File && Last->Line == Owner->Line) {
+        Last->High = High;
+        return;
+    }
+
+    struct SymbolRange* Segment = &Index->Segments[Index->SegmentCount++];
+    *Segment = *Owner;
+    Segment->Low = Low;
+    Segment->High = High;
+}
+
+// sweeps the nested ranges into disjoint segments that belong to the innermost range
+void SymbolIndexFinish(struct SymbolIndex* Index)
+{
+    qsort(Index->Ranges, Index->RangeCount, sizeof(struct SymbolRange), SymbolRangeCompare);
+
+    // every range starts at most one segment and ends at most one more
+    Index->Segments = (struct SymbolRange*)malloc((2 * Index->RangeCount + 1) * sizeof(struct SymbolRange));
+    Index->SegmentCount = 0;
+
+    struct SymbolRange** Stack = (struct SymbolRange**)malloc((Index->RangeCount + 1) * sizeof(struct SymbolRange*));
+    size_t Depth = 0;
+    Dwarf_Addr Position = 0;
+
+    for (size_t Count = 0; Count <= Index->RangeCount; Count++) {
+        struct SymbolRange* Range = Count < Index->RangeCount ? &Index->Ranges[Count] : 0;
+
+        while (Depth > 0 && (Range == 0 || Stack[Depth - 1]->High <= Range->Low)) {
+            struct SymbolRange* Top = Stack[--Depth];
+            SymbolIndexEmit(Index, Position, Top->High, Top);
+            if (Position < Top->High) {
+                Position = Top->High;
+            }
+        }
+
+        if (Range == 0) {
+            break;
+        }
+
+        if (Depth > 0) {
+            SymbolIndexEmit(Index, Position, Range->Low, Stack[Depth - 1]);
+            // ranges that overlap without nesting are cut at the end of the outer one
+            if (Range->High > Stack[Depth - 1]->High) {
+                Range->High = Stack[Depth - 1]->High;
+            }
+        }
+
+        if (Position < Range->Low) {
+            Position = Range->Low;
+        }
+
+        Stack[Depth++] = Range;
+    }
+
+    free(Stack);
+    free(Index->Ranges);
+    Index->Ranges = 0;
+    Index->RangeCount = 0;
+    Index->RangeSize = 0;
+}
+
+// one input address, resolved in address order and printed in input order
+struct SymbolQuery {
+    Dwarf_Addr Address;
+    size_t Position;
+};
+
+#define SYMBOLIZE_BATCH (1 << 20)
+
+int SymbolQueryCompare(const void* A, const void* B)
+{
+    Dwarf_Addr AddressA = ((const struct SymbolQuery*)A)->Address;
+    Dwarf_Addr AddressB = ((const struct SymbolQuery*)B)->Address;
+
+    return AddressA < AddressB ? -1 : AddressA > AddressB;
+}
+
+// Results[Position] is 1 + the segment holding the address, or 0
+void SymbolIndexResolve(struct SymbolIndex* Index, struct SymbolQuery* Queries, size_t Count, size_t* Results)
+{
+    qsort(Queries, Count, sizeof(struct SymbolQuery), SymbolQueryCompare);
+
+    size_t Segment = 0;
+    for (size_t Query = 0; Query < Count; Query++) {
+        Dwarf_Addr Address = Queries[Query].Address;
+
+        while (Segment < Index->SegmentCount && Index->Segments[Segment].High <= Address) {
+            Segment++;
+        }
+
+        int Hit = Segment < Index->SegmentCount && Index->Segments[Segment].Low <= Address;
+        Results[Queries[Query].Position] = Hit ? Segment + 1 : 0;
+    }
+}
+
+void SymbolIndexPrint(struct SymbolIndex* Index, struct Output* Output, Dwarf_Addr Address, size_t Result)
+{
+    struct SymbolRange* Segment = Result == 0 ? 0 : &Index->Segments[Result - 1];
+    const char* Strings = Index->Strings.Strings;
+
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputRecordBegin(Output, "symbol");
+        OutputFieldHex(Output, "address", Address);
+        OutputFieldString(Output, "name", Segment == 0 || Segment->Name == 0 ? 0 : Strings + Segment->Name);
+        OutputFieldString(Output, "file", Segment == 0 || Segment->File == 0 ? 0 : Strings + Segment->File);
+        OutputFieldUnsigned(Output, "line", Segment == 0 ? 0 : Segment->Line);
+        OutputRecordEnd(Output);
+        return;
+    }
+
+    OutputLiteral(Output, "0x");
+    OutputHex(Output, Address, 16);
+    if (Segment == 0) {
+        OutputLiteral(Output, " ??\n");
+        return;
+    }
+
+    OutputLiteral(Output, " ");
+    OutputString(Output, Segment->Name == 0 ? "??" : Strings + Segment->Name);
+    OutputLiteral(Output, " ");
+    OutputString(Output, Segment->File == 0 ? "??" : Strings + Segment->File);
+    OutputLiteral(Output, ":");
+    OutputUnsigned(Output, Segment->Line);
+    OutputLiteral(Output, "\n");
+}
+
+// whitespace separated hex addresses, with or without 0x; anything else reads as 0
+size_t SymbolQueryRead(FILE* Input, struct SymbolQuery* Queries, size_t Size)
+{
+    size_t Count = 0;
+    int Character = fgetc_unlocked(Input);
+
+    while (Count < Size && Character != EOF) {
+        while (Character == ' ' || Character == '\t' || Character == '\n' || Character == '\r') {
+            Character = fgetc_unlocked(Input);
+        }
+
+        if (Character == EOF) {
+            break;
+        }
+
+        Dwarf_Addr Address = 0;
+        int Valid = 1;
+        int Digits = 0;
+
+        while (Character != EOF && Character != ' ' && Character != '\t' && Character != '\n' && Character != '\r') {
+            int Value = -1;
+            if (Character >= '0' && Character <= '9') {
+                Value = Character - '0';
+            } else if (Character >= 'a' && Character <= 'f') {
+                Value = Character - 'a' + 10;
+            } else if (Character >= 'A' && Character <= 'F') {
+                Value = Character - 'A' + 10;
+            } else if ((Character == 'x' || Character == 'X') && Digits == 1 && Address == 0) {
+                Digits = 0;
+                Character = fgetc_unlocked(Input);
+                continue;
+            }
+
+            if (Value < 0) {
+                Valid = 0;
+            } else {
+                Address = (Address << 4) | Value;
+                Digits++;
+            }
+
+            Character = fgetc_unlocked(Input);
+        }
+
+        Queries[Count].Address = Valid ? Address : 0;
+        Queries[Count].Position = Count;
+        Count++;
+    }
+
+    if (Character != EOF) {
+        ungetc(Character, Input);
+    }
+
+    return Count;
+}
+
+// DW_AT_name -> DIEs, for --find when the producer emitted no .debug_pubnames/.debug_pubtypes
+struct NameEntry {
+    Dwarf_Off Die;
+    Dwarf_Off Unit;
+    size_t Next; // 1 + index of the next entry with the same name, 0 ends the chain
+};
+
+struct NameIndex {
+    struct StringTable Names;
+    struct OffsetMap Heads; // name offset -> 1 + index of the last entry with that name
+    struct NameEntry* Entries;
+    size_t Count;
+    size_t Size;
+};
+
+void NameIndexInit(struct NameIndex* Index)
+{
+    memset(Index, 0, sizeof(*Index));
+    StringTableInit(&Index->Names);
+    OffsetMapInit(&Index->Heads, 4096);
+}
+
+void NameIndexFree(struct NameIndex* Index)
+{
+    StringTableFree(&Index->Names);
+    OffsetMapFree(&Index->Heads);
+    free(Index->Entries);
+}
+
+void NameIndexInsert(struct NameIndex* Index, const char* Name, Dwarf_Off Die, Dwarf_Off Unit)
+{
+    if (Name == 0 || Name[0] == 0) {
+        return;
+    }
+
+    if (Index->Count == Index->Size) {
+        Index->Size = Index->Size == 0 ? 4096 : Index->Size * 2;
+        Index->Entries = (struct NameEntry*)realloc(Index->Entries, Index->Size * sizeof(struct NameEntry));
+    }
+
+    Dwarf_Unsigned Key = StringTableIntern(&Index->Names, Name);
+    struct NameEntry* Entry = &Index->Entries[Index->Count++];
+    Entry->Die = Die;
+    Entry->Unit = Unit;
+    Entry->Next = (size_t)OffsetMapFind(&Index->Heads, Key);
+    OffsetMapInsert(&Index->Heads, Key, (void*)Index->Count);
+}
+
+// appends every DIE named Name in .debug_info order
+void NameIndexFind(struct NameIndex* Index, const char* Name, struct Array* Dies, struct Array* Units)
+{
+    Dwarf_Unsigned Key = StringTableIntern(&Index->Names, Name);
+    size_t First = Dies->used;
+
+    for (size_t Next = (size_t)OffsetMapFind(&Index->Heads, Key); Next != 0; Next = Index->Entries[Next - 1].Next) {
+        ArrayInsert(Dies, Index->Entries[Next - 1].Die);
+        ArrayInsert(Units, Index->Entries[Next - 1].Unit);
+    }
+
+    // the chains run from the newest entry back
+    for (size_t Low = First, High = Dies->used; Low + 1 < High; Low++, High--) {
+        Dwarf_Unsigned Die = Dies->array[Low];
+        Dwarf_Unsigned Unit = Units->array[Low];
+        Dies->array[Low] = Dies->array[High - 1];
+        Units->array[Low] = Units->array[High - 1];
+        Dies->array[High - 1] = Die;
+        Units->array[High - 1] = Unit;
+    }
+}
+
+// --dedup-types: every type DIE gets a structural hash built from its tag, its attributes and its
+// children, with references hashed through their targets and decl_file through the file name, so
+// the copies a header leaves in every CU hash alike; the first copy printed stays, the later ones
+// become a reference to it
+Dwarf_Bool TagDeduplicated[TAG_TABLE_SIZE] = {
+    [DW_TAG_enumeration_type] = 1,
+    [DW_TAG_base_type] = 1,
+    [DW_TAG_typedef] = 1,
+    [DW_TAG_array_type] = 1,
+    [DW_TAG_pointer_type] = 1,
+    [DW_TAG_subroutine_type] = 1,
+    [DW_TAG_structure_type] = 1,
+};
+
+#define TYPE_HASH_DEPTH 64
+
+uint64_t TypeHashBytes(uint64_t Hash, const void* Data, size_t Length)
+{
+    for (size_t Index = 0; Index < Length; Index++) {
+        Hash = (Hash ^ ((const unsigned char*)Data)[Index]) * 0x100000001b3ull;
+    }
+
+    return Hash;
+}
+
+uint64_t TypeHashValue(uint64_t Hash, uint64_t Value)
+{
+    return TypeHashBytes(Hash, &Value, sizeof(Value));
+}
+
+uint64_t TypeHashString(uint64_t Hash, const char* String)
+{
+    return String == 0 ? TypeHashValue(Hash, 0) : TypeHashBytes(Hash, String, strlen(String) + 1);
+}
+
+int AttributeFormIsReference(Dwarf_Half Form)
+{
+    return Form == DW_FORM_ref_addr || (Form >= DW_FORM_ref1 && Form <= DW_FORM_ref_udata);
+}
+
+// addresses, section offsets, line numbers and locations shift whenever anything before them
+// changes, a diff leaves them out
+int DiffIgnoredAttribute(Dwarf_Half Code, Dwarf_Half Form)
+{
+    switch (Form) {
+        case DW_FORM_addr:
+        case DW_FORM_addrx:
+        case DW_FORM_addrx1:
+        case DW_FORM_addrx2:
+        case DW_FORM_addrx3:
+        case DW_FORM_addrx4:
+        case DW_FORM_GNU_addr_index:
+        case DW_FORM_sec_offset:
+        case DW_FORM_loclistx:
+        case DW_FORM_rnglistx:
+            return 1;
+        default:
+            break;
+    }
+
+    switch (Code) {
+        case DW_AT_decl_line:
+        case DW_AT_decl_column:
+        case DW_AT_call_line:
+        case DW_AT_call_column:
+        case DW_AT_location:
+        case DW_AT_frame_base:
+        case DW_AT_comp_dir:
+        case DW_AT_producer:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+uint64_t TypeHashAt(struct DwarfContext* Context, Dwarf_Off Offset, int Depth, int* Open);
+
+// what a reference to Offset adds to a hash: a named struct, class or union stands for itself, so
+// a pointer member does not pull the pointee's members in and the usual self-referencing types
+// hash without a cycle; in a diff every named target does, so a changed struct does not also
+// change every function taking a pointer to it
+uint64_t TypeHashReference(struct DwarfContext* Context, Dwarf_Off Offset, int Depth, int* Open)
+{
+    uint64_t Hash = (uint64_t)(uintptr_t)OffsetMapFind(&Context->TypeHashes, Offset * 2 + 1);
+    if (Hash != 0) {
+        return Hash;
+    }
+
+    Dwarf_Die Die = 0;
+    char* Name = 0;
+    Dwarf_Half Tag = 0;
+
+    if (dwarf_offdie_b(Context->Debug, Offset, 1, &Die, 0) == DW_DLV_OK) {
+        dwarf_tag(Die, &Tag, 0);
+        int Nominal = Context->DiffHashing || Tag == DW_TAG_structure_type || Tag == DW_TAG_class_type || Tag == DW_TAG_union_type;
+        if (Nominal && dwarf_diename(Die, &Name, 0) == DW_DLV_OK) {
+            Hash = TypeHashString(TypeHashValue(0xcbf29ce484222325ull, Tag), Name) | 1;
+            dwarf_dealloc(Context->Debug, Name, DW_DLA_STRING);
+        }
+        dwarf_dealloc(Context->Debug, Die, DW_DLA_DIE);
+    }
+
+    int Inner = INT_MAX;
+    if (Hash == 0) {
+        Hash = TypeHashAt(Context, Offset, Depth, &Inner);
+    }
+
+    if (Inner > Depth) {
+        OffsetMapInsert(&Context->TypeHashes, Offset * 2 + 1, (void*)(uintptr_t)Hash);
+    } else if (Inner < *Open) {
+        *Open = Inner;
+    }
+
+    return Hash;
+}
+
+// never 0, the memo stores it as a pointer; *Open is lowered to the depth of the shallowest type
+// still being hashed that this one reached back to
+uint64_t TypeHashDie(struct DwarfContext* Context, Dwarf_Die Die, int Depth, int* Open)
+{
+    struct DieAttributes Attributes;
+    Dwarf_Off Offset = 0;
+    Dwarf_Half Tag = 0;
+    int Inner = INT_MAX;
+
+    dwarf_dieoffset(Die, &Offset, 0);
+    dwarf_tag(Die, &Tag, 0);
+    DieAttributesLoad(Context, Die, &Attributes);
+
+    uint64_t Hash = TypeHashValue(0xcbf29ce484222325ull, Tag);
+    Hash = TypeHashString(Hash, GetTagString(&Attributes, DW_AT_name));
+
+    // open until the end, an even value holding the depth, see TypeHashAt()
+    OffsetMapInsert(&Context->TypeHashes, Offset * 2, (void*)(uintptr_t)((Depth + 1) * 2));
+
+    for (Dwarf_Signed Index = 0; Index < Attributes.Count; Index++) {
+        Dwarf_Attribute Attribute = Attributes.List[Index];
+        Dwarf_Half Code = 0;
+        Dwarf_Half Form = 0;
+        Dwarf_Off Reference = 0;
+        char* String = 0;
+        Dwarf_Unsigned Value = 0;
+        Dwarf_Bool Flag = 0;
+        Dwarf_Ptr Bytes = 0;
+
+        dwarf_whatattr(Attribute, &Code, 0);
+        dwarf_whatform(Attribute, &Form, 0);
+        if (Code == DW_AT_sibling || Code == DW_AT_name || (Context->DiffHashing && DiffIgnoredAttribute(Code, Form))) {
+            continue;
+        }
+
+        Hash = TypeHashValue(Hash, Code);
+        if (Code == DW_AT_decl_file) {
+            Hash = TypeHashString(Hash, SourceFileName(Context, GetTagUnsignedData(&Attributes, DW_AT_decl_file)));
+        } else if (AttributeFormIsReference(Form) && dwarf_global_formref(Attribute, &Reference, 0) == DW_DLV_OK) {
+            Hash = TypeHashValue(Hash, TypeHashReference(Context, Reference, Depth + 1, &Inner));
+        } else if (dwarf_formstring(Attribute, &String, 0) == DW_DLV_OK) {
+            Hash = TypeHashString(Hash, String);
+        } else if (dwarf_formudata(Attribute, &Value, 0) == DW_DLV_OK) {
+            Hash = TypeHashValue(Hash, Value);
+        } else if (dwarf_formflag(Attribute, &Flag, 0) == DW_DLV_OK) {
+            Hash = TypeHashValue(Hash, Flag);
+        } else if (dwarf_formexprloc(Attribute, &Value, &Bytes, 0) == DW_DLV_OK) {
+            Hash = TypeHashBytes(Hash, Bytes, Value);
+        } else {
+            Hash = TypeHashValue(Hash, Form);
+        }
+    }
+
+    DieAttributesFree(Context, &Attributes);
+
+    // members, enumerators, subranges and parameters, in order
+    Dwarf_Die Child = 0;
+    if (Depth > TYPE_HASH_DEPTH || dwarf_child(Die, &Child, 0) != DW_DLV_OK) {
+        Child = 0;
+    }
+
+    while (Child != 0) {
+        Dwarf_Die Sibling = 0;
+
+        Hash = TypeHashValue(Hash, TypeHashDie(Context, Child, Depth + 1, &Inner));
+
+        if (dwarf_siblingof(Context->Debug, Child, &Sibling, 0) != DW_DLV_OK) {
+            Sibling = 0;
+        }
+        dwarf_dealloc(Context->Debug, Child, DW_DLA_DIE);
+        Child = Sibling;
+    }
+
+    Hash |= 1;
+
+    // a hash that reached back to this type or one opened above it depends on where the walk
+    // entered the cycle and is computed again next time; cycles closed below it are fine
+    if (Inner > Depth) {
+        OffsetMapInsert(&Context->TypeHashes, Offset * 2, (void*)(uintptr_t)Hash);
+    } else {
+        OffsetMapInsert(&Context->TypeHashes, Offset * 2, 0);
+        if (Inner < *Open) {
+            *Open = Inner;
+        }
+    }
+
+    return Hash;
+}
+
+// structural hash of the DIE at a .debug_info offset, computed once per offset
+uint64_t TypeHashAt(struct DwarfContext* Context, Dwarf_Off Offset, int Depth, int* Open)
+{
+    uint64_t Hash = (uint64_t)(uintptr_t)OffsetMapFind(&Context->TypeHashes, Offset * 2);
+    if ((Hash & 1) != 0) {
+        return Hash;
+    }
+
+    // a reference back to a type still being hashed is told apart by how many levels up it was
+    // opened, whichever DIE the cycle was entered at
+    if (Hash != 0) {
+        int Opened = (int)(Hash / 2) - 1;
+        if (Opened < *Open) {
+            *Open = Opened;
+        }
+        return TypeHashValue(0xcbf29ce484222325ull, Depth - Opened) | 1;
+    }
+
+    // cut off here, the hashes above depend on the depth the walk started at and stay out of
+    // the memo too
+    if (Depth > TYPE_HASH_DEPTH) {
+        *Open = -1;
+        return 1;
+    }
+
+    Dwarf_Die Die = 0;
+    if (dwarf_offdie_b(Context->Debug, Offset, 1, &Die, 0) != DW_DLV_OK) {
+        return 1;
+    }
+
+    Hash = TypeHashDie(Context, Die, Depth, Open);
+    dwarf_dealloc(Context->Debug, Die, DW_DLA_DIE);
+
+    return Hash;
+}
+
+// .debug_info offset of the first DIE of this shape, 0 when Entry is that DIE; with split DWARF
+// the first copy may sit in an earlier .dwo, the map is keyed by content and outlives the handle
+Dwarf_Off TypeDedupCanonical(struct DwarfContext* Context, struct WalkerEntry* Entry)
+{
+    int Open = INT_MAX;
+    Dwarf_Off Hash = TypeHashAt(Context, Entry->Offset, 0, &Open) >> 1; // OffsetMap stores Key + 1
+    Dwarf_Off Canonical = (Dwarf_Off)(uintptr_t)OffsetMapFind(&Context->TypeCanonical, Hash);
+
+    if (Canonical == 0) {
+        OffsetMapInsert(&Context->TypeCanonical, Hash, (void*)(uintptr_t)Entry->Offset);
+        return 0;
+    }
+
+    return Canonical == Entry->Offset ? 0 : Canonical;
+}
+
+// what is left of a later copy, its tag and name and where the first one is
+void OutputTypeDuplicate(struct DwarfContext* Context, struct WalkerEntry* Entry, struct DieAttributes* Attributes)
+{
+    struct Output* Output = Context->Output;
+    const char* TagName = 0;
+
+    dwarf_get_TAG_name(Entry->Tag, &TagName);
+    OutputTag(Output, TagName);
+    OutputFieldString(Output, "DW_AT_name", GetTagString(Attributes, DW_AT_name));
+    OutputFieldRef(Output, "duplicate_of", Entry->DuplicateOf);
+}
+
+struct LayoutTable;
+void LayoutStructAppend(struct DwarfContext* Context, struct LayoutTable* Table, struct WalkerEntry* Entry, struct DieAttributes* Attributes);
+
+void DwarfHandleDie(struct DwarfContext* Context, struct WalkerEntry* Entry, Dwarf_Off Parent, Dwarf_Bool HasChildren)
+{
+    struct DieAttributes Attributes;
+
+    if (Context->Symbols != 0 && Entry->Tag != DW_TAG_subprogram && Entry->Tag != DW_TAG_lexical_block) {
+        return;
+    }
+    if (Context->Layouts != 0 && Entry->Tag != DW_TAG_structure_type) {
+        return;
+    }
+
+    DieAttributesLoad(Context, Entry->Die, &Attributes);
+    if (Context->Columns != 0) {
+        DieColumnsAppend(Context->Columns, Entry->Tag, Entry->Offset, Parent, &Attributes);
+    } else if (Context->Symbols != 0) {
+        SymbolIndexAppend(Context, Context->Symbols, Entry, Parent, &Attributes);
+    } else if (Context->Layouts != 0) {
+        LayoutStructAppend(Context, Context->Layouts, Entry, &Attributes);
+    } else if (Context->Names != 0) {
+        NameIndexInsert(Context->Names, GetTagString(&Attributes, DW_AT_name), Entry->Offset, Context->UnitOffset);
+    } else if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputRecordBegin(Context->Output, "die");
+        OutputFieldUnsigned(Context->Output, "offset", Entry->Offset);
+        OutputFieldUnsigned(Context->Output, "parent", Parent);
+        if (Entry->DuplicateOf != 0) {
+            OutputTypeDuplicate(Context, Entry, &Attributes);
+        } else {
+            TagFunctions[Entry->Tag](Context, Entry->Die, &Attributes, HasChildren);
+        }
+        OutputRecordEnd(Context->Output);
+    } else if (Entry->DuplicateOf != 0) {
+        OutputTypeDuplicate(Context, Entry, &Attributes);
+    } else {
+        TagFunctions[Entry->Tag](Context, Entry->Die, &Attributes, HasChildren);
+    }
+    DieAttributesFree(Context, &Attributes);
+}
+
+// --tag, --name and --cu, read-only after argument parsing like GlobalOptions
+struct DieFilter {
+    int Active; // --tag or --name given, only matching DIEs are printed, with their whole subtree
+    Dwarf_Bool Tags[TAG_TABLE_SIZE]; // wanted tags, all of them without --tag
+    Dwarf_Bool Reaches[TAG_TABLE_SIZE]; // a wanted tag can appear somewhere below this one
+    const char* TagList;
+    const char* NamePattern; // fnmatch() glob
+    const char* NameRegexPattern;
+    regex_t NameRegex;
+    const char* UnitPattern; // fnmatch() glob on the CU's DW_AT_name
+};
+
+static struct DieFilter GlobalFilter;
+
+// parent -> child tags compilers emit below the tags the walker descends into
+static const Dwarf_Half TagNesting[][2] = {
+    { DW_TAG_enumeration_type, DW_TAG_enumerator },
+    { DW_TAG_array_type, DW_TAG_subrange_type },
+    { DW_TAG_subroutine_type, DW_TAG_formal_parameter },
+    { DW_TAG_structure_type, DW_TAG_member },
+    { DW_TAG_structure_type, DW_TAG_variable },
+    { DW_TAG_structure_type, DW_TAG_subprogram },
+    { DW_TAG_structure_type, DW_TAG_typedef },
+    { DW_TAG_structure_type, DW_TAG_structure_type },
+    { DW_TAG_structure_type, DW_TAG_enumeration_type },
+    { DW_TAG_subprogram, DW_TAG_formal_parameter },
+    { DW_TAG_subprogram, DW_TAG_lexical_block },
+    { DW_TAG_lexical_block, DW_TAG_lexical_block },
+};
+
+// types and nested functions can be declared in any function or block
+static const Dwarf_Half TagScoped[] = {
+    DW_TAG_variable,
+    DW_TAG_subprogram,
+    DW_TAG_typedef,
+    DW_TAG_base_type,
+    DW_TAG_pointer_type,
+    DW_TAG_array_type,
+    DW_TAG_subroutine_type,
+    DW_TAG_structure_type,
+    DW_TAG_enumeration_type,
+};
+
+// accepts "subprogram" as well as "DW_TAG_subprogram"
+int DieFilterParseTags(struct DieFilter* Filter, const char* List)
+{
+    char* Names = strdup(List);
+    char* Save = 0;
+    int Result = 0;
+
+    for (char* Name = strtok_r(Names, ",", &Save); Name != 0; Name = strtok_r(0, ",", &Save)) {
+        int Found = 0;
+
+        for (int Tag = 0; Tag < TAG_TABLE_SIZE; Tag++) {
+            const char* TagName = 0;
+            if (dwarf_get_TAG_name(Tag, &TagName) != DW_DLV_OK) {
+                continue;
+            }
+
+            if (strcmp(Name, TagName) == 0 || (strncmp(TagName, "DW_TAG_", 7) == 0 && strcmp(Name, TagName + 7) == 0)) {
+                Filter->Tags[Tag] = 1;
+                Found = 1;
+                break;
+            }
+        }
+
+        if (!Found) {
+            fprintf(stderr, "Unknown tag: %s\n", Name);
+            Result = -1;
+        }
+    }
+
+    free(Names);
+    return Result;
+}
+
+// compiles the patterns and works out which tags are worth descending into
+int DieFilterInit(struct DieFilter* Filter)
+{
+    static Dwarf_Bool Contains[TAG_TABLE_SIZE][TAG_TABLE_SIZE];
+
+    Filter->Active = Filter->TagList != 0 || Filter->NamePattern != 0 || Filter->NameRegexPattern != 0;
+    if (!Filter->Active) {
+        return 0;
+    }
+
+    if (Filter->TagList != 0) {
+        if (DieFilterParseTags(Filter, Filter->TagList) != 0) {
+            return -1;
+        }
+    } else {
+        memset(Filter->Tags, 1, sizeof(Filter->Tags));
+    }
+
+    if (Filter->NameRegexPattern != 0) {
+        int Result = regcomp(&Filter->NameRegex, Filter->NameRegexPattern, REG_EXTENDED | REG_NOSUB);
+        if (Result != 0) {
+            char Message[256];
+            regerror(Result, &Filter->NameRegex, Message, sizeof(Message));
+            fprintf(stderr, "Invalid --name-regex: %s\n", Message);
+            return -1;
+        }
+    }
+
+    for (size_t Index = 0; Index < sizeof(TagNesting) / sizeof(TagNesting[0]); Index++) {
+        Contains[TagNesting[Index][0]][TagNesting[Index][1]] = 1;
+    }
+    for (size_t Index = 0; Index < sizeof(TagScoped) / sizeof(TagScoped[0]); Index++) {
+        Contains[DW_TAG_subprogram][TagScoped[Index]] = 1;
+        Contains[DW_TAG_lexical_block][TagScoped[Index]] = 1;
+    }
+
+    // transitive closure, a struct in a block in a function still puts members below the function
+    for (int Via = 0; Via < TAG_TABLE_SIZE; Via++) {
+        for (int From = 0; From < TAG_TABLE_SIZE; From++) {
+            if (!Contains[From][Via]) {
+                continue;
+            }
+            for (int To = 0; To < TAG_TABLE_SIZE; To++) {
+                Contains[From][To] |= Contains[Via][To];
+            }
+        }
+    }
+
+    for (int From = 0; From < TAG_TABLE_SIZE; From++) {
+        for (int To = 0; To < TAG_TABLE_SIZE; To++) {
+            if (Contains[From][To] && Filter->Tags[To] && TagFunctions[To] != 0) {
+                Filter->Reaches[From] = 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+void DieFilterFree(struct DieFilter* Filter)
+{
+    if (Filter->Active && Filter->NameRegexPattern != 0) {
+        regfree(&Filter->NameRegex);
+    }
+}
+
+int DieFilterNameMatches(struct DieFilter* Filter, const char* Name)
+{
+    if (Filter->NamePattern != 0 && (Name == 0 || fnmatch(Filter->NamePattern, Name, 0) != 0)) {
+        return 0;
+    }
+
+    if (Filter->NameRegexPattern != 0 && (Name == 0 || regexec(&Filter->NameRegex, Name, 0, 0, 0) != 0)) {
+        return 0;
+    }
+
+    return 1;
+}
+
+// the tag check is free, the name costs an attribute list and is only read for wanted tags
+int DieFilterMatches(struct DwarfContext* Context, struct WalkerEntry* Entry)
+{
+    if (!GlobalFilter.Tags[Entry->Tag]) {
+        return 0;
+    }
+
+    if (GlobalFilter.NamePattern == 0 && GlobalFilter.NameRegexPattern == 0) {
+        return 1;
+    }
+
+    struct DieAttributes Attributes;
+    DieAttributesLoad(Context, Entry->Die, &Attributes);
+    int Result = DieFilterNameMatches(&GlobalFilter, GetTagString(&Attributes, DW_AT_name));
+    DieAttributesFree(Context, &Attributes);
+
+    return Result;
+}
+
+int DieFilterUnitMatches(struct DwarfContext* Context, Dwarf_Die CUDie)
+{
+    if (GlobalFilter.UnitPattern == 0) {
+        return 1;
+    }
+
+    struct DieAttributes Attributes;
+    DieAttributesLoad(Context, CUDie, &Attributes);
+    const char* Name = GetTagString(&Attributes, DW_AT_name);
+    int Result = Name != 0 && fnmatch(GlobalFilter.UnitPattern, Name, 0) == 0;
+    DieAttributesFree(Context, &Attributes);
+
+    return Result;
+}
+
+// visits First, its subtree and, with Siblings, the DIEs after it in pre-order with an
+// explicit stack, one level per entry; First is released by the walk
+void DwarfWalkDies(struct DwarfContext* Context, Dwarf_Die First, Dwarf_Off FirstParent, Dwarf_Bool Siblings)
+{
+    struct WalkerEntry* Stack = Context->WalkStack;
+    int Depth = 0;
+    int MatchDepth = -1; // depth of the filter match whose subtree is being printed
+    int Result = 0;
+
+    Stack[0].Die = First;
+
+    while (Depth >= 0) {
+        struct WalkerEntry* Entry = &Stack[Depth];
+        Dwarf_Die ChildDie = 0;
+        Dwarf_Bool HasChildren = 0;
+
+        Result = dwarf_tag(Entry->Die, &Entry->Tag, &Context->Error);
+        if (Result != DW_DLV_OK) {
+            DwarfContextFail(Context, "dwarf_tag()");
+            for (; Depth >= 0; Depth--) {
+                dwarf_dealloc(Context->Debug, Stack[Depth].Die, DW_DLA_DIE);
+            }
+            return;
+        }
+
+        dwarf_dieoffset(Entry->Die, &Entry->Offset, 0);
+
+        if (Context->Stats != 0) {
+            StatsCountTag(Context->Stats, Entry->Tag);
+            // dwarf_tag(), dwarf_dieoffset(), dwarf_child() and dwarf_siblingof()
+            Context->Stats->DwarfCalls += 4;
+        }
+
+        if (Entry->Tag < TAG_TABLE_SIZE && TagFunctions[Entry->Tag] != 0) {
+            Dwarf_Bool Selected = 1;
+            Dwarf_Bool Descend = TagDescends[Entry->Tag];
+
+            if (GlobalFilter.Active) {
+                if (MatchDepth >= Depth) {
+                    MatchDepth = -1;
+                }
+                Selected = MatchDepth >= 0 || DieFilterMatches(Context, Entry);
+                if (Selected && MatchDepth < 0) {
+                    MatchDepth = Depth;
+                }
+
+                // without dwarf_child() the children are never read, the sibling step
+                // below jumps over them through DW_AT_sibling
+                Descend = Descend && (Selected || GlobalFilter.Reaches[Entry->Tag]);
+            }
+
+            // a later copy of a type is printed as a reference, its children are never read
+            Entry->DuplicateOf = 0;
+            if (GlobalOptions.DedupTypes && Selected && TagDeduplicated[Entry->Tag] && Context->Columns == 0 && Context->Symbols == 0
+                && Context->Names == 0 && Context->Layouts == 0) {
+                Entry->DuplicateOf = TypeDedupCanonical(Context, Entry);
+                Descend = Descend && Entry->DuplicateOf == 0;
+            }
+
+            if (Descend && dwarf_child(Entry->Die, &ChildDie, &Context->Error) == DW_DLV_OK) {
+                HasChildren = 1;
+            }
+
+            if (Selected) {
+                DwarfHandleDie(Context, Entry, Depth == 0 ? FirstParent : Stack[Depth - 1].Offset, HasChildren);
+            }
+        }
+
+        if (HasChildren) {
+            if (Depth + 1 < Context->WalkDepthLimit) {
+                Stack[++Depth].Die = ChildDie;
+                continue;
+            }
+
+            fprintf(stderr, "DIE at offset 0x%llx is nested deeper than %d levels, its children are skipped\n", Entry->Offset, Context->WalkDepthLimit);
+            dwarf_dealloc(Context->Debug, ChildDie, DW_DLA_DIE);
+        }
+
+        // next sibling, climbing up for every level that has none left
+        while (Depth >= 0) {
+            Dwarf_Die SiblingDie = 0;
+            Result = Depth == 0 && !Siblings ? DW_DLV_NO_ENTRY : dwarf_siblingof(Context->Debug, Stack[Depth].Die, &SiblingDie, 0);
+            dwarf_dealloc(Context->Debug, Stack[Depth].Die, DW_DLA_DIE);
+            if (Result == DW_DLV_OK) {
+                Stack[Depth].Die = SiblingDie;
+                break;
+            }
+
+            Depth--;
+        }
+    }
+}
+
+// visits the DIEs below CUDie
+void DwarfWalkCompilationUnit(struct DwarfContext* Context, Dwarf_Die CUDie)
+{
+    Dwarf_Die First = 0;
+    Dwarf_Off CUOffset = 0;
+
+    if (dwarf_child(CUDie, &First, &Context->Error) != DW_DLV_OK) {
+        if (Context->Columns == 0 && Context->Symbols == 0 && Context->Names == 0 && Context->Layouts == 0 && GlobalOptions.Format == FORMAT_TEXT) {
+            OutputLiteral(Context->Output, "dwarf_child() NOK: ");
+            OutputString(Context->Output, dwarf_errmsg(Context->Error));
+            OutputLiteral(Context->Output, "\n");
+        }
+        return;
+    }
+
+    dwarf_dieoffset(CUDie, &CUOffset, 0);
+    DwarfWalkDies(Context, First, CUOffset, 1);
+}
+
+// C declarations for DW_AT_type targets, rendered once per .debug_info offset
+struct TypeName {
+    char* Prefix; // a declarator goes between Prefix and Suffix
+    char* Suffix;
+    char* Text; // with an empty declarator, what gets printed
+};
+
+static struct TypeName TypeNameVoid = { "void ", "", "void" };
+
+#define TYPE_RESOLVE_DEPTH 64
+
+char* TypeConcat(const char* A, const char* B, const char* C)
+{
+    size_t LengthA = strlen(A);
+    size_t LengthB = strlen(B);
+    size_t LengthC = strlen(C);
+
+    char* Result = (char*)malloc(LengthA + LengthB + LengthC + 1);
+    memcpy(Result, A, LengthA);
+    memcpy(Result + LengthA, B, LengthB);
+    memcpy(Result + LengthA + LengthB, C, LengthC + 1);
+
+    return Result;
+}
+
+void TypeNameSet(struct TypeName* Name, char* Prefix, char* Suffix)
+{
+    free(Name->Prefix);
+    free(Name->Suffix);
+    free(Name->Text);
+
+    Name->Prefix = Prefix;
+    Name->Suffix = Suffix;
+    Name->Text = TypeConcat(Prefix, Suffix, "");
+
+    size_t Length = strlen(Name->Text);
+    while (Length > 0 && Name->Text[Length - 1] == ' ') {
+        Name->Text[--Length] = 0;
+    }
+}
+
+void TypeResolverFree(struct OffsetMap* Names)
+{
+    for (size_t Index = 0; Index < Names->Size; Index++) {
+        struct TypeName* Name = (struct TypeName*)Names->Values[Index];
+        if (Names->Keys[Index] != 0 && Name != 0) {
+            free(Name->Prefix);
+            free(Name->Suffix);
+            free(Name->Text);
+            free(Name);
+        }
+    }
+
+    OffsetMapFree(Names);
+}
+
+struct TypeName* TypeResolve(struct DwarfContext* Context, Dwarf_Off Offset, int Depth);
+
+struct TypeName* TypeResolveAttribute(struct DwarfContext* Context, struct DieAttributes* Attributes, int Depth)
+{
+    if (GetTagAttribute(Attributes, DW_AT_type) == 0) {
+        return &TypeNameVoid;
+    }
+
+    return TypeResolve(Context, GetTagGlobalRef(Attributes, DW_AT_type), Depth + 1);
+}
+
+// "[N]" for every subrange child of an array
+char* TypeArrayBounds(struct DwarfContext* Context, Dwarf_Die Die)
+{
+    char* Bounds = strdup("");
+    Dwarf_Die Child = 0;
+
+    if (dwarf_child(Die, &Child, 0) != DW_DLV_OK) {
+        Child = 0;
+    }
+
+    while (Child != 0) {
+        struct DieAttributes Attributes;
+        Dwarf_Half Tag = 0;
+        char Bound[32] = "[]";
+
+        dwarf_tag(Child, &Tag, 0);
+        if (Tag == DW_TAG_subrange_type) {
+            DieAttributesLoad(Context, Child, &Attributes);
+            if (GetTagAttribute(&Attributes, DW_AT_count) != 0) {
+                snprintf(Bound, sizeof(Bound), "[%llu]", GetTagUnsignedData(&Attributes, DW_AT_count));
+            } else if (GetTagAttribute(&Attributes, DW_AT_upper_bound) != 0) {
+                snprintf(Bound, sizeof(Bound), "[%llu]", GetTagUnsignedData(&Attributes, DW_AT_upper_bound) + 1);
+            }
+            DieAttributesFree(Context, &Attributes);
+
+            char* Joined = TypeConcat(Bounds, Bound, "");
+            free(Bounds);
+            Bounds = Joined;
+        }
+
+        Dwarf_Die Sibling = 0;
+        if (dwarf_siblingof(Context->Debug, Child, &Sibling, 0) != DW_DLV_OK) {
+            Sibling = 0;
+        }
+        dwarf_dealloc(Context->Debug, Child, DW_DLA_DIE);
+        Child = Sibling;
+    }
+
+    if (*Bounds == 0) {
+        free(Bounds);
+        Bounds = strdup("[]");
+    }
+
+    return Bounds;
+}
+
+// "(int, char *)" from the formal_parameter children of a subroutine type
+char* TypeParameters(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, int Depth)
+{
+    char* Parameters = strdup("");
+    Dwarf_Die Child = 0;
+
+    if (dwarf_child(Die, &Child, 0) != DW_DLV_OK) {
+        Child = 0;
+    }
+
+    while (Child != 0) {
+        struct DieAttributes ChildAttributes;
+        Dwarf_Half Tag = 0;
+        const char* Parameter = 0;
+
+        dwarf_tag(Child, &Tag, 0);
+        if (Tag == DW_TAG_formal_parameter) {
+            DieAttributesLoad(Context, Child, &ChildAttributes);
+            Parameter = TypeResolveAttribute(Context, &ChildAttributes, Depth)->Text;
+            DieAttributesFree(Context, &ChildAttributes);
+        } else if (Tag == DW_TAG_unspecified_parameters) {
+            Parameter = "...";
+        }
+
+        if (Parameter != 0) {
+            char* Joined = TypeConcat(Parameters, *Parameters ? ", " : "", Parameter);
+            free(Parameters);
+            Parameters = Joined;
+        }
+
+        Dwarf_Die Sibling = 0;
+        if (dwarf_siblingof(Context->Debug, Child, &Sibling, 0) != DW_DLV_OK) {
+            Sibling = 0;
+        }
+        dwarf_dealloc(Context->Debug, Child, DW_DLA_DIE);
+        Child = Sibling;
+    }
+
+    if (*Parameters == 0 && GetTagFlag(Attributes, DW_AT_prototyped)) {
+        free(Parameters);
+        Parameters = strdup("void");
+    }
+
+    char* Result = TypeConcat("(", Parameters, ")");
+    free(Parameters);
+
+    return Result;
+}
+
+struct TypeName* TypeResolve(struct DwarfContext* Context, Dwarf_Off Offset, int Depth)
+{
+    struct TypeName* Name = (struct TypeName*)OffsetMapFind(&Context->TypeNames, Offset);
+    if (Name != 0) {
+        return Name;
+    }
+
+    // inserted before recursing, a cycle in the type graph resolves to "?"
+    Name = (struct TypeName*)calloc(1, sizeof(struct TypeName));
+    TypeNameSet(Name, strdup("? "), strdup(""));
+    OffsetMapInsert(&Context->TypeNames, Offset, Name);
+
+    Dwarf_Die Die = 0;
+    if (Depth > TYPE_RESOLVE_DEPTH || dwarf_offdie_b(Context->Debug, Offset, 1, &Die, 0) != DW_DLV_OK) {
+        return Name;
+    }
+
+    struct DieAttributes Attributes;
+    Dwarf_Half Tag = 0;
+
+    dwarf_tag(Die, &Tag, 0);
+    DieAttributesLoad(Context, Die, &Attributes);
+
+    const char* TagName = GetTagString(&Attributes, DW_AT_name);
+    const char* Keyword = 0;
+    const char* Qualifier = 0;
+    struct TypeName* Target = 0;
+
+    switch (Tag) {
+        case DW_TAG_base_type:
+        case DW_TAG_typedef:
+        case DW_TAG_unspecified_type:
+            TypeNameSet(Name, TypeConcat(TagName == 0 ? "?" : TagName, " ", ""), strdup(""));
+            break;
+        case DW_TAG_structure_type:
+            Keyword = "struct ";
+            break;
+        case DW_TAG_union_type:
+            Keyword = "union ";
+            break;
+        case DW_TAG_enumeration_type:
+            Keyword = "enum ";
+            break;
+        case DW_TAG_class_type:
+            Keyword = "class ";
+            break;
+        case DW_TAG_const_type:
+            Qualifier = "const";
+            break;
+        case DW_TAG_volatile_type:
+            Qualifier = "volatile";
+            break;
+        case DW_TAG_restrict_type:
+            Qualifier = "restrict";
+            break;
+        case DW_TAG_pointer_type:
+        case DW_TAG_reference_type:
+        case DW_TAG_rvalue_reference_type: {
+            const char* Declarator = Tag == DW_TAG_pointer_type ? "*" : Tag == DW_TAG_reference_type ? "&" : "&&";
+            Target = TypeResolveAttribute(Context, &Attributes, Depth);
+            if (*Target->Suffix != 0) {
+                TypeNameSet(Name, TypeConcat(Target->Prefix, "(", Declarator), TypeConcat(")", Target->Suffix, ""));
+            } else {
+                TypeNameSet(Name, TypeConcat(Target->Prefix, Declarator, ""), strdup(""));
+            }
+            break;
+        }
+        case DW_TAG_array_type: {
+            Target = TypeResolveAttribute(Context, &Attributes, Depth);
+            char* Bounds = TypeArrayBounds(Context, Die);
+            TypeNameSet(Name, strdup(Target->Prefix), TypeConcat(Bounds, Target->Suffix, ""));
+            free(Bounds);
+            break;
+        }
+        case DW_TAG_subroutine_type: {
+            Target = TypeResolveAttribute(Context, &Attributes, Depth);
+            char* Parameters = TypeParameters(Context, Die, &Attributes, Depth);
+            TypeNameSet(Name, strdup(Target->Prefix), TypeConcat(Parameters, Target->Suffix, ""));
+            free(Parameters);
+            break;
+        }
+        default:
+            break;
+    }
+
+    if (Keyword != 0) {
+        TypeNameSet(Name, TypeConcat(Keyword, TagName == 0 ? "<anonymous>" : TagName, " "), strdup(""));
+    }
+
+    if (Qualifier != 0) {
+        Target = TypeResolveAttribute(Context, &Attributes, Depth);
+        size_t Length = strlen(Target->Prefix);
+        if (*Target->Suffix == 0 && Length > 0 && Target->Prefix[Length - 1] == ' ') {
+            // "const int", qualifying the base type
+            TypeNameSet(Name, TypeConcat(Qualifier, " ", Target->Prefix), strdup(""));
+        } else {
+            // "int * const", qualifying the pointer
+            char* Qualified = TypeConcat(Target->Prefix, " ", Qualifier);
+            TypeNameSet(Name, TypeConcat(Qualified, " ", ""), strdup(Target->Suffix));
+            free(Qualified);
+        }
+    }
+
+    DieAttributesFree(Context, &Attributes);
+    dwarf_dealloc(Context->Debug, Die, DW_DLA_DIE);
+
+    return Name;
+}
+
+// DW_AT_type as printed so far, followed by the resolved declaration with --resolve-types
+void OutputFieldType(struct DwarfContext* Context, struct DieAttributes* Attributes, Dwarf_Off Type)
+{
+    struct Output* Output = Context->Output;
+
+    if (!GlobalOptions.ResolveTypes) {
+        OutputFieldRef(Output, "DW_AT_type", Type);
+        return;
+    }
+
+    const char* Text = TypeResolveAttribute(Context, Attributes, 0)->Text;
+
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputFieldRef(Output, "DW_AT_type", Type);
+        OutputFieldString(Output, "DW_AT_type_name", Text);
+        return;
+    }
+
+    OutputFieldName(Output, "DW_AT_type");
+    OutputLiteral(Output, "<0x");
+    OutputHex(Output, Type, 8);
+    OutputLiteral(Output, "> ");
+    OutputString(Output, Text);
+    OutputLiteral(Output, "\n");
+}
+
+// DW_AT_location and DW_AT_frame_base compiled once into op arrays that can be evaluated
+// against any number of register and memory snapshots; families of ops are folded on the way:
+// DW_OP_lit*, DW_OP_const*u and DW_OP_constx become DW_OP_constu, DW_OP_const*s DW_OP_consts,
+// DW_OP_reg* DW_OP_regx, DW_OP_breg* DW_OP_bregx and DW_OP_addrx DW_OP_addr
+struct LocationOp {
+    uint8_t Code; // folded, what the evaluator switches on, 0 for an op that could not be compiled
+    uint8_t Atom; // as encoded, what gets printed
+    Dwarf_Unsigned Operand; // register of regx/bregx, op index for skip/bra
+    Dwarf_Unsigned Operand2; // offset of bregx, displacement of skip/bra, implicit value
+};
+
+// the ops of one expression, PCs in [Low, High) as dwarf_get_locdesc_entry_c() reports them
+struct LocationRange {
+    Dwarf_Addr Low;
+    Dwarf_Addr High;
+    uint32_t First;
+    uint32_t Count;
+};
+
+// one allocation holding both arrays, a plain expression is a single range covering every PC
+struct LocationList {
+    int Single;
+    size_t RangeCount;
+    struct LocationRange* Ranges;
+    struct LocationOp* Ops;
+};
+
+#define LOCATION_STACK_SIZE 64
+#define LOCATION_STEP_LIMIT 65536
+
+void LocationCacheFree(struct OffsetMap* Locations)
+{
+    for (size_t Index = 0; Index < Locations->Size; Index++) {
+        if (Locations->Keys[Index] != 0) {
+            free(Locations->Values[Index]);
+        }
+    }
+
+    OffsetMapFree(Locations);
+}
+
+Dwarf_Unsigned LocationSignExtend(Dwarf_Unsigned Value, int Bytes)
+{
+    int Shift = 64 - Bytes * 8;
+    return (Dwarf_Unsigned)(((int64_t)(Value << Shift)) >> Shift);
+}
+
+// reads the ops of one expression of Length bytes (0 when unknown) into Ops, -1 when libdwarf
+// refuses one of them
+int LocationCompileOps(struct DwarfContext* Context, Dwarf_Die Die, Dwarf_Locdesc_c Description, struct LocationOp* Ops, Dwarf_Unsigned Count, Dwarf_Unsigned Length)
+{
+    Dwarf_Unsigned* Offsets = (Dwarf_Unsigned*)malloc((Count + 1) * sizeof(Dwarf_Unsigned));
+
+    for (Dwarf_Unsigned Index = 0; Index < Count; Index++) {
+        struct LocationOp* Op = &Ops[Index];
+        Dwarf_Small Atom = 0;
+        Dwarf_Unsigned Operand = 0;
+        Dwarf_Unsigned Operand2 = 0;
+        Dwarf_Unsigned Operand3 = 0;
+
+        int Result = dwarf_get_location_op_value_c(Description, Index, &Atom, &Operand, &Operand2, &Operand3, &Offsets[Index], &Context->Error);
+        if (Result != DW_DLV_OK) {
+            free(Offsets);
+            return -1;
+        }
+
+        Op->Code = Atom;
+        Op->Atom = Atom;
+        Op->Operand = Operand;
+        Op->Operand2 = Operand2;
+
+        if (Atom >= DW_OP_lit0 && Atom <= DW_OP_lit31) {
+            Op->Code = DW_OP_constu;
+            Op->Operand = Atom - DW_OP_lit0;
+        } else if (Atom >= DW_OP_reg0 && Atom <= DW_OP_reg31) {
+            Op->Code = DW_OP_regx;
+            Op->Operand = Atom - DW_OP_reg0;
+        } else if (Atom >= DW_OP_breg0 && Atom <= DW_OP_breg31) {
+            Op->Code = DW_OP_bregx;
+            Op->Operand = Atom - DW_OP_breg0;
+            Op->Operand2 = Operand;
+        }
+
+        switch (Atom) {
+            case DW_OP_const1u:
+            case DW_OP_const2u:
+            case DW_OP_const4u:
+            case DW_OP_const8u:
+                Op->Code = DW_OP_constu;
+                break;
+            case DW_OP_const1s:
+                Op->Code = DW_OP_consts;
+                Op->Operand = LocationSignExtend(Operand, 1);
+                break;
+            case DW_OP_const2s:
+                Op->Code = DW_OP_consts;
+                Op->Operand = LocationSignExtend(Operand, 2);
+                break;
+            case DW_OP_const4s:
+                Op->Code = DW_OP_consts;
+                Op->Operand = LocationSignExtend(Operand, 4);
+                break;
+            case DW_OP_const8s:
+                Op->Code = DW_OP_consts;
+                break;
+            case DW_OP_addrx:
+            case DW_OP_constx:
+            case DW_OP_GNU_addr_index:
+            case DW_OP_GNU_const_index:
+                // .debug_addr is looked up here, not on every evaluation
+                Op->Code = Atom == DW_OP_addrx || Atom == DW_OP_GNU_addr_index ? DW_OP_addr : DW_OP_constu;
+                if (dwarf_debug_addr_index_to_addr(Die, Operand, &Op->Operand, &Context->Error) != DW_DLV_OK) {
+                    Op->Code = 0;
+                }
+                break;
+            case DW_OP_skip:
+            case DW_OP_bra:
+                Op->Operand2 = LocationSignExtend(Operand, 2);
+                break;
+            case DW_OP_implicit_value:
+                // values up to 8 bytes are kept, the block itself belongs to libdwarf
+                Op->Operand2 = 0;
+                if (Operand <= sizeof(Dwarf_Unsigned) && Operand2 != 0) {
+                    memcpy(&Op->Operand2, (const void*)(uintptr_t)Operand2, Operand);
+                } else {
+                    Op->Code = 0;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    // branch displacements count bytes from the end of the 3 byte op, the compiled form keeps op
+    // indices: the first byte after the expression ends it (index Count), a target inside an op,
+    // before the expression or past its end fails the branch; with no Length, anything past the
+    // start of the last op is taken as the end
+    for (Dwarf_Unsigned Index = 0; Index < Count; Index++) {
+        struct LocationOp* Op = &Ops[Index];
+        if (Op->Code != DW_OP_skip && Op->Code != DW_OP_bra) {
+            continue;
+        }
+
+        int64_t Target = (int64_t)(Offsets[Index] + 3 + Op->Operand2);
+        int AtEnd = Length != 0 ? Target == (int64_t)Length : Target > (int64_t)Offsets[Count - 1];
+        Op->Code = AtEnd ? Op->Atom : 0;
+        Op->Operand = Count;
+        for (Dwarf_Unsigned Other = 0; Other < Count; Other++) {
+            if ((int64_t)Offsets[Other] == Target) {
+                Op->Code = Op->Atom;
+                Op->Operand = Other;
+                break;
+            }
+        }
+    }
+
+    free(Offsets);
+    return 0;
+}
+
+// the compiled form of AttributeCode, built on first use and kept until the context goes away;
+// 0 without the attribute or when libdwarf cannot read it
+struct LocationList* LocationCompile(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Half AttributeCode)
+{
+    Dwarf_Attribute Attribute = GetTagAttribute(Attributes, AttributeCode);
+    Dwarf_Off Offset = 0;
+
+    if (Attribute == 0 || dwarf_dieoffset(Die, &Offset, 0) != DW_DLV_OK) {
+        return 0;
+    }
+
+    Dwarf_Off Key = Offset * 2 + (AttributeCode == DW_AT_frame_base);
+    struct LocationList* List = (struct LocationList*)OffsetMapFind(&Context->Locations, Key);
+    if (List != 0) {
+        return List;
+    }
+
+    Dwarf_Loc_Head_c Head = 0;
+    Dwarf_Unsigned EntryCount = 0;
+    if (dwarf_get_loclist_c(Attribute, &Head, &EntryCount, &Context->Error) != DW_DLV_OK) {
+        return 0;
+    }
+
+    // sizes first, then one allocation for the ranges and all of their ops
+    Dwarf_Unsigned RangeCount = 0;
+    Dwarf_Unsigned OpCount = 0;
+    Dwarf_Small Kind = DW_LKIND_expression;
+
+    for (Dwarf_Unsigned Index = 0; Index < EntryCount; Index++) {
+        Dwarf_Small Value = 0;
+        Dwarf_Addr Low = 0;
+        Dwarf_Addr High = 0;
+        Dwarf_Unsigned Count = 0;
+        Dwarf_Locdesc_c Description = 0;
+        Dwarf_Unsigned ExpressionOffset = 0;
+        Dwarf_Unsigned DescriptionOffset = 0;
+
+        if (dwarf_get_locdesc_entry_c(Head, Index, &Value, &Low, &High, &Count, &Description, &Kind, &ExpressionOffset, &DescriptionOffset, &Context->Error) != DW_DLV_OK) {
+            dwarf_loc_head_c_dealloc(Head);
+            return 0;
+        }
+
+        // base address and end of list entries carry no ops, neither does an optimized out range
+        if (Count > 0) {
+            RangeCount++;
+            OpCount += Count;
+        }
+    }
+
+    List = (struct LocationList*)calloc(1, sizeof(struct LocationList) + RangeCount * sizeof(struct LocationRange) + OpCount * sizeof(struct LocationOp));
+    List->Single = Kind == DW_LKIND_expression;
+    List->Ranges = (struct LocationRange*)(List + 1);
+    List->Ops = (struct LocationOp*)(List->Ranges + RangeCount);
+
+    uint32_t First = 0;
+    for (Dwarf_Unsigned Index = 0; Index < EntryCount; Index++) {
+        Dwarf_Small Value = 0;
+        Dwarf_Addr Low = 0;
+        Dwarf_Addr High = 0;
+        Dwarf_Unsigned Count = 0;
+        Dwarf_Locdesc_c Description = 0;
+        Dwarf_Unsigned ExpressionOffset = 0;
+        Dwarf_Unsigned DescriptionOffset = 0;
+
+        dwarf_get_locdesc_entry_c(Head, Index, &Value, &Low, &High, &Count, &Description, &Kind, &ExpressionOffset, &DescriptionOffset, &Context->Error);
+        if (Count == 0) {
+            continue;
+        }
+
+        // a list entry's expression ends where the next entry starts
+        Dwarf_Unsigned Length = 0;
+        Dwarf_Ptr Pointer = 0;
+        if (List->Single) {
+            if (dwarf_formexprloc(Attribute, &Length, &Pointer, 0) != DW_DLV_OK) {
+                Length = 0;
+            }
+        } else if (Index + 1 < EntryCount) {
+            Dwarf_Small NextValue = 0;
+            Dwarf_Addr NextLow = 0;
+            Dwarf_Addr NextHigh = 0;
+            Dwarf_Unsigned NextCount = 0;
+            Dwarf_Locdesc_c NextDescription = 0;
+            Dwarf_Small NextKind = 0;
+            Dwarf_Unsigned NextExpressionOffset = 0;
+            Dwarf_Unsigned NextDescriptionOffset = 0;
+
+            if (dwarf_get_locdesc_entry_c(Head, Index + 1, &NextValue, &NextLow, &NextHigh, &NextCount, &NextDescription, &NextKind, &NextExpressionOffset, &NextDescriptionOffset, &Context->Error) == DW_DLV_OK
+                && NextDescriptionOffset > ExpressionOffset) {
+                Length = NextDescriptionOffset - ExpressionOffset;
+            }
+        }
+
+        struct LocationRange* Range = &List->Ranges[List->RangeCount++];
+        Range->Low = List->Single ? 0 : Low;
+        Range->High = List->Single ? ~(Dwarf_Addr)0 : High;
+        Range->First = First;
+        Range->Count = (uint32_t)Count;
+
+        if (LocationCompileOps(Context, Die, Description, &List->Ops[First], Count, Length) != 0) {
+            List->RangeCount--;
+            continue;
+        }
+        First += (uint32_t)Count;
+    }
+
+    dwarf_loc_head_c_dealloc(Head);
+    OffsetMapInsert(&Context->Locations, Key, List);
+
+    return List;
+}
+
+int LocationEvaluate(const struct LocationList* List, Dwarf_Addr PC, const struct LocationFrame* Frame, struct LocationResult* Result)
+{
+    const struct LocationRange* Range = 0;
+
+    for (size_t Index = 0; Index < List->RangeCount; Index++) {
+        if (PC >= List->Ranges[Index].Low && PC < List->Ranges[Index].High) {
+            Range = &List->Ranges[Index];
+            break;
+        }
+    }
+
+    if (Range == 0) {
+        return -1;
+    }
+
+    const struct LocationOp* Ops = &List->Ops[Range->First];
+    Dwarf_Unsigned Stack[LOCATION_STACK_SIZE];
+    int Top = 0; // entries on Stack
+    int AddressSize = Frame->AddressSize != 0 ? Frame->AddressSize : 8;
+    int Steps = 0;
+
+    Result->Kind = LOCATION_MEMORY;
+    Result->Value = 0;
+
+#define LOCATION_NEED(Entries) \
+    if (Top < (Entries)) { \
+        return -1; \
+    }
+#define LOCATION_PUSH(Entry) \
+    if (Top == LOCATION_STACK_SIZE) { \
+        return -1; \
+    } \
+    Value = (Entry); \
+    Stack[Top++] = Value
+
+    for (uint32_t Index = 0; Index < Range->Count; Index++) {
+        const struct LocationOp* Op = &Ops[Index];
+        Dwarf_Unsigned Value = 0;
+
+        switch (Op->Code) {
+            case DW_OP_addr:
+            case DW_OP_constu:
+            case DW_OP_consts:
+                LOCATION_PUSH(Op->Operand);
+                break;
+            case DW_OP_regx:
+                Result->Kind = LOCATION_REGISTER;
+                Result->Value = Op->Operand;
+                return 0;
+            case DW_OP_bregx:
+                if (Op->Operand >= Frame->RegisterCount) {
+                    return -1;
+                }
+                LOCATION_PUSH(Frame->Registers[Op->Operand] + Op->Operand2);
+                break;
+            case DW_OP_fbreg:
+                LOCATION_PUSH(Frame->FrameBase + Op->Operand);
+                break;
+            case DW_OP_call_frame_cfa:
+                LOCATION_PUSH(Frame->CallFrameCFA);
+                break;
+            case DW_OP_deref:
+            case DW_OP_deref_size: {
+                LOCATION_NEED(1);
+                size_t Size = Op->Code == DW_OP_deref ? (size_t)AddressSize : (size_t)Op->Operand;
+                if (Size > sizeof(Value) || Frame->ReadMemory == 0 || Frame->ReadMemory(Frame->Data, Stack[Top - 1], &Value, Size) != 0) {
+                    return -1;
+                }
+                Stack[Top - 1] = Value;
+                break;
+            }
+            case DW_OP_dup:
+                LOCATION_NEED(1);
+                LOCATION_PUSH(Stack[Top - 1]);
+                break;
+            case DW_OP_drop:
+                LOCATION_NEED(1);
+                Top--;
+                break;
+            case DW_OP_over:
+                LOCATION_NEED(2);
+                LOCATION_PUSH(Stack[Top - 2]);
+                break;
+            case DW_OP_pick:
+                if (Op->Operand >= (Dwarf_Unsigned)Top) {
+                    return -1;
+                }
+                LOCATION_PUSH(Stack[Top - 1 - (int)Op->Operand]);
+                break;
+            case DW_OP_swap:
+                LOCATION_NEED(2);
+                Value = Stack[Top - 1];
+                Stack[Top - 1] = Stack[Top - 2];
+                Stack[Top - 2] = Value;
+                break;
+            case DW_OP_rot:
+                LOCATION_NEED(3);
+                Value = Stack[Top - 1];
+                Stack[Top - 1] = Stack[Top - 2];
+                Stack[Top - 2] = Stack[Top - 3];
+                Stack[Top - 3] = Value;
+                break;
+            case DW_OP_abs:
+                LOCATION_NEED(1);
+                if ((int64_t)Stack[Top - 1] < 0) {
+                    Stack[Top - 1] = -Stack[Top - 1];
+                }
+                break;
+            case DW_OP_neg:
+                LOCATION_NEED(1);
+                Stack[Top - 1] = -Stack[Top - 1];
+                break;
+            case DW_OP_not:
+                LOCATION_NEED(1);
+                Stack[Top - 1] = ~Stack[Top - 1];
+                break;
+            case DW_OP_plus_uconst:
+                LOCATION_NEED(1);
+                Stack[Top - 1] += Op->Operand;
+                break;
+            case DW_OP_and:
+            case DW_OP_or:
+            case DW_OP_xor:
+            case DW_OP_plus:
+            case DW_OP_minus:
+            case DW_OP_mul:
+            case DW_OP_div:
+            case DW_OP_mod:
+            case DW_OP_shl:
+            case DW_OP_shr:
+            case DW_OP_shra:
+            case DW_OP_eq:
+            case DW_OP_ne:
+            case DW_OP_lt:
+            case DW_OP_le:
+            case DW_OP_gt:
+            case DW_OP_ge: {
+                LOCATION_NEED(2);
+                Dwarf_Unsigned Right = Stack[--Top];
+                Dwarf_Unsigned Left = Stack[Top - 1];
+                switch (Op->Code) {
+                    case DW_OP_and: Value = Left & Right; break;
+                    case DW_OP_or: Value = Left | Right; break;
+                    case DW_OP_xor: Value = Left ^ Right; break;
+                    case DW_OP_plus: Value = Left + Right; break;
+                    case DW_OP_minus: Value = Left - Right; break;
+                    case DW_OP_mul: Value = Left * Right; break;
+                    case DW_OP_div:
+                        if (Right == 0) {
+                            return -1;
+                        }
+                        Value = (Dwarf_Unsigned)((int64_t)Left / (int64_t)Right);
+                        break;
+                    case DW_OP_mod:
+                        if (Right == 0) {
+                            return -1;
+                        }
+                        Value = Left % Right;
+                        break;
+                    case DW_OP_shl: Value = Right >= 64 ? 0 : Left << Right; break;
+                    case DW_OP_shr: Value = Right >= 64 ? 0 : Left >> Right; break;
+                    case DW_OP_shra: Value = (Dwarf_Unsigned)((int64_t)Left >> (Right >= 64 ? 63 : Right)); break;
+                    case DW_OP_eq: Value = Left == Right; break;
+                    case DW_OP_ne: Value = Left != Right; break;
+                    case DW_OP_lt: Value = (int64_t)Left < (int64_t)Right; break;
+                    case DW_OP_le: Value = (int64_t)Left <= (int64_t)Right; break;
+                    case DW_OP_gt: Value = (int64_t)Left > (int64_t)Right; break;
+                    case DW_OP_ge: Value = (int64_t)Left >= (int64_t)Right; break;
+                }
+                Stack[Top - 1] = Value;
+                break;
+            }
+            case DW_OP_skip:
+                if (++Steps > LOCATION_STEP_LIMIT) {
+                    return -1;
+                }
+                Index = (uint32_t)Op->Operand - 1;
+                break;
+            case DW_OP_bra:
+                LOCATION_NEED(1);
+                if (++Steps > LOCATION_STEP_LIMIT) {
+                    return -1;
+                }
+                if (Stack[--Top] != 0) {
+                    Index = (uint32_t)Op->Operand - 1;
+                }
+                break;
+            case DW_OP_nop:
+                break;
+            case DW_OP_stack_value:
+                LOCATION_NEED(1);
+                Result->Kind = LOCATION_VALUE;
+                Result->Value = Stack[Top - 1];
+                return 0;
+            case DW_OP_implicit_value:
+                Result->Kind = LOCATION_VALUE;
+                Result->Value = Op->Operand2;
+                return 0;
+            case DW_OP_piece:
+            case DW_OP_bit_piece:
+                Index = Range->Count;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+#undef LOCATION_NEED
+#undef LOCATION_PUSH
+
+    if (Top == 0) {
+        return -1;
+    }
+
+    Result->Value = Stack[Top - 1];
+    return 0;
+}
+
+int LocationFrameBase(const struct LocationList* FrameBase, Dwarf_Addr PC, const struct LocationFrame* Frame, Dwarf_Addr* Base)
+{
+    struct LocationResult Result;
+
+    if (LocationEvaluate(FrameBase, PC, Frame, &Result) != 0) {
+        return -1;
+    }
+
+    if (Result.Kind == LOCATION_REGISTER) {
+        if (Result.Value >= Frame->RegisterCount) {
+            return -1;
+        }
+        Result.Value = Frame->Registers[Result.Value];
+    }
+
+    *Base = Result.Value;
+    return 0;
+}
+
+void OutputSigned(struct Output* Output, Dwarf_Unsigned Value)
+{
+    if ((int64_t)Value < 0) {
+        OutputLiteral(Output, "-");
+        Value = -Value;
+    }
+    OutputUnsigned(Output, Value);
+}
+
+// "DW_OP_breg7 8; DW_OP_deref", lists as "[0x..., 0x...) ops, ..."
+void OutputLocationOps(struct Output* Output, const struct LocationOp* Ops, uint32_t Count)
+{
+    for (uint32_t Index = 0; Index < Count; Index++) {
+        const struct LocationOp* Op = &Ops[Index];
+        const char* Name = 0;
+
+        if (Index > 0) {
+            OutputLiteral(Output, "; ");
+        }
+
+        if (dwarf_get_OP_name(Op->Atom, &Name) == DW_DLV_OK) {
+            OutputString(Output, Name);
+        } else {
+            OutputLiteral(Output, "DW_OP_0x");
+            OutputHex(Output, Op->Atom, 2);
+        }
+
+        if ((Op->Atom >= DW_OP_lit0 && Op->Atom <= DW_OP_reg31) || Op->Code == 0) {
+            continue;
+        }
+
+        switch (Op->Code) {
+            case DW_OP_addr:
+                OutputLiteral(Output, " 0x");
+                OutputHex(Output, Op->Operand, 8);
+                break;
+            case DW_OP_consts:
+            case DW_OP_fbreg:
+                OutputLiteral(Output, " ");
+                OutputSigned(Output, Op->Operand);
+                break;
+            case DW_OP_bregx:
+                if (Op->Atom == DW_OP_bregx) {
+                    OutputLiteral(Output, " ");
+                    OutputUnsigned(Output, Op->Operand);
+                }
+                OutputLiteral(Output, " ");
+                OutputSigned(Output, Op->Operand2);
+                break;
+            case DW_OP_skip:
+            case DW_OP_bra:
+                OutputLiteral(Output, " ");
+                OutputSigned(Output, Op->Operand2);
+                break;
+            case DW_OP_constu:
+            case DW_OP_regx:
+            case DW_OP_pick:
+            case DW_OP_plus_uconst:
+            case DW_OP_deref_size:
+            case DW_OP_piece:
+            case DW_OP_implicit_value:
+            case DW_OP_entry_value:
+            case DW_OP_GNU_entry_value:
+                // the implicit value and the entry value expression are given by their length
+                OutputLiteral(Output, " ");
+                OutputUnsigned(Output, Op->Operand);
+                break;
+            case DW_OP_bit_piece:
+                // size and offset in bits
+                OutputLiteral(Output, " ");
+                OutputUnsigned(Output, Op->Operand);
+                OutputLiteral(Output, " ");
+                OutputUnsigned(Output, Op->Operand2);
+                break;
+            case DW_OP_call2:
+            case DW_OP_call4:
+            case DW_OP_call_ref:
+            case DW_OP_GNU_parameter_ref:
+            case DW_OP_GNU_variable_value:
+            case DW_OP_convert:
+            case DW_OP_GNU_convert:
+            case DW_OP_reinterpret:
+            case DW_OP_GNU_reinterpret:
+            case DW_OP_const_type:
+            case DW_OP_GNU_const_type:
+                // DIE offsets, CU relative for call2/call4 and the typed ops, the constant of
+                // DW_OP_const_type is left out
+                OutputLiteral(Output, " <0x");
+                OutputHex(Output, Op->Operand, 8);
+                OutputLiteral(Output, ">");
+                break;
+            case DW_OP_implicit_pointer:
+            case DW_OP_GNU_implicit_pointer:
+                OutputLiteral(Output, " <0x");
+                OutputHex(Output, Op->Operand, 8);
+                OutputLiteral(Output, "> ");
+                OutputSigned(Output, Op->Operand2);
+                break;
+            case DW_OP_regval_type:
+            case DW_OP_GNU_regval_type:
+            case DW_OP_deref_type:
+            case DW_OP_GNU_deref_type:
+                // register or size first, then the type
+                OutputLiteral(Output, " ");
+                OutputUnsigned(Output, Op->Operand);
+                OutputLiteral(Output, " <0x");
+                OutputHex(Output, Op->Operand2, 8);
+                OutputLiteral(Output, ">");
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// the decoded expression with --decode-locations, its length in bytes as before otherwise
+void OutputFieldLocation(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Half AttributeCode, const char* Name)
+{
+    struct Output* Output = Context->Output;
+    struct LocationList* List = GlobalOptions.DecodeLocations ? LocationCompile(Context, Die, Attributes, AttributeCode) : 0;
+
+    if (List == 0) {
+        Dwarf_Ptr Pointer = 0;
+        Dwarf_Unsigned Length = GetTagExprLoc(Context, Attributes, AttributeCode, &Pointer);
+        if (AttributeCode == DW_AT_frame_base) {
+            OutputFieldHex(Output, Name, Length);
+        } else {
+            OutputFieldUnsigned(Output, Name, Length);
+        }
+        return;
+    }
+
+    OutputFieldName(Output, Name);
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputLiteral(Output, "\"");
+    }
+
+    for (size_t Index = 0; Index < List->RangeCount; Index++) {
+        struct LocationRange* Range = &List->Ranges[Index];
+        if (Index > 0) {
+            OutputLiteral(Output, ", ");
+        }
+        if (!List->Single) {
+            OutputLiteral(Output, "[0x");
+            OutputHex(Output, Range->Low, 8);
+            OutputLiteral(Output, ", 0x");
+            OutputHex(Output, Range->High, 8);
+            OutputLiteral(Output, ") ");
+        }
+        OutputLocationOps(Output, &List->Ops[Range->First], Range->Count);
+    }
+
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputLiteral(Output, "\"");
+    }
+    OutputFieldEnd(Output);
+}
+
+// --layout: padding holes, trailing padding and cache line crossings of every struct, reported
+// once per definition however many CUs include it
+#define LAYOUT_CACHE_LINE 64
+
+struct LayoutMember {
+    Dwarf_Unsigned Name; // offsets into the table's string table
+    Dwarf_Unsigned Offset; // bytes from the start of the struct
+    Dwarf_Unsigned Size; // bytes the member touches, bit fields rounded out to whole bytes
+    Dwarf_Unsigned Alignment;
+};
+
+struct LayoutStruct {
+    Dwarf_Unsigned Name;
+    Dwarf_Unsigned File;
+    Dwarf_Unsigned Line;
+    Dwarf_Off Offset; // of the first definition seen
+    Dwarf_Unsigned Size;
+    Dwarf_Unsigned Holes;
+    Dwarf_Unsigned HoleBytes;
+    Dwarf_Unsigned Trailing;
+    Dwarf_Unsigned Crossing; // members that fit in a cache line but straddle two
+    Dwarf_Unsigned Packed; // size with the members sorted by alignment
+    size_t First; // members in the table's Members
+    size_t Count;
+};
+
+struct LayoutTable {
+    struct LayoutStruct* Structs;
+    size_t StructCount;
+    size_t StructSize;
+    struct LayoutMember* Members;
+    size_t MemberCount;
+    size_t MemberSize;
+    struct StringTable Strings;
+    struct OffsetMap Seen; // structural hash, see TypeHashAt() -> 1
+    struct OffsetMap Types; // type DIE offset -> size << 8 | alignment
+};
+
+void LayoutTableInit(struct LayoutTable* Table)
+{
+    memset(Table, 0, sizeof(*Table));
+
+    Table->StructSize = 1024;
+    Table->Structs = (struct LayoutStruct*)malloc(Table->StructSize * sizeof(struct LayoutStruct));
+    Table->MemberSize = 8192;
+    Table->Members = (struct LayoutMember*)malloc(Table->MemberSize * sizeof(struct LayoutMember));
+    StringTableInit(&Table->Strings);
+    OffsetMapInit(&Table->Seen, 4096);
+    OffsetMapInit(&Table->Types, 4096);
+}
+
+void LayoutTableFree(struct LayoutTable* Table)
+{
+    free(Table->Structs);
+    free(Table->Members);
+    StringTableFree(&Table->Strings);
+    OffsetMapFree(&Table->Seen);
+    OffsetMapFree(&Table->Types);
+}
+
+// natural alignment of a scalar, the largest power of two up to 16 dividing its size
+Dwarf_Unsigned LayoutScalarAlignment(Dwarf_Unsigned Size)
+{
+    Dwarf_Unsigned Alignment = 1;
+    while (Alignment < 16 && Size % (Alignment * 2) == 0) {
+        Alignment *= 2;
+    }
+
+    return Alignment;
+}
+
+Dwarf_Unsigned LayoutTypeSize(struct DwarfContext* Context, struct LayoutTable* Table, Dwarf_Off Offset, Dwarf_Unsigned* Alignment, int Depth);
+
+// element count of an array type, the product of its subranges; 0 for a flexible array
+Dwarf_Unsigned LayoutArrayCount(struct DwarfContext* Context, Dwarf_Die Die)
+{
+    Dwarf_Unsigned Count = 1;
+    Dwarf_Die Child = 0;
+
+    if (dwarf_child(Die, &Child, 0) != DW_DLV_OK) {
+        return 0;
+    }
+
+    while (Child != 0) {
+        Dwarf_Half Tag = 0;
+        Dwarf_Die Sibling = 0;
+
+        dwarf_tag(Child, &Tag, 0);
+        if (Tag == DW_TAG_subrange_type) {
+            struct DieAttributes Attributes;
+            DieAttributesLoad(Context, Child, &Attributes);
+
+            if (GetTagAttribute(&Attributes, DW_AT_count) != 0) {
+                Count *= GetTagUnsignedData(&Attributes, DW_AT_count);
+            } else if (GetTagAttribute(&Attributes, DW_AT_upper_bound) != 0) {
+                Count *= GetTagUnsignedData(&Attributes, DW_AT_upper_bound) + 1 - GetTagUnsignedData(&Attributes, DW_AT_lower_bound);
+            } else {
+                Count = 0;
+            }
+
+            DieAttributesFree(Context, &Attributes);
+        }
+
+        if (dwarf_siblingof(Context->Debug, Child, &Sibling, 0) != DW_DLV_OK) {
+            Sibling = 0;
+        }
+        dwarf_dealloc(Context->Debug, Child, DW_DLA_DIE);
+        Child = Sibling;
+    }
+
+    return Count;
+}
+
+// alignment of a struct or union, DW_AT_alignment or the largest one among its members
+Dwarf_Unsigned LayoutAggregateAlignment(struct DwarfContext* Context, struct LayoutTable* Table, Dwarf_Die Die, int Depth)
+{
+    Dwarf_Unsigned Alignment = 1;
+    Dwarf_Die Child = 0;
+
+    if (dwarf_child(Die, &Child, 0) != DW_DLV_OK) {
+        return Alignment;
+    }
+
+    while (Child != 0) {
+        Dwarf_Half Tag = 0;
+        Dwarf_Die Sibling = 0;
+
+        dwarf_tag(Child, &Tag, 0);
+        if (Tag == DW_TAG_member) {
+            struct DieAttributes Attributes;
+            Dwarf_Unsigned MemberAlignment = 1;
+
+            DieAttributesLoad(Context, Child, &Attributes);
+            if (!GetTagFlag(&Attributes, DW_AT_declaration)) {
+                LayoutTypeSize(Context, Table, GetTagGlobalRef(&Attributes, DW_AT_type), &MemberAlignment, Depth + 1);
+            }
+            DieAttributesFree(Context, &Attributes);
+
+            if (MemberAlignment > Alignment) {
+                Alignment = MemberAlignment;
+            }
+        }
+
+        if (dwarf_siblingof(Context->Debug, Child, &Sibling, 0) != DW_DLV_OK) {
+            Sibling = 0;
+        }
+        dwarf_dealloc(Context->Debug, Child, DW_DLA_DIE);
+        Child = Sibling;
+    }
+
+    return Alignment;
+}
+
+// size in bytes of the type at a .debug_info offset, computed once; alignment comes from
+// DW_AT_alignment when present and is otherwise derived like the ABI does for C
+Dwarf_Unsigned LayoutTypeSize(struct DwarfContext* Context, struct LayoutTable* Table, Dwarf_Off Offset, Dwarf_Unsigned* Alignment, int Depth)
+{
+    uintptr_t Known = (uintptr_t)OffsetMapFind(&Table->Types, Offset);
+    if (Known != 0) {
+        *Alignment = Known & 0xff;
+        return Known >> 8;
+    }
+
+    *Alignment = 1;
+
+    // inserted before recursing, a cycle ends in an empty type
+    OffsetMapInsert(&Table->Types, Offset, (void*)(uintptr_t)1);
+
+    Dwarf_Die Die = 0;
+    if (Offset == 0 || Depth > TYPE_RESOLVE_DEPTH || dwarf_offdie_b(Context->Debug, Offset, 1, &Die, 0) != DW_DLV_OK) {
+        return 0;
+    }
+
+    struct DieAttributes Attributes;
+    Dwarf_Half Tag = 0;
+
+    dwarf_tag(Die, &Tag, 0);
+    DieAttributesLoad(Context, Die, &Attributes);
+
+    Dwarf_Unsigned Size = GetTagUnsignedData(&Attributes, DW_AT_byte_size);
+    int HasSize = GetTagAttribute(&Attributes, DW_AT_byte_size) != 0;
+
+    switch (Tag) {
+        case DW_TAG_typedef:
+        case DW_TAG_const_type:
+        case DW_TAG_volatile_type:
+        case DW_TAG_restrict_type:
+        case DW_TAG_atomic_type:
+            Size = LayoutTypeSize(Context, Table, GetTagGlobalRef(&Attributes, DW_AT_type), Alignment, Depth + 1);
+            break;
+        case DW_TAG_array_type: {
+            Dwarf_Unsigned Element = LayoutTypeSize(Context, Table, GetTagGlobalRef(&Attributes, DW_AT_type), Alignment, Depth + 1);
+            if (!HasSize) {
+                Size = Element * LayoutArrayCount(Context, Die);
+            }
+            break;
+        }
+        case DW_TAG_structure_type:
+        case DW_TAG_union_type:
+        case DW_TAG_class_type:
+            *Alignment = LayoutAggregateAlignment(Context, Table, Die, Depth);
+            break;
+        case DW_TAG_pointer_type:
+        case DW_TAG_reference_type:
+        case DW_TAG_rvalue_reference_type:
+            if (!HasSize) {
+                Size = 8;
+            }
+            *Alignment = LayoutScalarAlignment(Size);
+            break;
+        default:
+            *Alignment = LayoutScalarAlignment(Size);
+            break;
+    }
+
+    if (GetTagAttribute(&Attributes, DW_AT_alignment) != 0) {
+        *Alignment = GetTagUnsignedData(&Attributes, DW_AT_alignment);
+    }
+    if (*Alignment == 0 || *Alignment > 0xff) {
+        *Alignment = 1;
+    }
+
+    DieAttributesFree(Context, &Attributes);
+    dwarf_dealloc(Context->Debug, Die, DW_DLA_DIE);
+
+    OffsetMapInsert(&Table->Types, Offset, (void*)(uintptr_t)(Size << 8 | *Alignment));
+
+    return Size;
+}
+
+// byte offset of a member, DWARF 2 compilers emit DW_OP_plus_uconst instead of a constant
+Dwarf_Unsigned LayoutMemberOffset(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes)
+{
+    Dwarf_Unsigned Offset = 0;
+    Dwarf_Attribute Attribute = GetTagAttribute(Attributes, DW_AT_data_member_location);
+
+    if (Attribute == 0 || dwarf_formudata(Attribute, &Offset, 0) == DW_DLV_OK) {
+        return Offset;
+    }
+
+    struct LocationList* List = LocationCompile(Context, Die, Attributes, DW_AT_data_member_location);
+    if (List != 0 && List->RangeCount == 1 && List->Ranges[0].Count == 1 && List->Ops[0].Code == DW_OP_plus_uconst) {
+        Offset = List->Ops[0].Operand;
+    }
+
+    return Offset;
+}
+
+int LayoutMemberCompare(const void* A, const void* B)
+{
+    const struct LayoutMember* MemberA = (const struct LayoutMember*)A;
+    const struct LayoutMember* MemberB = (const struct LayoutMember*)B;
+
+    if (MemberA->Offset != MemberB->Offset) {
+        return MemberA->Offset < MemberB->Offset ? -1 : 1;
+    }
+
+    return 0;
+}
+
+int LayoutAlignmentCompare(const void* A, const void* B)
+{
+    Dwarf_Unsigned AlignmentA = *(const Dwarf_Unsigned*)A;
+    Dwarf_Unsigned AlignmentB = *(const Dwarf_Unsigned*)B;
+
+    return AlignmentA > AlignmentB ? -1 : AlignmentA < AlignmentB;
+}
+
+// the size the members would need sorted by decreasing alignment, the order that leaves the
+// least padding when sizes are multiples of their alignment as they are in C
+Dwarf_Unsigned LayoutPackedSize(struct LayoutMember* Members, size_t Count)
+{
+    Dwarf_Unsigned* Order = (Dwarf_Unsigned*)malloc((Count + 1) * 2 * sizeof(Dwarf_Unsigned));
+    Dwarf_Unsigned Largest = 1;
+    Dwarf_Unsigned Size = 0;
+
+    for (size_t Index = 0; Index < Count; Index++) {
+        Order[Index * 2] = Members[Index].Alignment;
+        Order[Index * 2 + 1] = Members[Index].Size;
+    }
+    qsort(Order, Count, 2 * sizeof(Dwarf_Unsigned), LayoutAlignmentCompare);
+
+    for (size_t Index = 0; Index < Count; Index++) {
+        Dwarf_Unsigned Alignment = Order[Index * 2];
+        Size = (Size + Alignment - 1) / Alignment * Alignment + Order[Index * 2 + 1];
+        if (Alignment > Largest) {
+            Largest = Alignment;
+        }
+    }
+
+    free(Order);
+    return (Size + Largest - 1) / Largest * Largest;
+}
+
+void LayoutStructAppend(struct DwarfContext* Context, struct LayoutTable* Table, struct WalkerEntry* Entry, struct DieAttributes* Attributes)
+{
+    if (GetTagFlag(Attributes, DW_AT_declaration) || GetTagAttribute(Attributes, DW_AT_byte_size) == 0) {
+        return;
+    }
+
+    const char* Name = GetTagString(Attributes, DW_AT_name);
+    const char* File = SourceFileName(Context, GetTagUnsignedData(Attributes, DW_AT_decl_file));
+    Dwarf_Unsigned Line = GetTagUnsignedData(Attributes, DW_AT_decl_line);
+    Dwarf_Unsigned Size = GetTagUnsignedData(Attributes, DW_AT_byte_size);
+
+    // every CU including a header repeats its structs, only the first copy gets its members read;
+    // the structural hash tells copies apart from different structs sharing a name and a line
+    int Open = INT_MAX;
+    Dwarf_Off Hash = TypeHashAt(Context, Entry->Offset, 0, &Open) >> 1; // OffsetMap stores Key + 1
+
+    if (OffsetMapFind(&Table->Seen, Hash) != 0) {
+        return;
+    }
+    OffsetMapInsert(&Table->Seen, Hash, (void*)(uintptr_t)1);
+
+    if (Table->StructCount == Table->StructSize) {
+        Table->StructSize *= 2;
+        Table->Structs = (struct LayoutStruct*)realloc(Table->Structs, Table->StructSize * sizeof(struct LayoutStruct));
+    }
+
+    struct LayoutStruct* Struct = &Table->Structs[Table->StructCount++];
+    memset(Struct, 0, sizeof(*Struct));
+    Struct->Name = StringTableIntern(&Table->Strings, Name);
+    Struct->File = StringTableIntern(&Table->Strings, File);
+    Struct->Line = Line;
+    Struct->Offset = Entry->Offset;
+    Struct->Size = Size;
+    Struct->First = Table->MemberCount;
+
+    Dwarf_Die Child = 0;
+    if (dwarf_child(Entry->Die, &Child, 0) != DW_DLV_OK) {
+        Child = 0;
+    }
+
+    while (Child != 0) {
+        Dwarf_Half Tag = 0;
+        Dwarf_Die Sibling = 0;
+
+        dwarf_tag(Child, &Tag, 0);
+        if (Tag == DW_TAG_member) {
+            struct DieAttributes MemberAttributes;
+            DieAttributesLoad(Context, Child, &MemberAttributes);
+
+            // C++ static members have no place in the object
+            if (!GetTagFlag(&MemberAttributes, DW_AT_declaration) && !GetTagFlag(&MemberAttributes, DW_AT_external)) {
+                if (Table->MemberCount == Table->MemberSize) {
+                    Table->MemberSize *= 2;
+                    Table->Members = (struct LayoutMember*)realloc(Table->Members, Table->MemberSize * sizeof(struct LayoutMember));
+                }
+
+                struct LayoutMember* Member = &Table->Members[Table->MemberCount++];
+                Member->Name = StringTableIntern(&Table->Strings, GetTagString(&MemberAttributes, DW_AT_name));
+                Member->Size = LayoutTypeSize(Context, Table, GetTagGlobalRef(&MemberAttributes, DW_AT_type), &Member->Alignment, 0);
+                Member->Offset = LayoutMemberOffset(Context, Child, &MemberAttributes);
+
+                // bit fields take the bytes their bits touch, alignment no longer applies
+                Dwarf_Unsigned Bits = GetTagUnsignedData(&MemberAttributes, DW_AT_bit_size);
+                if (Bits != 0 && GetTagAttribute(&MemberAttributes, DW_AT_data_bit_offset) != 0) {
+                    Dwarf_Unsigned BitOffset = GetTagUnsignedData(&MemberAttributes, DW_AT_data_bit_offset);
+                    Member->Offset = BitOffset / 8;
+                    Member->Size = (BitOffset + Bits + 7) / 8 - Member->Offset;
+                    Member->Alignment = 1;
+                } else if (Bits != 0) {
+                    Member->Alignment = 1;
+                }
+            }
+
+            DieAttributesFree(Context, &MemberAttributes);
+        }
+
+        if (dwarf_siblingof(Context->Debug, Child, &Sibling, 0) != DW_DLV_OK) {
+            Sibling = 0;
+        }
+        dwarf_dealloc(Context->Debug, Child, DW_DLA_DIE);
+        Child = Sibling;
+    }
+
+    Struct->Count = Table->MemberCount - Struct->First;
+
+    struct LayoutMember* Members = &Table->Members[Struct->First];
+    qsort(Members, Struct->Count, sizeof(struct LayoutMember), LayoutMemberCompare);
+
+    Dwarf_Unsigned End = 0;
+    for (size_t Index = 0; Index < Struct->Count; Index++) {
+        struct LayoutMember* Member = &Members[Index];
+
+        if (Member->Offset > End) {
+            Struct->Holes++;
+            Struct->HoleBytes += Member->Offset - End;
+        }
+        if (Member->Offset + Member->Size > End) {
+            End = Member->Offset + Member->Size;
+        }
+
+        if (Member->Size > 0 && Member->Size <= LAYOUT_CACHE_LINE
+            && Member->Offset / LAYOUT_CACHE_LINE != (Member->Offset + Member->Size - 1) / LAYOUT_CACHE_LINE) {
+            Struct->Crossing++;
+        }
+    }
+
+    Struct->Trailing = Size > End ? Size - End : 0;
+    Struct->Packed = LayoutPackedSize(Members, Struct->Count);
+}
+
+static struct LayoutTable* LayoutSortBase; // qsort() has no context argument
+
+// most wasted bytes first, then by name
+int LayoutStructCompare(const void* A, const void* B)
+{
+    const struct LayoutStruct* StructA = (const struct LayoutStruct*)A;
+    const struct LayoutStruct* StructB = (const struct LayoutStruct*)B;
+    Dwarf_Unsigned WastedA = StructA->HoleBytes + StructA->Trailing;
+    Dwarf_Unsigned WastedB = StructB->HoleBytes + StructB->Trailing;
+
+    if (WastedA != WastedB) {
+        return WastedA > WastedB ? -1 : 1;
+    }
+
+    int Order = strcmp(LayoutSortBase->Strings.Strings + StructA->Name, LayoutSortBase->Strings.Strings + StructB->Name);
+    if (Order != 0) {
+        return Order;
+    }
+
+    return StructA->Offset < StructB->Offset ? -1 : StructA->Offset > StructB->Offset;
+}
+
+void LayoutPrintStruct(struct LayoutTable* Table, struct LayoutStruct* Struct, struct Output* Output)
+{
+    const char* Strings = Table->Strings.Strings;
+    const char* Name = Struct->Name == 0 ? "<anonymous>" : Strings + Struct->Name;
+    Dwarf_Unsigned Saved = Struct->Packed < Struct->Size ? Struct->Size - Struct->Packed : 0;
+
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputRecordBegin(Output, "layout");
+        OutputFieldUnsigned(Output, "offset", Struct->Offset);
+        OutputFieldString(Output, "name", Name);
+        OutputFieldString(Output, "decl_file", Struct->File == 0 ? 0 : Strings + Struct->File);
+        OutputFieldUnsigned(Output, "decl_line", Struct->Line);
+        OutputFieldUnsigned(Output, "size", Struct->Size);
+        OutputFieldUnsigned(Output, "holes", Struct->Holes);
+        OutputFieldUnsigned(Output, "hole_bytes", Struct->HoleBytes);
+        OutputFieldUnsigned(Output, "trailing", Struct->Trailing);
+        OutputFieldUnsigned(Output, "crossing", Struct->Crossing);
+        OutputFieldUnsigned(Output, "reordered_size", Saved != 0 ? Struct->Packed : Struct->Size);
+        OutputRecordEnd(Output);
+        return;
+    }
+
+    OutputLiteral(Output, "struct ");
+    OutputString(Output, Name);
+    OutputLiteral(Output, ": ");
+    OutputUnsigned(Output, Struct->Size);
+    OutputLiteral(Output, " bytes, ");
+    OutputUnsigned(Output, Struct->HoleBytes + Struct->Trailing);
+    OutputLiteral(Output, " wasted");
+    if (Saved != 0) {
+        OutputLiteral(Output, ", ");
+        OutputUnsigned(Output, Struct->Packed);
+        OutputLiteral(Output, " bytes reordered");
+    }
+    if (Struct->File != 0) {
+        OutputLiteral(Output, " (");
+        OutputString(Output, Strings + Struct->File);
+        OutputLiteral(Output, ":");
+        OutputUnsigned(Output, Struct->Line);
+        OutputLiteral(Output, ")");
+    }
+    OutputLiteral(Output, "\n");
+
+    Dwarf_Unsigned End = 0;
+    struct LayoutMember* Members = &Table->Members[Struct->First];
+    for (size_t Index = 0; Index < Struct->Count; Index++) {
+        struct LayoutMember* Member = &Members[Index];
+
+        if (Member->Offset > End) {
+            OutputLiteral(Output, "\thole: ");
+            OutputUnsigned(Output, Member->Offset - End);
+            OutputLiteral(Output, " bytes at ");
+            OutputUnsigned(Output, End);
+            OutputLiteral(Output, "\n");
+        }
+        if (Member->Offset + Member->Size > End) {
+            End = Member->Offset + Member->Size;
+        }
+
+        if (Member->Size > 0 && Member->Size <= LAYOUT_CACHE_LINE
+            && Member->Offset / LAYOUT_CACHE_LINE != (Member->Offset + Member->Size - 1) / LAYOUT_CACHE_LINE) {
+            OutputLiteral(Output, "\tcache line crossing: ");
+            OutputString(Output, Member->Name == 0 ? "<anonymous>" : Strings + Member->Name);
+            OutputLiteral(Output, " at ");
+            OutputUnsigned(Output, Member->Offset);
+            OutputLiteral(Output, ", ");
+            OutputUnsigned(Output, Member->Size);
+            OutputLiteral(Output, " bytes\n");
+        }
+    }
+
+    if (Struct->Trailing != 0) {
+        OutputLiteral(Output, "\ttrailing padding: ");
+        OutputUnsigned(Output, Struct->Trailing);
+        OutputLiteral(Output, " bytes\n");
+    }
+}
+
+// structs without holes, trailing padding or crossings are left out
+void LayoutPrint(struct LayoutTable* Table, struct Output* Output)
+{
+    LayoutSortBase = Table;
+    qsort(Table->Structs, Table->StructCount, sizeof(struct LayoutStruct), LayoutStructCompare);
+
+    for (size_t Index = 0; Index < Table->StructCount; Index++) {
+        struct LayoutStruct* Struct = &Table->Structs[Index];
+        if (Struct->HoleBytes + Struct->Trailing + Struct->Crossing != 0) {
+            LayoutPrintStruct(Table, Struct, Output);
+        }
+    }
+}
+
+void HandleDwarfEnumerationType(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren)
+{
+    const char* Name = GetTagString(Attributes, DW_AT_name);
+    Dwarf_Unsigned Encoding = GetTagUnsignedData(Attributes, DW_AT_encoding);
+    Dwarf_Unsigned Size = GetTagUnsignedData(Attributes, DW_AT_byte_size);
+    Dwarf_Unsigned Line = GetTagUnsignedData(Attributes, DW_AT_decl_line);
+    Dwarf_Unsigned File = GetTagUnsignedData(Attributes, DW_AT_decl_file);
+    Dwarf_Unsigned Column = GetTagUnsignedData(Attributes, DW_AT_decl_column);
+    Dwarf_Off Type = GetTagRef(Attributes, DW_AT_type);
+    Dwarf_Off Sibling = GetTagRef(Attributes, DW_AT_sibling);
+
+    struct Output* Output = Context->Output;
+    OutputTagWithChildren(Output, "DW_TAG_enumeration_type", HasChildren);
+    OutputFieldString(Output, "DW_AT_name", Name);
+    OutputFieldUnsigned(Output, "DW_AT_encoding", Encoding);
+    OutputFieldUnsigned(Output, "DW_AT_byte_size", Size);
+    OutputFieldString(Output, "DW_AT_decl_file", SourceFileName(Context, File));
+    OutputFieldUnsigned(Output, "DW_AT_decl_line", Line);
+    OutputFieldUnsigned(Output, "DW_AT_decl_column", Column);
+    OutputFieldType(Context, Attributes, Type);
+    OutputFieldHex(Output, "DW_AT_sibling", Sibling);
+}
+
+void HandleDwarfEnumerator(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren)
+{
+    const char* Name = GetTagString(Attributes, DW_AT_name);
+    Dwarf_Unsigned Value = GetTagUnsignedData(Attributes, DW_AT_const_value);
+
+    struct Output* Output = Context->Output;
+    OutputTag(Output, "DW_TAG_enumerator");
+    OutputFieldString(Output, "DW_AT_name", Name);
+    OutputFieldUnsigned(Output, "DW_AT_const_value", Value);
+}
+
+void HandleDwarfBaseType(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren)
+{
+    char* Name = GetTagString(Attributes, DW_AT_name);
+    Dwarf_Off Type = GetTagRef(Attributes, DW_AT_type);
+    Dwarf_Unsigned Size = GetTagUnsignedData(Attributes, DW_AT_byte_size);
+
+    struct Output* Output = Context->Output;
+    OutputTag(Output, "DW_TAG_base_type");
+    OutputFieldString(Output, "DW_AT_name", Name);
+    OutputFieldType(Context, Attributes, Type);
+    OutputFieldUnsigned(Output, "DW_AT_byte_size", Size);
+}
+
+void HandleDwarfTypedef(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren)
+{
+    char* Name = GetTagString(Attributes, DW_AT_name);
+    Dwarf_Unsigned File = GetTagUnsignedData(Attributes, DW_AT_decl_file);
+    Dwarf_Unsigned Line = GetTagUnsignedData(Attributes, DW_AT_decl_line);
+    Dwarf_Unsigned Column = GetTagUnsignedData(Attributes, DW_AT_decl_column);
+    Dwarf_Off Type = GetTagRef(Attributes, DW_AT_type);
+
+    struct Output* Output = Context->Output;
+    OutputTag(Output, "DW_TAG_typedef");
+    OutputFieldString(Output, "DW_AT_name", Name);
+    OutputFieldString(Output, "DW_AT_decl_file", SourceFileName(Context, File));
+    OutputFieldUnsigned(Output, "DW_AT_decl_line", Line);
+    OutputFieldUnsigned(Output, "DW_AT_decl_column", Column);
+    OutputFieldType(Context, Attributes, Type);
+}
+
+void HandleDwarfArrayType(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren)
+{
+    Dwarf_Off Type = GetTagRef(Attributes, DW_AT_type);
+    Dwarf_Off Sibling = GetTagRef(Attributes, DW_AT_sibling);
+
+    struct Output* Output = Context->Output;
+    OutputTagWithChildren(Output, "DW_TAG_array_type", HasChildren);
+    OutputFieldType(Context, Attributes, Type);
+    OutputFieldUnsigned(Output, "DW_AT_sibling", Sibling);
+}
+
+void HandleDwarfSubrangeType(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren)
+{
+    Dwarf_Off Type = GetTagRef(Attributes, DW_AT_type);
+    Dwarf_Unsigned UpperBound = GetTagUnsignedData(Attributes, DW_AT_upper_bound);
+
+    struct Output* Output = Context->Output;
+    OutputTag(Output, "DW_TAG_subrange_type");
+    OutputFieldType(Context, Attributes, Type);
+    OutputFieldUnsigned(Output, "DW_AT_upper_bound", UpperBound);
+}
+
+void HandleDwarfPointerType(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren)
+{
+    Dwarf_Unsigned Size = GetTagUnsignedData(Attributes, DW_AT_byte_size);
+    Dwarf_Off Type = GetTagRef(Attributes, DW_AT_type);
+
+    struct Output* Output = Context->Output;
+    OutputTag(Output, "DW_TAG_pointer_type");
+    OutputFieldUnsigned(Output, "DW_AT_byte_size", Size);
+    OutputFieldType(Context, Attributes, Type);
+}
+
+void HandleDwarfSubroutineType(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren)
+{
+    Dwarf_Off Sibling = GetTagRef(Attributes, DW_AT_sibling);
+
+    struct Output* Output = Context->Output;
+    OutputTagWithChildren(Output, "DW_TAG_subroutine_type", HasChildren);
+    OutputFieldHex(Output, "DW_AT_sibling", Sibling);
+}
+
+void HandleDwarfStructureType(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren)
+{
+    char* Name = GetTagString(Attributes, DW_AT_name);
+    Dwarf_Unsigned Size = GetTagUnsignedData(Attributes, DW_AT_byte_size);
+    Dwarf_Unsigned File = GetTagUnsignedData(Attributes, DW_AT_decl_file);
+    Dwarf_Unsigned Line = GetTagUnsignedData(Attributes, DW_AT_decl_line);
+    Dwarf_Unsigned Column = GetTagUnsignedData(Attributes, DW_AT_decl_column);
+    Dwarf_Off Sibling = GetTagRef(Attributes, DW_AT_sibling);
+
+    struct Output* Output = Context->Output;
+    OutputTagWithChildren(Output, "DW_TAG_structure_type", HasChildren);
+    OutputFieldString(Output, "DW_AT_name", Name);
+    OutputFieldUnsigned(Output, "DW_AT_byte_size", Size);
+    OutputFieldString(Output, "DW_AT_decl_file", SourceFileName(Context, File));
+    OutputFieldUnsigned(Output, "DW_AT_decl_line", Line);
+    OutputFieldUnsigned(Output, "DW_AT_decl_column", Column);
+    OutputFieldUnsigned(Output, "DW_AT_sibling", Sibling);
+}
+
+void HandleDwarfMember(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren)
+{
+    char* Name = GetTagString(Attributes, DW_AT_name);
+    Dwarf_Unsigned File = GetTagUnsignedData(Attributes, DW_AT_decl_file);
+    Dwarf_Unsigned Line = GetTagUnsignedData(Attributes, DW_AT_decl_line);
+    Dwarf_Unsigned Column = GetTagUnsignedData(Attributes, DW_AT_decl_column);
+    Dwarf_Off Type = GetTagRef(Attributes, DW_AT_type);
+    Dwarf_Unsigned MemberLocation = GetTagUnsignedData(Attributes, DW_AT_data_member_location);
+
+    struct Output* Output = Context->Output;
+    OutputTag(Output, "DW_TAG_member");
+    OutputFieldString(Output, "DW_AT_name", Name);
+    OutputFieldString(Output, "DW_AT_decl_file", SourceFileName(Context, File));
+    OutputFieldUnsigned(Output, "DW_AT_decl_line", Line);
+    OutputFieldUnsigned(Output, "DW_AT_decl_column", Column);
+    OutputFieldType(Context, Attributes, Type);
+    OutputFieldUnsigned(Output, "DW_AT_data_member_location", MemberLocation);
+}
+
+void HandleDwarfLexicalBlock(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren)
+{
+    Dwarf_Addr LowPC = GetTagAddress(Attributes, DW_AT_low_pc);
+    Dwarf_Unsigned HighPC = GetTagUnsignedData(Attributes, DW_AT_high_pc);
+    Dwarf_Off Sibling = GetTagRef(Attributes, DW_AT_sibling);
+
+    struct Output* Output = Context->Output;
+    OutputTagWithChildren(Output, "DW_TAG_lexical_block", HasChildren);
+    OutputFieldHex(Output, "DW_AT_low_pc", LowPC);
+    OutputFieldUnsigned(Output, "DW_AT_high_pc", HighPC);
+    OutputFieldHex(Output, "DW_AT_sibling", Sibling);
+}
+
+void HandleDwarfFormalParameter(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren)
+{
+    char* Name = GetTagString(Attributes, DW_AT_name);
+    Dwarf_Unsigned File = GetTagUnsignedData(Attributes, DW_AT_decl_file);
+    Dwarf_Unsigned Line = GetTagUnsignedData(Attributes, DW_AT_decl_line);
+    Dwarf_Unsigned Column = GetTagUnsignedData(Attributes, DW_AT_decl_column);
+    Dwarf_Off Type = GetTagRef(Attributes, DW_AT_type);
+
+    struct Output* Output = Context->Output;
+    OutputTag(Output, "DW_TAG_formal_parameter");
+    OutputFieldString(Output, "DW_AT_name", Name);
+    OutputFieldString(Output, "DW_AT_decl_file", SourceFileName(Context, File));
+    OutputFieldUnsigned(Output, "DW_AT_decl_line", Line);
+    OutputFieldUnsigned(Output, "DW_AT_decl_column", Column);
+    OutputFieldType(Context, Attributes, Type);
+    OutputFieldLocation(Context, Die, Attributes, DW_AT_location, "DW_AT_location");
+}
+
+void HandleDwarfSubprogram(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren)
+{
+    Dwarf_Bool External = GetTagFlag(Attributes, DW_AT_external);
+    const char* Name = GetTagString(Attributes, DW_AT_name);
+    Dwarf_Unsigned Line = GetTagUnsignedData(Attributes, DW_AT_decl_line);
+    Dwarf_Unsigned File = GetTagUnsignedData(Attributes, DW_AT_decl_file);
+    Dwarf_Unsigned Column = GetTagUnsignedData(Attributes, DW_AT_decl_column);
+    const char* LinkageName = GetTagString(Attributes, DW_AT_linkage_name);
+    Dwarf_Off Type = GetTagRef(Attributes, DW_AT_type);
+    Dwarf_Addr LowPC = GetTagAddress(Attributes, DW_AT_low_pc);
+    Dwarf_Unsigned HighPC = GetTagUnsignedData(Attributes, DW_AT_high_pc);
+    Dwarf_Off Sibling = GetTagRef(Attributes, DW_AT_sibling);
+
+    struct Output* Output = Context->Output;
+    OutputTagWithChildren(Output, "DW_TAG_subprogram", HasChildren);
+    OutputFieldUnsigned(Output, "DW_AT_external", External);
+    OutputFieldString(Output, "DW_AT_name", Name);
+    OutputFieldString(Output, "DW_AT_decl_file", SourceFileName(Context, File));
+    OutputFieldUnsigned(Output, "DW_AT_decl_line", Line);
+    OutputFieldUnsigned(Output, "DW_AT_decl_column", Column);
+    OutputFieldString(Output, "DW_AT_linkage_name", LinkageName);
+    OutputFieldType(Context, Attributes, Type);
+    OutputFieldHex(Output, "DW_AT_low_pc", LowPC);
+    OutputFieldUnsigned(Output, "DW_AT_high_pc", HighPC);
+    OutputFieldLocation(Context, Die, Attributes, DW_AT_frame_base, "DW_AT_frame_base");
+    OutputFieldHex(Output, "DW_AT_sibling", Sibling);
+}
+
+void HandleDwarfVariable(struct DwarfContext* Context, Dwarf_Die Die, struct DieAttributes* Attributes, Dwarf_Bool HasChildren)
+{
+    const char* Name = GetTagString(Attributes, DW_AT_name);
+    Dwarf_Unsigned Line = GetTagUnsignedData(Attributes, DW_AT_decl_line);
+    Dwarf_Unsigned File = GetTagUnsignedData(Attributes, DW_AT_decl_file);
+    Dwarf_Unsigned Column = GetTagUnsignedData(Attributes, DW_AT_decl_column);
+    Dwarf_Off Type = GetTagRef(Attributes, DW_AT_type);
+    Dwarf_Bool External = GetTagFlag(Attributes, DW_AT_external);
+
+    struct Output* Output = Context->Output;
+    OutputTag(Output, "DW_TAG_variable");
+    OutputFieldString(Output, "DW_AT_name", Name);
+    OutputFieldString(Output, "DW_AT_decl_file", SourceFileName(Context, File));
+    OutputFieldUnsigned(Output, "DW_AT_decl_line", Line);
+    OutputFieldUnsigned(Output, "DW_AT_decl_column", Column);
+    OutputFieldUnsigned(Output, "DW_AT_external", External);
+    OutputFieldType(Context, Attributes, Type);
+    OutputFieldLocation(Context, Die, Attributes, DW_AT_location, "DW_AT_location");
+}
+
+void HandleDwarfCompilationUnit(struct DwarfContext* Context, Dwarf_Die CUDie)
+{
+    struct DieAttributes Attributes;
+    DieAttributesLoad(Context, CUDie, &Attributes);
+
+    char* Producer = GetTagString(&Attributes, DW_AT_producer);
+    Dwarf_Unsigned Language = GetTagUnsignedData(&Attributes, DW_AT_language);
+    char* Name = GetTagString(&Attributes, DW_AT_name);
+    char* Directory = GetTagString(&Attributes, DW_AT_comp_dir);
+    Dwarf_Off MacroOffset = GetTagRef(&Attributes, DW_AT_macros);
+
+    struct Output* Output = Context->Output;
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputRecordBegin(Output, "cu");
+        OutputFieldUnsigned(Output, "offset", Context->UnitOffset);
+        OutputFieldString(Output, "producer", Producer);
+        OutputFieldUnsigned(Output, "language", Language);
+        OutputFieldString(Output, "comp_dir", Directory);
+        OutputFieldString(Output, "name", Name);
+        OutputFieldUnsigned(Output, "macro_offset", MacroOffset);
+        OutputRecordEnd(Output);
+        DieAttributesFree(Context, &Attributes);
+        return;
+    }
+
+    OutputLiteral(Output, "Producer: ");
+    OutputString(Output, Producer);
+    OutputLiteral(Output, "\nLanguage: ");
+    OutputUnsigned(Output, Language);
+    OutputLiteral(Output, "\nFile: ");
+    OutputString(Output, Directory);
+    OutputLiteral(Output, "/");
+    OutputString(Output, Name);
+    OutputLiteral(Output, "\nMacro Offset and Information: 0x");
+    OutputHex(Output, MacroOffset, 8);
+    OutputLiteral(Output, "\n");
+
+    DieAttributesFree(Context, &Attributes);
+}
+
+// "\t[INDEX] 0xOP NAME", the common start of every macro operation line
+// in NDJSON the record is left open for the operands
+void OutputMacroOperation(struct DwarfContext* Context, int Index, Dwarf_Half MacroOperator, const char* TagName)
+{
+    struct Output* Output = Context->Output;
+
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputRecordBegin(Output, "macro");
+        OutputFieldUnsigned(Output, "unit", Context->MacroUnitOffset);
+        OutputFieldUnsigned(Output, "index", Index);
+        OutputFieldUnsigned(Output, "op", MacroOperator);
+        OutputFieldString(Output, "name", TagName);
+        return;
+    }
+
+    OutputLiteral(Output, "\t[");
+    OutputUnsigned(Output, Index);
+    OutputLiteral(Output, "] 0x");
+    OutputHex(Output, MacroOperator, 2);
+    OutputLiteral(Output, " ");
+    OutputString(Output, TagName);
+}
+
+void OutputMacroHeader(struct DwarfContext* Context, Dwarf_Unsigned Offset, Dwarf_Unsigned Version, Dwarf_Unsigned MacroOpsCount, Dwarf_Unsigned MacroOpsDataLength)
+{
+    struct Output* Output = Context->Output;
+
+    Context->MacroUnitOffset = Offset;
+
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputRecordBegin(Output, "macro_unit");
+        OutputFieldUnsigned(Output, "offset", Offset);
+        OutputFieldUnsigned(Output, "version", Version);
+        OutputFieldUnsigned(Output, "count", MacroOpsCount);
+        OutputFieldUnsigned(Output, "length", MacroOpsDataLength);
+        OutputRecordEnd(Output);
+        return;
+    }
+
+    OutputLiteral(Output, "Macro data from CU-DIE at .debug_info offset 0x");
+    OutputHex(Output, Offset, 8);
+    OutputLiteral(Output, ":\nMacro Version: ");
+    OutputUnsigned(Output, Version);
+    OutputLiteral(Output, "\nMacroInformationEntries count: ");
+    OutputUnsigned(Output, MacroOpsCount);
+    OutputLiteral(Output, ", bytes length: ");
+    OutputUnsigned(Output, MacroOpsDataLength);
+    OutputLiteral(Output, "\n");
+}
+
+void HandleMacroDefUndef(struct DwarfContext* Context, Dwarf_Macro_Context MacroContext, Dwarf_Half MacroOperator, int Index, const char* TagName)
+{
+    Dwarf_Unsigned MLine = 0;
+    Dwarf_Unsigned MIndex = 0;
+    Dwarf_Unsigned MOffset = 0;
+    Dwarf_Half MFormsCount = 0;
+    const char* MacroString = 0;
+
+    int Result = dwarf_get_macro_defundef(MacroContext, Index, &MLine, &MIndex, &MOffset, &MFormsCount, &MacroString, 0);
+    if (Result != DW_DLV_OK) {
+        exit(1);
+    }
+
+    OutputMacroOperation(Context, Index, MacroOperator, TagName);
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputFieldUnsigned(Context->Output, "line", MLine);
+        OutputFieldString(Context->Output, "string", MacroString);
+        OutputRecordEnd(Context->Output);
+        return;
+    }
+
+    OutputLiteral(Context->Output, " line:");
+    OutputUnsigned(Context->Output, MLine);
+    OutputLiteral(Context->Output, " ");
+    OutputString(Context->Output, MacroString);
+    OutputLiteral(Context->Output, "\n");
+}
+
+void HandleMacroStartFile(struct DwarfContext* Context, Dwarf_Macro_Context MacroContext, Dwarf_Half MacroOperator, int Index, const char* TagName)
+{
+    Dwarf_Unsigned MLine = 0;
+    Dwarf_Unsigned MIndex = 0;
+    const char* MacroString = 0;
+
+    int Result = dwarf_get_macro_startend_file(MacroContext, Index, &MLine, &MIndex, &MacroString, 0);
+    if (Result != DW_DLV_OK) {
+        exit(1);
+    }
+
+    OutputMacroOperation(Context, Index, MacroOperator, TagName);
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputFieldUnsigned(Context->Output, "line", MLine);
+        OutputFieldUnsigned(Context->Output, "file", MIndex);
+        OutputFieldString(Context->Output, "string", MacroString);
+        OutputRecordEnd(Context->Output);
+        return;
+    }
+
+    OutputLiteral(Context->Output, " line:");
+    OutputUnsigned(Context->Output, MLine);
+    OutputLiteral(Context->Output, " file number: ");
+    OutputUnsigned(Context->Output, MIndex);
+    OutputLiteral(Context->Output, " ");
+    OutputString(Context->Output, MacroString);
+    OutputLiteral(Context->Output, "\n");
+}
+
+void HandleMacroEndFile(struct DwarfContext* Context, Dwarf_Macro_Context MacroContext, Dwarf_Half MacroOperator, int Index, const char* TagName)
+{
+    Dwarf_Unsigned MLine = 0;
+    Dwarf_Unsigned MIndex = 0;
+    const char* MacroString = 0;
+
+    int Result = dwarf_get_macro_startend_file(MacroContext, Index, &MLine, &MIndex, &MacroString, 0);
+    if (Result != DW_DLV_OK) {
+        exit(1);
+    }
+
+    OutputMacroOperation(Context, Index, MacroOperator, TagName);
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputRecordEnd(Context->Output);
+        return;
+    }
+
+    OutputLiteral(Context->Output, "\n");
+}
+
+void HandleMacroImport(struct DwarfContext* Context, Dwarf_Macro_Context MacroContext, Dwarf_Half MacroOperator, int Index, const char* TagName)
+{
+    Dwarf_Unsigned MOffset = 0;
+
+    int Result = dwarf_get_macro_import(MacroContext, Index, &MOffset, 0);
+    if (Result != DW_DLV_OK) {
+        exit(1);
+    }
+
+    if (MacroCacheReference(Context->MacroCache, MOffset)) {
+        ArrayInsert(&Context->ImportedMacros, MOffset);
+    }
+    ArrayInsert(Context->MacroUnit != 0 ? &Context->MacroUnit->Imports : &Context->MacroImports, MOffset);
+
+    OutputMacroOperation(Context, Index, MacroOperator, TagName);
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputFieldUnsigned(Context->Output, "offset", MOffset);
+        OutputRecordEnd(Context->Output);
+        return;
+    }
+
+    OutputLiteral(Context->Output, " offset 0x");
+    OutputHex(Context->Output, MOffset, 8);
+    OutputLiteral(Context->Output, "\n");
+}
+
+void HandleDwarfMacroOperations(struct DwarfContext* Context, Dwarf_Macro_Context MacroContext, Dwarf_Unsigned MacroOpsCount)
+{
+    int Result = 0;
+
+    for (int Index = 0; Index < MacroOpsCount; Index++) {
+        Dwarf_Unsigned SectionOffset = 0;
+        Dwarf_Half MacroOperator = 0;
+        Dwarf_Half FormsCount = 0;
+        const Dwarf_Small* FormCodeArray = 0;
+        const char* MacroName = 0;
+
+        Result = dwarf_get_macro_op(MacroContext, Index, &SectionOffset, &MacroOperator, &FormsCount, &FormCodeArray, 0);
+        if (Result != DW_DLV_OK) {
+            continue;
+        }
+
+        dwarf_get_MACRO_name(MacroOperator, &MacroName);
+
+        switch (MacroOperator) {
+            case 0:
+                break;
+            case DW_MACRO_define:
+            case DW_MACRO_undef:
+            case DW_MACRO_define_strp:
+            case DW_MACRO_undef_strp:
+            case DW_MACRO_define_strx:
+            case DW_MACRO_undef_strx:
+            case DW_MACRO_define_sup:
+            case DW_MACRO_undef_sup:
+                HandleMacroDefUndef(Context, MacroContext, MacroOperator, Index, MacroName);
+                break;
+            case DW_MACRO_start_file:
+                HandleMacroStartFile(Context, MacroContext, MacroOperator, Index, MacroName);
+                break;
+            case DW_MACRO_end_file:
+                HandleMacroEndFile(Context, MacroContext, MacroOperator, Index, MacroName);
+                break;
+            case DW_MACRO_import:
+                HandleMacroImport(Context, MacroContext, MacroOperator, Index, MacroName);
+                break;
+        }
+    }
+}
+
+void HandleDwarfCompilationUnitMacros(struct DwarfContext* Context, Dwarf_Die CUDie)
+{
+    Dwarf_Unsigned Version = 0;
+    Dwarf_Macro_Context MacroContext = 0;
+    Dwarf_Unsigned MacroUnitOffset = 0;
+    Dwarf_Unsigned MacroOpsCount = 0;
+    Dwarf_Unsigned MacroOpsDataLength = 0;
+
+    int Result = dwarf_get_macro_context(CUDie, &Version, &MacroContext, &MacroUnitOffset, &MacroOpsCount, &MacroOpsDataLength, 0);
+    if (Result == DW_DLV_NO_ENTRY) {
+        return;
+    }
+
+    if (Result != DW_DLV_OK) {
+        fprintf(stderr, "dwarf_get_macro_context() error\n");
+        exit(1);
+    }
+
+    OutputMacroHeader(Context, MacroUnitOffset, Version, MacroOpsCount, MacroOpsDataLength);
+
+    HandleDwarfMacroOperations(Context, MacroContext, MacroOpsCount);
+
+    dwarf_dealloc_macro_context(MacroContext);
+}
+
+// decoded line programs, one packed row per line table entry
+#define LINE_IS_STMT 0x1
+#define LINE_BASIC_BLOCK 0x2
+#define LINE_END_SEQUENCE 0x4
+#define LINE_PROLOGUE_END 0x8
+#define LINE_EPILOGUE_BEGIN 0x10
+
+struct LineRow {
+    Dwarf_Addr Address;
+    uint32_t File; // offset into the table's string table
+    uint32_t Line;
+    uint16_t Column;
+    uint16_t Flags;
+    uint32_t Order; // position in the line programs, keeps the address sort stable
+};
+
+struct LineTable {
+    struct LineRow* Rows;
+    size_t Count;
+    size_t Size;
+    uint32_t* ByLine; // rows without LINE_END_SEQUENCE, sorted by file, line and address
+    size_t ByLineCount;
+    struct StringTable Strings;
+};
+
+void LineTableInit(struct LineTable* Table)
+{
+    memset(Table, 0, sizeof(*Table));
+
+    Table->Size = 4096;
+    Table->Rows = (struct LineRow*)malloc(Table->Size * sizeof(struct LineRow));
+    StringTableInit(&Table->Strings);
+}
+
+void LineTableFree(struct LineTable* Table)
+{
+    free(Table->Rows);
+    free(Table->ByLine);
+    StringTableFree(&Table->Strings);
+    memset(Table, 0, sizeof(*Table));
+}
+
+// appends the rows of the CU's line program, returns the DWARF version of the table or 0
+Dwarf_Unsigned LineTableLoad(struct DwarfContext* Context, struct LineTable* Table, Dwarf_Die CUDie)
+{
+    Dwarf_Unsigned Version = 0;
+    Dwarf_Small TableCount = 0;
+    Dwarf_Line_Context LineContext = 0;
+    Dwarf_Line* Lines = 0;
+    Dwarf_Signed LineCount = 0;
+
+    if (dwarf_srclines_b(CUDie, &Version, &TableCount, &LineContext, 0) != DW_DLV_OK) {
+        return 0;
+    }
+
+    if (dwarf_srclines_from_linecontext(LineContext, &Lines, &LineCount, 0) != DW_DLV_OK) {
+        dwarf_srclines_dealloc_b(LineContext);
+        return 0;
+    }
+
+    // file names once per CU
+    struct SourceFiles* SourceFiles = &Context->SourceFiles;
+    uint32_t* Files = (uint32_t*)calloc(SourceFiles->Count + 1, sizeof(uint32_t));
+    for (Dwarf_Signed Index = 0; Index < SourceFiles->Count; Index++) {
+        Files[Index] = (uint32_t)StringTableIntern(&Table->Strings, SourceFiles->Files[Index]);
+    }
+
+    if (Table->Size - Table->Count < (size_t)LineCount) {
+        while (Table->Size - Table->Count < (size_t)LineCount) {
+            Table->Size *= 2;
+        }
+        Table->Rows = (struct LineRow*)realloc(Table->Rows, Table->Size * sizeof(struct LineRow));
+    }
+
+    for (Dwarf_Signed Index = 0; Index < LineCount; Index++) {
+        struct LineRow* Row = &Table->Rows[Table->Count];
+        Dwarf_Unsigned File = 0;
+        Dwarf_Unsigned Line = 0;
+        Dwarf_Unsigned Column = 0;
+        Dwarf_Bool Flag = 0;
+        Dwarf_Bool PrologueEnd = 0;
+        Dwarf_Bool EpilogueBegin = 0;
+        Dwarf_Unsigned Isa = 0;
+        Dwarf_Unsigned Discriminator = 0;
+
+        memset(Row, 0, sizeof(*Row));
+        dwarf_lineaddr(Lines[Index], &Row->Address, 0);
+        dwarf_lineno(Lines[Index], &Line, 0);
+        dwarf_lineoff_b(Lines[Index], &Column, 0);
+        dwarf_line_srcfileno(Lines[Index], &File, 0);
+
+        Dwarf_Signed Slot = SourceFileSlot(SourceFiles->Base, SourceFiles->Count, File);
+        if (Slot >= 0) {
+            Row->File = Files[Slot];
+        }
+
+        Row->Line = (uint32_t)Line;
+        Row->Column = Column > UINT16_MAX ? UINT16_MAX : (uint16_t)Column;
+        Row->Order = (uint32_t)Table->Count;
+
+        if (dwarf_linebeginstatement(Lines[Index], &Flag, 0) == DW_DLV_OK && Flag) {
+            Row->Flags |= LINE_IS_STMT;
+        }
+        if (dwarf_lineblock(Lines[Index], &Flag, 0) == DW_DLV_OK && Flag) {
+            Row->Flags |= LINE_BASIC_BLOCK;
+        }
+        if (dwarf_lineendsequence(Lines[Index], &Flag, 0) == DW_DLV_OK && Flag) {
+            Row->Flags |= LINE_END_SEQUENCE;
+        }
+        if (dwarf_prologue_end_etc(Lines[Index], &PrologueEnd, &EpilogueBegin, &Isa, &Discriminator, 0) == DW_DLV_OK) {
+            Row->Flags |= (PrologueEnd ? LINE_PROLOGUE_END : 0) | (EpilogueBegin ? LINE_EPILOGUE_BEGIN : 0);
+        }
+
+        Table->Count++;
+    }
+
+    free(Files);
+    dwarf_srclines_dealloc_b(LineContext);
+
+    __atomic_fetch_add(&GlobalTimingStats.LineRows, LineCount, __ATOMIC_RELAXED);
+
+    return Version;
+}
+
+// sequence ends sort before rows starting at the same address
+int LineRowCompareAddress(const void* A, const void* B)
+{
+    const struct LineRow* RowA = (const struct LineRow*)A;
+    const struct LineRow* RowB = (const struct LineRow*)B;
+
+    if (RowA->Address != RowB->Address) {
+        return RowA->Address < RowB->Address ? -1 : 1;
+    }
+
+    int EndA = (RowA->Flags & LINE_END_SEQUENCE) != 0;
+    int EndB = (RowB->Flags & LINE_END_SEQUENCE) != 0;
+    if (EndA != EndB) {
+        return EndB - EndA;
+    }
+
+    return RowA->Order < RowB->Order ? -1 : RowA->Order > RowB->Order;
+}
+
+static struct LineRow* LineRowSortBase; // qsort() has no context argument
+
+int LineRowCompareLine(const void* A, const void* B)
+{
+    const struct LineRow* RowA = &LineRowSortBase[*(const uint32_t*)A];
+    const struct LineRow* RowB = &LineRowSortBase[*(const uint32_t*)B];
+
+    if (RowA->File != RowB->File) {
+        return RowA->File < RowB->File ? -1 : 1;
+    }
+
+    if (RowA->Line != RowB->Line) {
+        return RowA->Line < RowB->Line ? -1 : 1;
+    }
+
+    return RowA->Address < RowB->Address ? -1 : RowA->Address > RowB->Address;
+}
+
+// sorts the rows by address and builds the line index, only for the query modes
+void LineTableFinish(struct LineTable* Table)
+{
+    qsort(Table->Rows, Table->Count, sizeof(struct LineRow), LineRowCompareAddress);
+
+    Table->ByLine = (uint32_t*)malloc((Table->Count + 1) * sizeof(uint32_t));
+    Table->ByLineCount = 0;
+    for (size_t Index = 0; Index < Table->Count; Index++) {
+        if (!(Table->Rows[Index].Flags & LINE_END_SEQUENCE)) {
+            Table->ByLine[Table->ByLineCount++] = (uint32_t)Index;
+        }
+    }
+
+    LineRowSortBase = Table->Rows;
+    qsort(Table->ByLine, Table->ByLineCount, sizeof(uint32_t), LineRowCompareLine);
+    LineRowSortBase = 0;
+}
+
+// the row covering Address, 0 when it falls outside every sequence
+struct LineRow* LineTableFindAddress(struct LineTable* Table, Dwarf_Addr Address)
+{
+    size_t Low = 0;
+    size_t High = Table->Count;
+
+    // first row past Address
+    while (Low < High) {
+        size_t Middle = Low + (High - Low) / 2;
+        if (Table->Rows[Middle].Address <= Address) {
+            Low = Middle + 1;
+        } else {
+            High = Middle;
+        }
+    }
+
+    if (Low == 0 || (Table->Rows[Low - 1].Flags & LINE_END_SEQUENCE)) {
+        return 0;
+    }
+
+    return &Table->Rows[Low - 1];
+}
+
+// [*First, return value) are the ByLine entries for File:Line
+size_t LineTableFindLine(struct LineTable* Table, uint32_t File, uint32_t Line, size_t* First)
+{
+    size_t Low = 0;
+    size_t High = Table->ByLineCount;
+
+    while (Low < High) {
+        size_t Middle = Low + (High - Low) / 2;
+        struct LineRow* Row = &Table->Rows[Table->ByLine[Middle]];
+        if (Row->File < File || (Row->File == File && Row->Line < Line)) {
+            Low = Middle + 1;
+        } else {
+            High = Middle;
+        }
+    }
+
+    *First = Low;
+    while (Low < Table->ByLineCount) {
+        struct LineRow* Row = &Table->Rows[Table->ByLine[Low]];
+        if (Row->File != File || Row->Line != Line) {
+            break;
+        }
+        Low++;
+    }
+
+    return Low;
+}
+
+void OutputLineFlags(struct Output* Output, uint16_t Flags)
+{
+    if (Flags & LINE_IS_STMT) {
+        OutputLiteral(Output, " is_stmt");
+    }
+    if (Flags & LINE_BASIC_BLOCK) {
+        OutputLiteral(Output, " basic_block");
+    }
+    if (Flags & LINE_END_SEQUENCE) {
+        OutputLiteral(Output, " end_sequence");
+    }
+    if (Flags & LINE_PROLOGUE_END) {
+        OutputLiteral(Output, " prologue_end");
+    }
+    if (Flags & LINE_EPILOGUE_BEGIN) {
+        OutputLiteral(Output, " epilogue_begin");
+    }
+}
+
+// "0xADDRESS FILE:LINE:COLUMN flags", or one "line" record
+void OutputLineRow(struct Output* Output, struct LineTable* Table, struct LineRow* Row, Dwarf_Off UnitOffset)
+{
+    const char* File = Row->File == 0 ? 0 : Table->Strings.Strings + Row->File;
+
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputRecordBegin(Output, "line");
+        OutputFieldUnsigned(Output, "cu", UnitOffset);
+        OutputFieldHex(Output, "address", Row->Address);
+        OutputFieldString(Output, "file", File);
+        OutputFieldUnsigned(Output, "line", Row->Line);
+        OutputFieldUnsigned(Output, "column", Row->Column);
+        OutputFieldUnsigned(Output, "flags", Row->Flags);
+        OutputRecordEnd(Output);
+        return;
+    }
+
+    OutputLiteral(Output, "0x");
+    OutputHex(Output, Row->Address, 16);
+    OutputLiteral(Output, " ");
+    OutputString(Output, File == 0 ? "??" : File);
+    OutputLiteral(Output, ":");
+    OutputUnsigned(Output, Row->Line);
+    OutputLiteral(Output, ":");
+    OutputUnsigned(Output, Row->Column);
+    OutputLineFlags(Output, Row->Flags);
+    OutputLiteral(Output, "\n");
+}
+
+void HandleDwarfSourceLines(struct DwarfContext* Context, Dwarf_Die CUDie)
+{
+    struct LineTable Table;
+    const char* SectionName = 0;
+
+    if (dwarf_get_line_section_name_from_die(CUDie, &SectionName, &Context->Error) != DW_DLV_OK) {
+        return;
+    }
+
+    Dwarf_Unsigned Start = TimingNow();
+
+    LineTableInit(&Table);
+    Dwarf_Unsigned Version = LineTableLoad(Context, &Table, CUDie);
+
+    __atomic_fetch_add(&GlobalTimingStats.LineNanoseconds, TimingNow() - Start, __ATOMIC_RELAXED);
+
+    if (Version != 0 && GlobalOptions.Format == FORMAT_TEXT) {
+        OutputLiteral(Context->Output, "Line table from ");
+        OutputString(Context->Output, SectionName);
+        OutputLiteral(Context->Output, ", version ");
+        OutputUnsigned(Context->Output, Version);
+        OutputLiteral(Context->Output, ", ");
+        OutputUnsigned(Context->Output, Table.Count);
+        OutputLiteral(Context->Output, " rows:\n");
+    }
+
+    for (size_t Index = 0; Index < Table.Count; Index++) {
+        OutputSeparator(Context->Output, "\t");
+        OutputLineRow(Context->Output, &Table, &Table.Rows[Index], Context->UnitOffset);
+    }
+
+    LineTableFree(&Table);
+}
+
+// raw bytes of a section, served from libelf's mapping of the file
+const char* ElfGetSectionData(Elf* ElfHandle, const char* Name, size_t* Size)
+{
+    size_t StringTableIndex = 0;
+    Elf_Scn* Section = 0;
+
+    *Size = 0;
+
+    if (ElfHandle == 0 || elf_getshdrstrndx(ElfHandle, &StringTableIndex) != 0) {
+        return 0;
+    }
+
+    while ((Section = elf_nextscn(ElfHandle, Section)) != 0) {
+        GElf_Shdr Header;
+        if (gelf_getshdr(Section, &Header) == 0) {
+            continue;
+        }
+
+        const char* SectionName = elf_strptr(ElfHandle, StringTableIndex, Header.sh_name);
+        if (SectionName == 0 || strcmp(SectionName, Name) != 0) {
+            continue;
+        }
+
+        if ((Header.sh_flags & SHF_COMPRESSED) && elf_compress(Section, 0, 0) < 0) {
+            return 0;
+        }
+
+        Elf_Data* Data = elf_getdata(Section, 0);
+        if (Data == 0 || Data->d_buf == 0) {
+            return 0;
+        }
+
+        *Size = Data->d_size;
+        return (const char*)Data->d_buf;
+    }
+
+    return 0;
+}
+
+void HandleDwarfDebugStr(struct DwarfContext* Context)
+{
+    const char* SectionName = 0;
+    size_t SectionSize = 0;
+
+    int Result = dwarf_get_string_section_name(Context->Debug, &SectionName, &Context->Error);
+    if (Result == DW_DLV_NO_ENTRY) {
+        return;
+    }
+
+    if (Result != DW_DLV_OK) {
+        exit(1);
+    }
+
+    if (GlobalOptions.Format == FORMAT_TEXT) {
+        OutputLiteral(Context->Output, "String Section Name: ");
+        OutputString(Context->Output, SectionName);
+        OutputLiteral(Context->Output, "\n");
+    }
+
+    const char* Section = ElfGetSectionData(Context->Elf, SectionName, &SectionSize);
+    if (Section == 0) {
+        return;
+    }
+
+    // memchr is vectorized in glibc, no need to go through dwarf_get_str() for every string
+    size_t StringOffset = 0;
+    while (StringOffset < SectionSize) {
+        const char* End = (const char*)memchr(Section + StringOffset, 0, SectionSize - StringOffset);
+        if (End == 0) {
+            break;
+        }
+
+        size_t StringLength = End - (Section + StringOffset);
+        if (GlobalOptions.Format == FORMAT_NDJSON) {
+            OutputRecordBegin(Context->Output, "string");
+            OutputFieldUnsigned(Context->Output, "offset", StringOffset);
+            OutputFieldUnsigned(Context->Output, "length", StringLength);
+            OutputFieldString(Context->Output, "value", Section + StringOffset);
+            OutputRecordEnd(Context->Output);
+        } else {
+            OutputLiteral(Context->Output, "name at offset 0x");
+            OutputHex(Context->Output, StringOffset, 8);
+            OutputLiteral(Context->Output, ", length ");
+            OutputUnsigned(Context->Output, StringLength);
+            OutputLiteral(Context->Output, " is '");
+            OutputBytes(Context->Output, Section + StringOffset, StringLength);
+            OutputLiteral(Context->Output, "'\n");
+        }
+
+        StringOffset += StringLength + 1;
+    }
+
+    OutputSeparator(Context->Output, "\n");
+}
+
+void HandleDwarfCompilationUnitMacrosByOffset(struct DwarfContext* Context, Dwarf_Die CUDie, Dwarf_Unsigned Offset)
+{
+    Dwarf_Unsigned Version = 0;
+    Dwarf_Macro_Context MacroContext = 0;
+    Dwarf_Unsigned MacroOpsCount = 0;
+    Dwarf_Unsigned MacroOpsDataLength = 0;
+
+    int Result = dwarf_get_macro_context_by_offset(CUDie, Offset, &Version, &MacroContext, &MacroOpsCount, &MacroOpsDataLength, 0);
+    if (Result != DW_DLV_OK) {
+        fprintf(stderr, "dwarf_get_macro_context() error\n");
+        exit(1);
+    }
+
+    OutputMacroHeader(Context, Offset, Version, MacroOpsCount, MacroOpsDataLength);
+
+    HandleDwarfMacroOperations(Context, MacroContext, MacroOpsCount);
+
+    dwarf_dealloc_macro_context(MacroContext);
+}
+
+// parses the units first imported by this CU into the cache, parsing one can import more; text
+// prints them all at the end, ndjson with the first CU importing them, see MacroCacheEmit()
+void HandleImportedMacroUnits(struct DwarfContext* Context, Dwarf_Die CUDie)
+{
+    struct Output* Output = Context->Output;
+
+    for (size_t Index = 0; Index < Context->ImportedMacros.used; Index++) {
+        struct MacroUnit* Unit = MacroCacheFind(Context->MacroCache, Context->ImportedMacros.array[Index]);
+        struct Output UnitOutput;
+
+        OutputInit(&UnitOutput, -1);
+        Context->Output = &UnitOutput;
+        Context->MacroUnit = Unit;
+        HandleDwarfCompilationUnitMacrosByOffset(Context, CUDie, Unit->Offset);
+
+        MacroCacheParsed(Context->MacroCache, Unit, UnitOutput.Buffer, UnitOutput.Used);
+    }
+
+    Context->Output = Output;
+    Context->MacroUnit = 0;
+    Context->ImportedMacros.used = 0;
+}
+
+void DwarfPrintCompilationUnit(struct DwarfContext* Context, Dwarf_Die CUDie)
+{
+    Dwarf_Unsigned Phase = StatsBegin(Context);
+
+    dwarf_dieoffset(CUDie, &Context->UnitOffset, 0);
+
+    if (Context->Stats != 0) {
+        Context->Stats->Units++;
+    }
+
+    // a filtered dump is only the matching DIEs
+    if (GlobalFilter.Active) {
+        DwarfLoadSourceFiles(Context, CUDie);
+        StatsEnd(Context, PHASE_SOURCE_FILES, Phase);
+
+        Dwarf_Unsigned Start = TimingNow();
+        DwarfWalkCompilationUnit(Context, CUDie);
+        __atomic_fetch_add(&GlobalTimingStats.WalkNanoseconds, TimingNow() - Start, __ATOMIC_RELAXED);
+        StatsEnd(Context, PHASE_WALK, Start);
+        return;
+    }
+
+    GetAllSourceFiles(Context, CUDie);
+    OutputSeparator(Context->Output, "\n\n");
+    StatsEnd(Context, PHASE_SOURCE_FILES, Phase);
+
+    Phase = StatsBegin(Context);
+    HandleDwarfCompilationUnit(Context, CUDie);
+    OutputSeparator(Context->Output, "\n\n");
+    StatsEnd(Context, PHASE_UNIT_HEADER, Phase);
+
+    Phase = StatsBegin(Context);
+    HandleDwarfCompilationUnitMacros(Context, CUDie);
+    OutputSeparator(Context->Output, "\n");
+    StatsEnd(Context, PHASE_MACROS, Phase);
+
+    Phase = StatsBegin(Context);
+    HandleImportedMacroUnits(Context, CUDie);
+    StatsEnd(Context, PHASE_MACRO_IMPORTS, Phase);
+
+    OutputSeparator(Context->Output, "\n");
+
+    if (GlobalOptions.PrintLines) {
+        Phase = StatsBegin(Context);
+        HandleDwarfSourceLines(Context, CUDie);
+        OutputSeparator(Context->Output, "\n");
+        StatsEnd(Context, PHASE_LINES, Phase);
+    }
+
+    Dwarf_Unsigned Start = TimingNow();
+    DwarfWalkCompilationUnit(Context, CUDie);
+    __atomic_fetch_add(&GlobalTimingStats.WalkNanoseconds, TimingNow() - Start, __ATOMIC_RELAXED);
+    StatsEnd(Context, PHASE_WALK, Start);
+}
+
+// CU DIE offsets, in .debug_info order
+void DwarfEnumerateCompilationUnits(struct DwarfContext* Context, struct Array* Offsets)
+{
+    while (dwarf_next_cu_header_c(Context->Debug, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0) == DW_DLV_OK) {
+        Dwarf_Die CUDie = 0;
+        Dwarf_Off Offset = 0;
+
+        int Result = dwarf_siblingof_b(Context->Debug, 0, 1, &CUDie, &Context->Error);
+        if (Result != DW_DLV_OK) {
+            DwarfContextFail(Context, "dwarf_siblingof()");
+            return;
+        }
+
+        if (dwarf_dieoffset(CUDie, &Offset, &Context->Error) != DW_DLV_OK) {
+            DwarfContextFail(Context, "dwarf_dieoffset()");
+            dwarf_dealloc(Context->Debug, CUDie, DW_DLA_DIE);
+            return;
+        }
+
+        ArrayInsert(Offsets, Offset);
+        dwarf_dealloc(Context->Debug, CUDie, DW_DLA_DIE);
+    }
+}
+
+// memory stuff
+struct MemoryStats {
+    int Recycles;
+};
+
+static struct MemoryStats GlobalMemoryStats;
+
+size_t MemoryCurrentRSS()
+{
+    long Pages = 0;
+
+    FILE* Statm = fopen("/proc/self/statm", "r");
+    if (Statm == 0) {
+        return 0;
+    }
+
+    if (fscanf(Statm, "%*s %ld", &Pages) != 1) {
+        Pages = 0;
+    }
+
+    fclose(Statm);
+
+    return (size_t)Pages * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+// NT_GNU_BUILD_ID as hex, 0 when the file has none
+int ElfBuildId(Elf* ElfHandle, char* Key, size_t Size)
+{
+    Elf_Scn* Section = 0;
+
+    while ((Section = elf_nextscn(ElfHandle, Section)) != 0) {
+        GElf_Shdr Header;
+        if (gelf_getshdr(Section, &Header) == 0 || Header.sh_type != SHT_NOTE) {
+            continue;
+        }
+
+        Elf_Data* Data = elf_getdata(Section, 0);
+        if (Data == 0) {
+            continue;
+        }
+
+        GElf_Nhdr Note;
+        size_t NameOffset = 0;
+        size_t DescriptorOffset = 0;
+        size_t Offset = 0;
+
+        while ((Offset = gelf_getnote(Data, Offset, &Note, &NameOffset, &DescriptorOffset)) > 0) {
+            const char* Name = (const char*)Data->d_buf + NameOffset;
+            if (Note.n_type != NT_GNU_BUILD_ID || Note.n_namesz != 4 || memcmp(Name, "GNU", 4) != 0) {
+                continue;
+            }
+
+            const unsigned char* Descriptor = (const unsigned char*)Data->d_buf + DescriptorOffset;
+            size_t Length = 0;
+            for (size_t Index = 0; Index < Note.n_descsz && Length + 2 < Size; Index++) {
+                Key[Length++] = "0123456789abcdef"[Descriptor[Index] >> 4];
+                Key[Length++] = "0123456789abcdef"[Descriptor[Index] & 0xf];
+            }
+            Key[Length] = 0;
+
+            return Length > 0;
+        }
+    }
+
+    return 0;
+}
+
+// separate debug files: a stripped binary points at its DWARF through its build-id, looked up
+// under --debug-dir, or through the file name in .gnu_debuglink
+#define DEBUG_DIRECTORY "/usr/lib/debug"
+
+// 1 when Path is an ELF file with a .debug_info, or a split .debug_info.dwo, of its own
+int DebugFileHasDwarf(const char* Path, char* BuildId, size_t BuildIdSize, char* Link, size_t LinkSize)
+{
+    size_t StringTableIndex = 0;
+    Elf_Scn* Section = 0;
+    int HasDwarf = 0;
+
+    int FileDescriptor = open(Path, O_RDONLY);
+    if (FileDescriptor < 0) {
+        return -1;
+    }
+
+    Elf* ElfHandle = elf_begin(FileDescriptor, ELF_C_READ_MMAP, 0);
+    if (ElfHandle == 0 || elf_kind(ElfHandle) != ELF_K_ELF || elf_getshdrstrndx(ElfHandle, &StringTableIndex) != 0) {
+        if (ElfHandle != 0) {
+            elf_end(ElfHandle);
+        }
+        close(FileDescriptor);
+        return -1;
+    }
+
+    while ((Section = elf_nextscn(ElfHandle, Section)) != 0) {
+        GElf_Shdr Header;
+        if (gelf_getshdr(Section, &Header) == 0) {
+            continue;
+        }
+
+        const char* Name = elf_strptr(ElfHandle, StringTableIndex, Header.sh_name);
+        if (Name == 0) {
+            continue;
+        }
+
+        if ((strcmp(Name, ".debug_info") == 0 || strcmp(Name, ".debug_info.dwo") == 0) && Header.sh_type != SHT_NOBITS) {
+            HasDwarf = 1;
+        } else if (strcmp(Name, ".gnu_debuglink") == 0 && Link != 0) {
+            // the file name, padding and a CRC32 of the debug file, which the build-id makes redundant
+            Elf_Data* Data = elf_getdata(Section, 0);
+            if (Data != 0 && Data->d_buf != 0 && memchr(Data->d_buf, 0, Data->d_size) != 0) {
+                snprintf(Link, LinkSize, "%s", (const char*)Data->d_buf);
+            }
+        }
+    }
+
+    if (BuildId != 0 && !ElfBuildId(ElfHandle, BuildId, BuildIdSize)) {
+        BuildId[0] = 0;
+    }
+
+    elf_end(ElfHandle);
+    close(FileDescriptor);
+
+    return HasDwarf;
+}
+
+// a candidate is taken when it has DWARF and, if both sides have one, the same build-id
+int DebugFileMatches(const char* Candidate, const char* BuildId)
+{
+    char CandidateId[128];
+
+    if (DebugFileHasDwarf(Candidate, CandidateId, sizeof(CandidateId), 0, 0) != 1) {
+        return 0;
+    }
+
+    return BuildId[0] == 0 || CandidateId[0] == 0 || strcmp(BuildId, CandidateId) == 0;
+}
+
+// the file to read DWARF from for Path, Path itself unless it was stripped and the debug file is found
+const char* DebugFileResolve(const char* Path, char* Resolved, size_t Size)
+{
+    const char* Directory = GlobalOptions.DebugDirectory != 0 ? GlobalOptions.DebugDirectory : DEBUG_DIRECTORY;
+    char BuildId[128];
+    char Link[NAME_MAX + 1] = "";
+
+    if (DebugFileHasDwarf(Path, BuildId, sizeof(BuildId), Link, sizeof(Link)) != 0) {
+        return Path;
+    }
+
+    if (BuildId[0] != 0 && BuildId[1] != 0) {
+        snprintf(Resolved, Size, "%s/.build-id/%.2s/%s.debug", Directory, BuildId, BuildId + 2);
+        if (DebugFileMatches(Resolved, BuildId)) {
+            return Resolved;
+        }
+    }
+
+    if (Link[0] == 0) {
+        return Path;
+    }
+
+    // next to the binary, in .debug/ next to it, and under the debug directory by absolute path
+    char Parent[PATH_MAX];
+    if (realpath(Path, Parent) == 0) {
+        snprintf(Parent, sizeof(Parent), "%s", Path);
+    }
+    char* Slash = strrchr(Parent, '/');
+    if (Slash != 0) {
+        *Slash = 0;
+    } else {
+        snprintf(Parent, sizeof(Parent), ".");
+    }
+
+    const char* Formats[] = { "%s%s/%s", "%s%s/.debug/%s", "%s%s/%s" };
+    const char* Prefixes[] = { "", "", Directory };
+    for (int Index = 0; Index < 3; Index++) {
+        snprintf(Resolved, Size, Formats[Index], Prefixes[Index], Parent, Link);
+        if (strcmp(Resolved, Path) != 0 && DebugFileMatches(Resolved, BuildId)) {
+            return Resolved;
+        }
+    }
+
+    return Path;
+}
+
+// a libdwarf handle over the mapped image when there is one, over the file descriptor otherwise
+#ifdef SELFDWARF_LIBRARY
+// without a handler libdwarf aborts on an error a call passed no Dwarf_Error for; with one the
+// call returns DW_DLV_ERROR like any other and the caller decides
+void DwarfLibraryErrorHandler(Dwarf_Error Error, Dwarf_Ptr Argument)
+{
+    (void)Error;
+    (void)Argument;
+}
+#define DWARF_ERROR_HANDLER DwarfLibraryErrorHandler
+#else
+#define DWARF_ERROR_HANDLER 0
+#endif
+
+int DwarfContextInit(struct DwarfContext* Context)
+{
+    if (Context->Image.Data != 0) {
+        return dwarf_object_init_b(&Context->Image.Interface, DWARF_ERROR_HANDLER, 0, DW_GROUPNUMBER_ANY, &Context->Debug, &Context->Error);
+    }
+
+    return dwarf_init(Context->FileDescriptor, DW_DLC_READ, DWARF_ERROR_HANDLER, 0, &Context->Debug, &Context->Error);
+}
+
+int DwarfContextFinish(struct DwarfContext* Context)
+{
+    if (Context->Image.Data != 0) {
+        return dwarf_object_finish(Context->Debug, &Context->Error);
+    }
+
+    return dwarf_finish(Context->Debug, &Context->Error);
+}
+
+// libdwarf keeps CU contexts, abbreviations and other per-CU caches until dwarf_finish(),
+// so staying under the budget means starting over with a fresh handle
+void DwarfContextRecycle(struct DwarfContext* Context)
+{
+    DwarfContextFinish(Context);
+
+    int DwarfInitResult = DwarfContextInit(Context);
+    if (DwarfInitResult != DW_DLV_OK) {
+        fprintf(stderr, "dwarf_init() error.\n");
+        exit(1);
+    }
+
+    if (Context->Package != 0) {
+        dwarf_set_tied_dbg(Context->Package->Debug, Context->Debug, 0);
+    }
+
+    __atomic_fetch_add(&GlobalMemoryStats.Recycles, 1, __ATOMIC_RELAXED);
+}
+
+void DwarfReleaseSourceFiles(struct DwarfContext* Context)
+{
+    for (Dwarf_Signed Index = 0; Index < Context->SourceFiles.Count; Index++) {
+        dwarf_dealloc(Context->Debug, Context->SourceFiles.Files[Index], DW_DLA_STRING);
+    }
+
+    if (Context->SourceFiles.Files != 0) {
+        dwarf_dealloc(Context->Debug, Context->SourceFiles.Files, DW_DLA_LIST);
+    }
+
+    Context->SourceFiles.Files = 0;
+    Context->SourceFiles.Count = 0;
+}
+
+void DwarfReleaseCompilationUnit(struct DwarfContext* Context, Dwarf_Die CUDie)
+{
+    DwarfReleaseSourceFiles(Context);
+
+    dwarf_dealloc(Context->Debug, CUDie, DW_DLA_DIE);
+
+    if (GlobalOptions.MemoryBudget != 0 && MemoryCurrentRSS() > GlobalOptions.MemoryBudget) {
+        DwarfContextRecycle(Context);
+    }
+}
+
+// the CU DIE and the DIEs the walker visits, as rows of Context->Columns
+void DwarfExportCompilationUnit(struct DwarfContext* Context, Dwarf_Die CUDie)
+{
+    struct DieAttributes Attributes;
+    Dwarf_Off Offset = 0;
+
+    DwarfLoadSourceFiles(Context, CUDie);
+
+    DieColumnsSetFiles(Context->Columns, &Context->SourceFiles);
+
+    dwarf_dieoffset(CUDie, &Offset, 0);
+    DieAttributesLoad(Context, CUDie, &Attributes);
+    DieColumnsAppend(Context->Columns, DW_TAG_compile_unit, Offset, ~(Dwarf_Off)0, &Attributes);
+    DieAttributesFree(Context, &Attributes);
+
+    DwarfWalkCompilationUnit(Context, CUDie);
+}
+
+// the functions and blocks of the CU, as ranges of Context->Symbols
+void DwarfIndexCompilationUnit(struct DwarfContext* Context, Dwarf_Die CUDie)
+{
+    struct DieAttributes Attributes;
+
+    DwarfLoadSourceFiles(Context, CUDie);
+
+    DieAttributesLoad(Context, CUDie, &Attributes);
+    SymbolIndexSetUnit(Context->Symbols, &Context->SourceFiles, GetTagAddress(&Attributes, DW_AT_low_pc));
+    DieAttributesFree(Context, &Attributes);
+
+    // the self-symbolizer wants both from the same pass
+    if (Context->Lines != 0) {
+        LineTableLoad(Context, Context->Lines, CUDie);
+    }
+
+    DwarfWalkCompilationUnit(Context, CUDie);
+}
+
+// the dwo_id pairing a skeleton unit with its split unit, from the DWARF 5 unit header or
+// DW_AT_GNU_dwo_id; -1 without one
+int DwarfUnitSignature(struct DwarfContext* Context, Dwarf_Die CUDie, Dwarf_Sig8* Signature)
+{
+    static const Dwarf_Sig8 Zero;
+    Dwarf_Sig8* HeaderSignature = 0;
+    Dwarf_Attribute Attribute = 0;
+    Dwarf_Unsigned Id = 0;
+
+    if (dwarf_cu_header_basics(CUDie, 0, 0, 0, 0, 0, 0, &HeaderSignature, 0, 0, 0) == DW_DLV_OK && HeaderSignature != 0
+        && memcmp(HeaderSignature, &Zero, sizeof(Zero)) != 0) {
+        *Signature = *HeaderSignature;
+        return 0;
+    }
+
+    if (dwarf_attr(CUDie, DW_AT_GNU_dwo_id, &Attribute, 0) != DW_DLV_OK) {
+        return -1;
+    }
+
+    // DW_FORM_data8, the bytes of the id in the target's order
+    int Result = dwarf_formudata(Attribute, &Id, 0) == DW_DLV_OK ? 0 : -1;
+    memcpy(Signature->signature, &Id, sizeof(Signature->signature));
+    dwarf_dealloc(Context->Debug, Attribute, DW_DLA_ATTR);
+
+    return Result;
+}
+
+// <file>.dwp, opened once per context and tied to the skeleton handle for addresses
+int DwarfOpenPackage(struct DwarfContext* Context)
+{
+    char Path[PATH_MAX];
+
+    if (Context->Package != 0) {
+        return 0;
+    }
+
+    if (Context->PackageMissing || Context->ObjectPath == 0) {
+        return -1;
+    }
+
+    snprintf(Path, sizeof(Path), "%s.dwp", Context->ObjectPath);
+
+    Context->Package = (struct DebugHandle*)calloc(1, sizeof(struct DebugHandle));
+    if (DebugHandleOpen(Context->Package, Path) != 0) {
+        free(Context->Package);
+        Context->Package = 0;
+        Context->PackageMissing = 1;
+        return -1;
+    }
+
+    dwarf_set_tied_dbg(Context->Package->Debug, Context->Debug, 0);
+    return 0;
+}
+
+const char* DwarfDieString(struct DwarfContext* Context, Dwarf_Die Die, Dwarf_Half AttributeCode)
+{
+    Dwarf_Attribute Attribute = 0;
+    char* String = 0;
+
+    if (dwarf_attr(Die, AttributeCode, &Attribute, 0) != DW_DLV_OK) {
+        return 0;
+    }
+
+    if (dwarf_formstring(Attribute, &String, 0) != DW_DLV_OK) {
+        String = 0;
+    }
+    dwarf_dealloc(Context->Debug, Attribute, DW_DLA_ATTR);
+
+    return String;
+}
+
+// the split unit of a skeleton CU and the handle it lives in, 0 for a regular CU or when neither
+// the .dwp nor the .dwo has it; only units the dump reaches are ever opened
+Dwarf_Debug DwarfOpenSplitUnit(struct DwarfContext* Context, Dwarf_Die CUDie, struct DebugHandle* Dwo, Dwarf_Die* SplitDie)
+{
+    Dwarf_Sig8 Signature;
+    char Path[PATH_MAX];
+
+    const char* Name = DwarfDieString(Context, CUDie, DW_AT_dwo_name);
+    if (Name == 0) {
+        Name = DwarfDieString(Context, CUDie, DW_AT_GNU_dwo_name);
+    }
+    if (Name == 0) {
+        return 0;
+    }
+
+    // a package serves every unit from its index, without reading the others
+    if (DwarfUnitSignature(Context, CUDie, &Signature) == 0 && DwarfOpenPackage(Context) == 0
+        && dwarf_die_from_hash_signature(Context->Package->Debug, &Signature, "cu", SplitDie, 0) == DW_DLV_OK) {
+        return Context->Package->Debug;
+    }
+
+    const char* Directory = DwarfDieString(Context, CUDie, DW_AT_comp_dir);
+    if (Name[0] == '/' || Directory == 0) {
+        snprintf(Path, sizeof(Path), "%s", Name);
+    } else {
+        snprintf(Path, sizeof(Path), "%s/%s", Directory, Name);
+    }
+
+    if (DebugHandleOpen(Dwo, Path) != 0) {
+        fprintf(stderr, "%s: split unit not found\n", Path);
+        return 0;
+    }
+
+    dwarf_set_tied_dbg(Dwo->Debug, Context->Debug, 0);
+
+    if (dwarf_next_cu_header_c(Dwo->Debug, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0) == DW_DLV_OK
+        && dwarf_siblingof_b(Dwo->Debug, 0, 1, SplitDie, 0) == DW_DLV_OK) {
+        return Dwo->Debug;
+    }
+
+    DebugHandleClose(Dwo);
+    return 0;
+}
+
+// the unit DIE through whichever mode the context is in
+void DwarfHandleCompilationUnitDie(struct DwarfContext* Context, Dwarf_Die CUDie)
+{
+    if (Context->Columns != 0) {
+        DwarfExportCompilationUnit(Context, CUDie);
+    } else if (Context->Symbols != 0) {
+        DwarfIndexCompilationUnit(Context, CUDie);
+    } else if (Context->Names != 0) {
+        dwarf_dieoffset(CUDie, &Context->UnitOffset, 0);
+        DwarfWalkCompilationUnit(Context, CUDie);
+    } else if (Context->Layouts != 0) {
+        DwarfLoadSourceFiles(Context, CUDie);
+        DwarfWalkCompilationUnit(Context, CUDie);
+    } else if (Context->Lines != 0) {
+        DwarfLoadSourceFiles(Context, CUDie);
+        LineTableLoad(Context, Context->Lines, CUDie);
+    } else {
+        DwarfPrintCompilationUnit(Context, CUDie);
+    }
+}
+
+// forgets everything keyed by a DIE offset, before and after a split unit is read through another handle
+void DwarfResetOffsetMemos(struct DwarfContext* Context)
+{
+    TypeResolverFree(&Context->TypeNames);
+    OffsetMapInit(&Context->TypeNames, 1024);
+    LocationCacheFree(&Context->Locations);
+    OffsetMapInit(&Context->Locations, 1024);
+    if (Context->Layouts != 0) {
+        OffsetMapFree(&Context->Layouts->Types);
+        OffsetMapInit(&Context->Layouts->Types, 4096);
+    }
+    OffsetMapFree(&Context->TypeHashes);
+    OffsetMapInit(&Context->TypeHashes, 1024);
+}
+
+// prints the CU at the given offset and releases everything it allocated
+void DwarfPrintCompilationUnitAt(struct DwarfContext* Context, Dwarf_Off Offset)
+{
+    Dwarf_Die CUDie = 0;
+
+    int Result = dwarf_offdie_b(Context->Debug, Offset, 1, &CUDie, &Context->Error);
+    if (Result != DW_DLV_OK) {
+        DwarfContextFail(Context, "dwarf_offdie_b()");
+        return;
+    }
+
+    // nothing below a CU skipped by --cu is read
+    if (DieFilterUnitMatches(Context, CUDie)) {
+        struct DebugHandle Dwo = { .FileDescriptor = -1 };
+        Dwarf_Debug Skeleton = Context->Debug;
+        Dwarf_Die SplitDie = 0;
+
+        // the line table stays with the skeleton, the split unit's only names the declaring files;
+        // a line-only pass has no use for the split unit, a symbol pass takes both
+        struct LineTable* Lines = Context->Lines;
+        Dwarf_Debug Split = Lines == 0 || Context->Symbols != 0 ? DwarfOpenSplitUnit(Context, CUDie, &Dwo, &SplitDie) : 0;
+        if (Split == 0) {
+            DwarfHandleCompilationUnitDie(Context, CUDie);
+        } else {
+            if (Lines != 0) {
+                DwarfLoadSourceFiles(Context, CUDie);
+                LineTableLoad(Context, Lines, CUDie);
+                DwarfReleaseSourceFiles(Context);
+            }
+
+            // the memos are keyed by bare DIE offsets, which mean something else on every handle
+            DwarfResetOffsetMemos(Context);
+            Context->Debug = Split;
+            Context->Lines = 0;
+            DwarfHandleCompilationUnitDie(Context, SplitDie);
+            DwarfReleaseSourceFiles(Context);
+            dwarf_dealloc(Split, SplitDie, DW_DLA_DIE);
+            Context->Lines = Lines;
+            Context->Debug = Skeleton;
+            DwarfResetOffsetMemos(Context);
+
+            if (Split == Dwo.Debug) {
+                DebugHandleClose(&Dwo);
+            }
+        }
+    }
+    DwarfReleaseCompilationUnit(Context, CUDie);
+
+    // stream consumers get every CU as soon as it is complete, a no-op for worker buffers
+    if (GlobalOptions.Format == FORMAT_NDJSON && Context->Output != 0) {
+        OutputFlush(Context->Output);
+    }
+}
+
+void DwarfPrintFunctionInfo(struct DwarfContext* Context)
+{
+    struct Array Offsets;
+
+    ArrayInit(&Offsets, 64);
+    DwarfEnumerateCompilationUnits(Context, &Offsets);
+
+    if (!GlobalOptions.SkipStrings && !GlobalFilter.Active) {
+        Dwarf_Unsigned Phase = StatsBegin(Context);
+        HandleDwarfDebugStr(Context);
+        StatsEnd(Context, PHASE_STRINGS, Phase);
+    }
+
+    if (Context->Boundaries != 0) {
+        ArrayInsert(Context->Boundaries, OutputPosition(Context->Output));
+    }
+
+    for (size_t Index = 0; Index < Offsets.used; Index++) {
+        Context->MacroImports.used = 0;
+        DwarfPrintCompilationUnitAt(Context, Offsets.array[Index]);
+        if (GlobalOptions.Format == FORMAT_NDJSON && Context->MacroCache != 0) {
+            MacroCacheEmit(Context->MacroCache, &Context->MacroImports, Context->Output);
+            OutputFlush(Context->Output);
+        }
+        if (Context->Boundaries != 0) {
+            ArrayInsert(Context->Boundaries, OutputPosition(Context->Output));
+        }
+    }
+
+    ArrayFree(&Offsets);
+}
+
+int DwarfContextOpen(struct DwarfContext* Context, const char* Path, struct Output* Output)
+{
+    memset(Context, 0, sizeof(*Context));
+
+    if (GlobalOptions.Stats) {
+        Context->Stats = (struct DumpStats*)calloc(1, sizeof(struct DumpStats));
+    }
+    Dwarf_Unsigned Phase = StatsBegin(Context);
+
+    // a stripped binary is read through its debug file alone
+    char DebugPath[PATH_MAX];
+    Context->ObjectPath = Path;
+    Path = DebugFileResolve(Path, DebugPath, sizeof(DebugPath));
+
+    Context->FileDescriptor = open(Path, O_RDONLY);
+    if (Context->FileDescriptor < 0) {
+        fprintf(stderr, "open() error: %s: %s\n", Path, strerror(errno));
+        free(Context->Stats);
+        return -1;
+    }
+
+    int DwarfInitResult = DW_DLV_ERROR;
+    if (ElfImageOpen(&Context->Image, Context->FileDescriptor) == 0) {
+        DwarfInitResult = DwarfContextInit(Context);
+        if (DwarfInitResult == DW_DLV_OK) {
+            Context->Elf = Context->Image.Elf;
+        } else {
+            ElfImageClose(&Context->Image);
+        }
+    }
+
+    if (DwarfInitResult != DW_DLV_OK) {
+        DwarfInitResult = DwarfContextInit(Context);
+        Context->Elf = elf_begin(Context->FileDescriptor, ELF_C_READ_MMAP, 0);
+    }
+
+    if (DwarfInitResult != DW_DLV_OK) {
+        fprintf(stderr, "dwarf_init() error: %s\n", Path);
+        if (Context->Elf != 0) {
+            elf_end(Context->Elf);
+        }
+        close(Context->FileDescriptor);
+        free(Context->Stats);
+        return -1;
+    }
+
+    ArrayInit(&Context->ImportedMacros, 1);
+    ArrayInit(&Context->MacroImports, 4);
+    Context->WalkDepthLimit = GlobalOptions.MaxDepth;
+    Context->WalkStack = (struct WalkerEntry*)calloc(Context->WalkDepthLimit, sizeof(struct WalkerEntry));
+    Context->Output = Output;
+    OffsetMapInit(&Context->TypeNames, 1024);
+    OffsetMapInit(&Context->Locations, 1024);
+    OffsetMapInit(&Context->TypeHashes, 1024);
+    OffsetMapInit(&Context->TypeCanonical, 1024);
+    StatsEnd(Context, PHASE_OPEN, Phase);
+
+    return 0;
+}
+
+int DwarfContextClose(struct DwarfContext* Context)
+{
+    ArrayFree(&Context->ImportedMacros);
+    ArrayFree(&Context->MacroImports);
+    free(Context->WalkStack);
+    TypeResolverFree(&Context->TypeNames);
+    LocationCacheFree(&Context->Locations);
+    OffsetMapFree(&Context->TypeHashes);
+    OffsetMapFree(&Context->TypeCanonical);
+
+    if (Context->Stats != 0) {
+        StatsMerge(&GlobalStats, Context->Stats);
+        free(Context->Stats);
+    }
+
+    if (Context->Package != 0) {
+        DebugHandleClose(Context->Package);
+        free(Context->Package);
+    }
+
+    int DwarfFinishResult = DwarfContextFinish(Context);
+    if (Context->Image.Data != 0) {
+        ElfImageClose(&Context->Image);
+    } else if (Context->Elf != 0) {
+        elf_end(Context->Elf);
+    }
+    close(Context->FileDescriptor);
+    if (DwarfFinishResult != DW_DLV_OK) {
+        fprintf(stderr, "dwarf_finish() error.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// parallel CU stuff
+struct UnitOutput {
+    char* Buffer;
+    size_t Size;
+    struct Array MacroImports; // handed to MacroCacheEmit() by the writer
+    int Done;
+};
+
+struct UnitQueue {
+    const char* Path;
+    struct MacroCache* MacroCache;
+    struct Array Offsets;
+    struct UnitOutput* Outputs;
+    size_t Next;
+    size_t Written;
+    size_t Window; // how far the workers may get ahead of the writer
+    pthread_mutex_t Lock;
+    pthread_cond_t Ready;
+};
+
+void* UnitWorker(void* Argument)
+{
+    struct UnitQueue* Queue = (struct UnitQueue*)Argument;
+    struct DwarfContext Context;
+
+    if (DwarfContextOpen(&Context, Queue->Path, 0) != 0) {
+        exit(1);
+    }
+
+    Context.MacroCache = Queue->MacroCache;
+
+    for (;;) {
+        pthread_mutex_lock(&Queue->Lock);
+        size_t Index = Queue->Next++;
+        while (Index < Queue->Offsets.used && Index >= Queue->Written + Queue->Window) {
+            pthread_cond_wait(&Queue->Ready, &Queue->Lock);
+        }
+        pthread_mutex_unlock(&Queue->Lock);
+
+        if (Index >= Queue->Offsets.used) {
+            break;
+        }
+
+        struct UnitOutput* Output = &Queue->Outputs[Index];
+        struct Output UnitOutput;
+
+        OutputInit(&UnitOutput, -1);
+        Context.Output = &UnitOutput;
+        Context.MacroImports.used = 0;
+        DwarfPrintCompilationUnitAt(&Context, Queue->Offsets.array[Index]);
+
+        struct Array MacroImports;
+        ArrayInit(&MacroImports, Context.MacroImports.used + 1);
+        memcpy(MacroImports.array, Context.MacroImports.array, Context.MacroImports.used * sizeof(Dwarf_Unsigned));
+        MacroImports.used = Context.MacroImports.used;
+
+        pthread_mutex_lock(&Queue->Lock);
+        Output->Buffer = UnitOutput.Buffer;
+        Output->Size = UnitOutput.Used;
+        Output->MacroImports = MacroImports;
+        Output->Done = 1;
+        pthread_cond_broadcast(&Queue->Ready);
+        pthread_mutex_unlock(&Queue->Lock);
+    }
+
+    DwarfContextClose(&Context);
+
+    return 0;
+}
+
+// every worker renders whole CUs into its own buffer, the buffers are written in CU order
+void DwarfPrintFunctionInfoParallel(struct DwarfContext* Context, const char* Path, int Jobs)
+{
+    struct UnitQueue Queue = { 0 };
+
+    Queue.Path = Path;
+    Queue.MacroCache = Context->MacroCache;
+    Queue.Window = 4 * Jobs;
+    ArrayInit(&Queue.Offsets, 64);
+
+    DwarfEnumerateCompilationUnits(Context, &Queue.Offsets);
+
+    Queue.Outputs = (struct UnitOutput*)calloc(Queue.Offsets.used + 1, sizeof(struct UnitOutput));
+    pthread_mutex_init(&Queue.Lock, 0);
+    pthread_cond_init(&Queue.Ready, 0);
+
+    if (Jobs > (int)Queue.Offsets.used) {
+        Jobs = (int)Queue.Offsets.used;
+    }
+
+    pthread_t* Workers = (pthread_t*)calloc(Jobs + 1, sizeof(pthread_t));
+    for (int Index = 0; Index < Jobs; Index++) {
+        pthread_create(&Workers[Index], 0, UnitWorker, &Queue);
+    }
+
+    if (!GlobalOptions.SkipStrings && !GlobalFilter.Active) {
+        Dwarf_Unsigned Phase = StatsBegin(Context);
+        HandleDwarfDebugStr(Context);
+        StatsEnd(Context, PHASE_STRINGS, Phase);
+    }
+
+    if (Context->Boundaries != 0) {
+        ArrayInsert(Context->Boundaries, OutputPosition(Context->Output));
+    }
+
+    for (size_t Index = 0; Index < Queue.Offsets.used; Index++) {
+        struct UnitOutput* Output = &Queue.Outputs[Index];
+
+        pthread_mutex_lock(&Queue.Lock);
+        while (!Output->Done) {
+            pthread_cond_wait(&Queue.Ready, &Queue.Lock);
+        }
+        pthread_mutex_unlock(&Queue.Lock);
+
+        OutputBytes(Context->Output, Output->Buffer, Output->Size);
+        if (GlobalOptions.Format == FORMAT_NDJSON) {
+            MacroCacheEmit(Queue.MacroCache, &Output->MacroImports, Context->Output);
+            OutputFlush(Context->Output);
+        }
+        ArrayFree(&Output->MacroImports);
+        if (Context->Boundaries != 0) {
+            ArrayInsert(Context->Boundaries, OutputPosition(Context->Output));
+        }
+        free(Output->Buffer);
+        Output->Buffer = 0;
+
+        pthread_mutex_lock(&Queue.Lock);
+        Queue.Written = Index + 1;
+        pthread_cond_broadcast(&Queue.Ready);
+        pthread_mutex_unlock(&Queue.Lock);
+    }
+
+    for (int Index = 0; Index < Jobs; Index++) {
+        pthread_join(Workers[Index], 0);
+    }
+
+    free(Workers);
+    free(Queue.Outputs);
+    ArrayFree(&Queue.Offsets);
+    pthread_cond_destroy(&Queue.Ready);
+    pthread_mutex_destroy(&Queue.Lock);
+}
+
+int DwarfDumpFile(const char* Path, struct Output* Output, int Jobs, struct Array* Boundaries)
+{
+    struct DwarfContext Context;
+    struct MacroCache MacroCache;
+
+    if (DwarfContextOpen(&Context, Path, Output) != 0) {
+        return -1;
+    }
+
+    MacroCacheInit(&MacroCache);
+    Context.MacroCache = &MacroCache;
+    Context.Boundaries = Boundaries;
+
+    // which copy of a type is the first one printed depends on the CU order, so deduplicated
+    // dumps stay on one thread
+    if (Jobs > 1 && !GlobalOptions.DedupTypes) {
+        DwarfPrintFunctionInfoParallel(&Context, Path, Jobs);
+    } else {
+        DwarfPrintFunctionInfo(&Context);
+    }
+
+    MacroCachePrint(&MacroCache, Output);
+
+    if (Boundaries != 0) {
+        ArrayInsert(Boundaries, OutputPosition(Output));
+    }
+
+    int Result = DwarfContextClose(&Context);
+    if (OutputFlush(Output) != 0) {
+        fprintf(stderr, "write() error: %s\n", strerror(Output->Error));
+        Result = -1;
+    }
+
+    return Result;
+}
+
+// rendered dumps kept in --cache-dir, keyed by build-id and the options that change the text
+#define CACHE_MAGIC "SDDCACHE"
+#define CACHE_VERSION 2
+
+// the file is this header, the rendered dump, then Boundaries: UnitCount + 2 offsets into the
+// dump, the end of .debug_str, of every CU and of the imported macro units
+struct CacheHeader {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t KeyLength;
+    char Key[64]; // hex build-id, or "fnv-" and a content hash
+    uint64_t Options;
+    uint64_t SourceSize; // a stripped or rewritten file keeps its build-id, not its size and mtime
+    uint64_t SourceMtime;
+    uint64_t DebugSize; // of the file DwarfContextOpen() reads, the source itself when not stripped
+    uint64_t DebugMtime;
+    uint64_t DataOffset;
+    uint64_t DataSize;
+    uint64_t UnitCount;
+    uint64_t BoundariesOffset;
+};
+
+// build-id, or a hash of the whole file when there is none; DebugStatus is the file the dump
+// actually comes from, a debug file installed or rebuilt later has to invalidate the entry
+int CacheKey(const char* Path, char* Key, size_t Size, struct stat* Status, struct stat* DebugStatus)
+{
+    int FileDescriptor = open(Path, O_RDONLY);
+    if (FileDescriptor < 0 || fstat(FileDescriptor, Status) != 0) {
+        fprintf(stderr, "open() error: %s: %s\n", Path, strerror(errno));
+        if (FileDescriptor >= 0) {
+            close(FileDescriptor);
+        }
+        return -1;
+    }
+
+    int Found = 0;
+    Elf* ElfHandle = elf_begin(FileDescriptor, ELF_C_READ_MMAP, 0);
+    if (ElfHandle != 0) {
+        Found = ElfBuildId(ElfHandle, Key, Size);
+        elf_end(ElfHandle);
+    }
+
+    if (!Found) {
+        Dwarf_Unsigned Hash = 0xcbf29ce484222325ull;
+        void* Map = Status->st_size == 0 ? MAP_FAILED : mmap(0, Status->st_size, PROT_READ, MAP_PRIVATE, FileDescriptor, 0);
+        if (Map != MAP_FAILED) {
+            const unsigned char* Bytes = (const unsigned char*)Map;
+            for (off_t Index = 0; Index < Status->st_size; Index++) {
+                Hash = (Hash ^ Bytes[Index]) * 0x100000001b3ull;
+            }
+            munmap(Map, Status->st_size);
+        }
+
+        snprintf(Key, Size, "fnv-%016llx", Hash);
+    }
+
+    close(FileDescriptor);
+
+    char DebugPath[PATH_MAX];
+    const char* Resolved = DebugFileResolve(Path, DebugPath, sizeof(DebugPath));
+    if (Resolved == Path || stat(Resolved, DebugStatus) != 0) {
+        *DebugStatus = *Status;
+    }
+
+    return 0;
+}
+
+// everything that changes the rendered text has to be part of the cache key
+uint64_t CacheOptions()
+{
+    uint64_t Options = CACHE_VERSION;
+
+    Options = Options * 31 + GlobalOptions.Format;
+    Options = Options * 31 + GlobalOptions.SkipStrings;
+    Options = Options * 31 + GlobalOptions.PrintLines;
+    Options = Options * 31 + GlobalOptions.ResolveTypes;
+    Options = Options * 31 + GlobalOptions.DecodeLocations;
+    Options = Options * 31 + GlobalOptions.DedupTypes;
+    Options = Options * 31 + (uint64_t)GlobalOptions.MaxDepth;
+
+    const char* Filters[] = { GlobalFilter.TagList, GlobalFilter.NamePattern, GlobalFilter.NameRegexPattern, GlobalFilter.UnitPattern };
+    for (size_t Index = 0; Index < sizeof(Filters) / sizeof(Filters[0]); Index++) {
+        for (const char* Character = Filters[Index]; Character != 0 && *Character != 0; Character++) {
+            Options = Options * 31 + (unsigned char)*Character;
+        }
+        Options = Options * 31 + (Filters[Index] != 0);
+    }
+
+    return Options;
+}
+
+// writes the cached dump to Output, -1 when the entry is missing or stale
+int CacheServe(const char* CachePath, const char* Key, struct stat* Status, struct stat* DebugStatus, struct Output* Output)
+{
+    int FileDescriptor = open(CachePath, O_RDONLY);
+    if (FileDescriptor < 0) {
+        return -1;
+    }
+
+    struct stat CacheStatus;
+    if (fstat(FileDescriptor, &CacheStatus) != 0 || (size_t)CacheStatus.st_size < sizeof(struct CacheHeader)) {
+        close(FileDescriptor);
+        return -1;
+    }
+
+    void* Map = mmap(0, CacheStatus.st_size, PROT_READ, MAP_PRIVATE, FileDescriptor, 0);
+    close(FileDescriptor);
+    if (Map == MAP_FAILED) {
+        return -1;
+    }
+
+    const struct CacheHeader* Header = (const struct CacheHeader*)Map;
+    int Valid = memcmp(Header->Magic, CACHE_MAGIC, sizeof(Header->Magic)) == 0
+        && Header->Version == CACHE_VERSION
+        && Header->KeyLength == strlen(Key)
+        && memcmp(Header->Key, Key, Header->KeyLength) == 0
+        && Header->Options == CacheOptions()
+        && Header->SourceSize == (uint64_t)Status->st_size
+        && Header->SourceMtime == (uint64_t)Status->st_mtime
+        && Header->DebugSize == (uint64_t)DebugStatus->st_size
+        && Header->DebugMtime == (uint64_t)DebugStatus->st_mtime
+        && Header->DataOffset + Header->DataSize <= (uint64_t)CacheStatus.st_size;
+
+    if (Valid) {
+        madvise(Map, CacheStatus.st_size, MADV_SEQUENTIAL);
+        OutputBytes(Output, (const char*)Map + Header->DataOffset, Header->DataSize);
+        OutputFlush(Output);
+    }
+
+    munmap(Map, CacheStatus.st_size);
+
+    return Valid ? 0 : -1;
+}
+
+// renders the dump into a temporary file next to the entry and renames it into place,
+// returns 1 when the entry cannot be written at all; the temporary name is unique per call,
+// batch workers can store the same entry at the same time
+int CacheStore(const char* Path, const char* CachePath, const char* Key, struct stat* Status, struct stat* DebugStatus, int Jobs)
+{
+    size_t TemporaryLength = strlen(CachePath) + 32;
+    char* TemporaryPath = (char*)malloc(TemporaryLength);
+    snprintf(TemporaryPath, TemporaryLength, "%s.XXXXXX", CachePath);
+
+    int FileDescriptor = mkstemp(TemporaryPath);
+    if (FileDescriptor < 0) {
+        fprintf(stderr, "mkstemp() error: %s: %s\n", TemporaryPath, strerror(errno));
+        free(TemporaryPath);
+        return 1;
+    }
+    fchmod(FileDescriptor, 0644);
+
+    struct CacheHeader Header;
+    struct Output Output;
+    struct Array Boundaries;
+
+    memset(&Header, 0, sizeof(Header));
+    ArrayInit(&Boundaries, 64);
+    OutputInit(&Output, FileDescriptor);
+    OutputBytes(&Output, (const char*)&Header, sizeof(Header));
+
+    int Result = DwarfDumpFile(Path, &Output, Jobs, &Boundaries);
+
+    memcpy(Header.Magic, CACHE_MAGIC, sizeof(Header.Magic));
+    Header.Version = CACHE_VERSION;
+    Header.KeyLength = (uint32_t)strlen(Key);
+    memcpy(Header.Key, Key, Header.KeyLength);
+    Header.Options = CacheOptions();
+    Header.SourceSize = (uint64_t)Status->st_size;
+    Header.SourceMtime = (uint64_t)Status->st_mtime;
+    Header.DebugSize = (uint64_t)DebugStatus->st_size;
+    Header.DebugMtime = (uint64_t)DebugStatus->st_mtime;
+    Header.DataOffset = sizeof(Header);
+    Header.DataSize = OutputPosition(&Output) - sizeof(Header);
+    Header.UnitCount = Boundaries.used >= 2 ? Boundaries.used - 2 : 0;
+    Header.BoundariesOffset = OutputPosition(&Output);
+
+    for (size_t Index = 0; Index < Boundaries.used; Index++) {
+        uint64_t Boundary = Boundaries.array[Index] - sizeof(Header);
+        OutputBytes(&Output, (const char*)&Boundary, sizeof(Boundary));
+    }
+
+    if (OutputFlush(&Output) != 0 || pwrite(FileDescriptor, &Header, sizeof(Header), 0) != sizeof(Header)) {
+        Result = -1;
+    }
+
+    OutputFree(&Output);
+    ArrayFree(&Boundaries);
+    close(FileDescriptor);
+
+    if (Result == 0 && rename(TemporaryPath, CachePath) != 0) {
+        fprintf(stderr, "rename() error: %s: %s\n", CachePath, strerror(errno));
+        Result = 1;
+    }
+
+    if (Result != 0) {
+        unlink(TemporaryPath);
+    }
+
+    free(TemporaryPath);
+
+    return Result;
+}
+
+// DwarfDumpFile() through --cache-dir, a miss fills the entry first and serves it like a hit
+int DwarfDumpFileCached(const char* Path, struct Output* Output, int Jobs)
+{
+    if (GlobalOptions.CacheDirectory == 0) {
+        return DwarfDumpFile(Path, Output, Jobs, 0);
+    }
+
+    char Key[64];
+    struct stat Status;
+    struct stat DebugStatus;
+    if (CacheKey(Path, Key, sizeof(Key), &Status, &DebugStatus) != 0) {
+        return -1;
+    }
+
+    size_t Length = strlen(GlobalOptions.CacheDirectory) + strlen(Key) + 64;
+    char* CachePath = (char*)malloc(Length);
+    snprintf(CachePath, Length, "%s/%s-%016llx.cache", GlobalOptions.CacheDirectory, Key, (unsigned long long)CacheOptions());
+
+    int Result = CacheServe(CachePath, Key, &Status, &DebugStatus, Output);
+    if (Result != 0) {
+        if (mkdir(GlobalOptions.CacheDirectory, 0777) != 0 && errno != EEXIST) {
+            fprintf(stderr, "mkdir() error: %s: %s\n", GlobalOptions.CacheDirectory, strerror(errno));
+        }
+
+        Result = CacheStore(Path, CachePath, Key, &Status, &DebugStatus, Jobs);
+        if (Result == 0) {
+            Result = CacheServe(CachePath, Key, &Status, &DebugStatus, Output);
+        } else if (Result > 0) {
+            // no usable cache directory, dump directly
+            Result = DwarfDumpFile(Path, Output, Jobs, 0);
+        }
+    }
+
+    free(CachePath);
+
+    if (Result == 0 && Output->Error != 0) {
+        fprintf(stderr, "write() error: %s\n", strerror(Output->Error));
+        Result = -1;
+    }
+
+    return Result;
+}
+
+// single threaded, the rows are appended in .debug_info order
+int DwarfExportFile(const char* Path, const char* ColumnsPath)
+{
+    struct DwarfContext Context;
+    struct DieColumns Columns;
+    struct Array Offsets;
+
+    if (DwarfContextOpen(&Context, Path, 0) != 0) {
+        return -1;
+    }
+
+    DieColumnsInit(&Columns);
+    Context.Columns = &Columns;
+
+    ArrayInit(&Offsets, 64);
+    DwarfEnumerateCompilationUnits(&Context, &Offsets);
+
+    for (size_t Index = 0; Index < Offsets.used; Index++) {
+        DwarfPrintCompilationUnitAt(&Context, Offsets.array[Index]);
+    }
+
+    ArrayFree(&Offsets);
+
+    int Result = DieColumnsWrite(&Columns, ColumnsPath);
+    DieColumnsFree(&Columns);
+
+    if (DwarfContextClose(&Context) != 0) {
+        Result = -1;
+    }
+
+    return Result;
+}
+
+// one pass over every CU, the report is sorted once all structs are in
+int DwarfLayoutFile(const char* Path, struct Output* Output)
+{
+    struct DwarfContext Context;
+    struct LayoutTable Table;
+    struct Array Offsets;
+
+    if (DwarfContextOpen(&Context, Path, Output) != 0) {
+        return -1;
+    }
+
+    LayoutTableInit(&Table);
+    Context.Layouts = &Table;
+
+    ArrayInit(&Offsets, 64);
+    DwarfEnumerateCompilationUnits(&Context, &Offsets);
+
+    for (size_t Index = 0; Index < Offsets.used; Index++) {
+        DwarfPrintCompilationUnitAt(&Context, Offsets.array[Index]);
+    }
+
+    ArrayFree(&Offsets);
+    LayoutPrint(&Table, Output);
+    LayoutTableFree(&Table);
+
+    int Result = DwarfContextClose(&Context);
+    if (OutputFlush(Output) != 0) {
+        fprintf(stderr, "write() error: %s\n", strerror(Output->Error));
+        Result = -1;
+    }
+
+    return Result;
+}
+
+// diff mode stuff: both files reduced to one hash per CU and one per named top-level DIE,
+// CUs matched by DW_AT_name and only the CUs whose hashes differ compared entity by entity
+struct DiffEntity {
+    Dwarf_Half Tag;
+    Dwarf_Unsigned Name; // offset into the side's string table
+    uint64_t Hash;
+};
+
+struct DiffUnit {
+    Dwarf_Unsigned Name;
+    uint64_t Hash;
+    size_t First; // entities, sorted by tag, name and hash
+    size_t Count;
+};
+
+struct DiffSide {
+    const char* Path;
+    struct DiffUnit* Units;
+    size_t UnitCount;
+    struct DiffEntity* Entities;
+    size_t EntityCount;
+    size_t EntitySize;
+    struct StringTable Strings;
+    int Result;
+};
+
+// what a diff reports, 0 for tags it leaves out
+const char* DiffEntityKind(Dwarf_Half Tag)
+{
+    switch (Tag) {
+        case DW_TAG_subprogram:
+            return "function";
+        case DW_TAG_variable:
+            return "variable";
+        case DW_TAG_structure_type:
+            return "struct";
+        case DW_TAG_union_type:
+            return "union";
+        case DW_TAG_class_type:
+            return "class";
+        case DW_TAG_enumeration_type:
+            return "enum";
+        case DW_TAG_typedef:
+            return "typedef";
+        default:
+            return 0;
+    }
+}
+
+static struct DiffSide* DiffSortBase; // qsort() has no context argument
+
+int DiffEntityCompare(const void* A, const void* B)
+{
+    const struct DiffEntity* EntityA = (const struct DiffEntity*)A;
+    const struct DiffEntity* EntityB = (const struct DiffEntity*)B;
+
+    if (EntityA->Tag != EntityB->Tag) {
+        return EntityA->Tag < EntityB->Tag ? -1 : 1;
+    }
+
+    int Order = strcmp(DiffSortBase->Strings.Strings + EntityA->Name, DiffSortBase->Strings.Strings + EntityB->Name);
+    if (Order != 0) {
+        return Order;
+    }
+
+    return EntityA->Hash < EntityB->Hash ? -1 : EntityA->Hash > EntityB->Hash;
+}
+
+int DiffUnitCompare(const void* A, const void* B)
+{
+    const struct DiffUnit* UnitA = (const struct DiffUnit*)A;
+    const struct DiffUnit* UnitB = (const struct DiffUnit*)B;
+
+    int Order = strcmp(DiffSortBase->Strings.Strings + UnitA->Name, DiffSortBase->Strings.Strings + UnitB->Name);
+    if (Order != 0) {
+        return Order;
+    }
+
+    // the same file built twice pairs up in .debug_info order
+    return UnitA->First < UnitB->First ? -1 : UnitA->First > UnitB->First;
+}
+
+int DiffSameName(struct DiffSide* Side, struct DiffEntity* A, struct DiffEntity* B)
+{
+    return A->Tag == B->Tag && strcmp(Side->Strings.Strings + A->Name, Side->Strings.Strings + B->Name) == 0;
+}
+
+void DiffSideAppend(struct DiffSide* Side, Dwarf_Half Tag, const char* Name, uint64_t Hash)
+{
+    if (Side->EntityCount == Side->EntitySize) {
+        Side->EntitySize *= 2;
+        Side->Entities = (struct DiffEntity*)realloc(Side->Entities, Side->EntitySize * sizeof(struct DiffEntity));
+    }
+
+    struct DiffEntity* Entity = &Side->Entities[Side->EntityCount++];
+    Entity->Tag = Tag;
+    Entity->Name = StringTableIntern(&Side->Strings, Name);
+    Entity->Hash = Hash;
+}
+
+// hashes every CU of Side->Path, the names are copied so the file can be closed right after
+void* DiffSideLoad(void* Argument)
+{
+    struct DiffSide* Side = (struct DiffSide*)Argument;
+    struct DwarfContext Context;
+    struct Array Offsets;
+
+    Side->EntitySize = 4096;
+    Side->Entities = (struct DiffEntity*)malloc(Side->EntitySize * sizeof(struct DiffEntity));
+    StringTableInit(&Side->Strings);
+
+    Side->Result = DwarfContextOpen(&Context, Side->Path, 0);
+    if (Side->Result != 0) {
+        return 0;
+    }
+
+    Context.DiffHashing = 1;
+
+    ArrayInit(&Offsets, 64);
+    DwarfEnumerateCompilationUnits(&Context, &Offsets);
+    Side->Units = (struct DiffUnit*)calloc(Offsets.used + 1, sizeof(struct DiffUnit));
+
+    for (size_t Index = 0; Index < Offsets.used; Index++) {
+        Dwarf_Die CUDie = 0;
+        if (dwarf_offdie_b(Context.Debug, Offsets.array[Index], 1, &CUDie, &Context.Error) != DW_DLV_OK) {
+            fprintf(stderr, "dwarf_offdie_b() error: %s\n", dwarf_errmsg(Context.Error));
+            exit(1);
+        }
+
+        struct DieAttributes Attributes;
+        DieAttributesLoad(&Context, CUDie, &Attributes);
+        DwarfLoadSourceFiles(&Context, CUDie);
+
+        struct DiffUnit* Unit = &Side->Units[Side->UnitCount++];
+        Unit->Name = StringTableIntern(&Side->Strings, GetTagString(&Attributes, DW_AT_name));
+        Unit->First = Side->EntityCount;
+        DieAttributesFree(&Context, &Attributes);
+
+        // the CU hash memoizes the hash of every DIE below it, entities are lookups after that
+        int Open = INT_MAX;
+        Unit->Hash = TypeHashDie(&Context, CUDie, 0, &Open);
+
+        Dwarf_Die Child = 0;
+        if (dwarf_child(CUDie, &Child, 0) != DW_DLV_OK) {
+            Child = 0;
+        }
+
+        while (Child != 0) {
+            Dwarf_Die Sibling = 0;
+            Dwarf_Half Tag = 0;
+            Dwarf_Off Offset = 0;
+
+            dwarf_tag(Child, &Tag, 0);
+            if (DiffEntityKind(Tag) != 0) {
+                DieAttributesLoad(&Context, Child, &Attributes);
+
+                // C++ overloads share a DW_AT_name
+                const char* Name = GetTagString(&Attributes, DW_AT_linkage_name);
+                if (Name == 0) {
+                    Name = GetTagString(&Attributes, DW_AT_name);
+                }
+                if (Name != 0) {
+                    dwarf_dieoffset(Child, &Offset, 0);
+                    DiffSideAppend(Side, Tag, Name, TypeHashAt(&Context, Offset, 1, &Open));
+                }
+
+                DieAttributesFree(&Context, &Attributes);
+            }
+
+            if (dwarf_siblingof(Context.Debug, Child, &Sibling, 0) != DW_DLV_OK) {
+                Sibling = 0;
+            }
+            dwarf_dealloc(Context.Debug, Child, DW_DLA_DIE);
+            Child = Sibling;
+        }
+
+        Unit->Count = Side->EntityCount - Unit->First;
+
+        // references leave their CU rarely enough that the memo only has to live for one
+        OffsetMapFree(&Context.TypeHashes);
+        OffsetMapInit(&Context.TypeHashes, 1024);
+        DwarfReleaseCompilationUnit(&Context, CUDie);
+    }
+
+    ArrayFree(&Offsets);
+    Side->Result = DwarfContextClose(&Context);
+
+    return 0;
+}
+
+void DiffSideFree(struct DiffSide* Side)
+{
+    free(Side->Units);
+    free(Side->Entities);
+    StringTableFree(&Side->Strings);
+}
+
+// "+ function foo in src/a.c", a CU itself has no Unit
+void DiffReport(struct Output* Output, char Change, const char* Kind, const char* Name, const char* Unit)
+{
+    if (GlobalOptions.Format == FORMAT_NDJSON) {
+        OutputRecordBegin(Output, "diff");
+        OutputFieldString(Output, "change", Change == '+' ? "added" : Change == '-' ? "removed" : "changed");
+        OutputFieldString(Output, "kind", Kind);
+        OutputFieldString(Output, "name", Name);
+        if (Unit != 0) {
+            OutputFieldString(Output, "cu", Unit);
+        }
+        OutputRecordEnd(Output);
+        return;
+    }
+
+    OutputBytes(Output, &Change, 1);
+    OutputLiteral(Output, " ");
+    OutputString(Output, Kind);
+    OutputLiteral(Output, " ");
+    OutputString(Output, Name);
+    if (Unit != 0) {
+        OutputLiteral(Output, " in ");
+        OutputString(Output, Unit);
+    }
+    OutputLiteral(Output, "\n");
+}
+
+// entities of two CUs with the same name; equal names with different hashes are changes, a
+// name that appears more often on one side is added or removed that many times
+void DiffUnits(struct DiffSide* Old, struct DiffUnit* OldUnit, struct DiffSide* New, struct DiffUnit* NewUnit, struct Output* Output)
+{
+    struct DiffEntity* OldEntities = &Old->Entities[OldUnit->First];
+    struct DiffEntity* NewEntities = &New->Entities[NewUnit->First];
+    const char* Unit = New->Strings.Strings + NewUnit->Name;
+    size_t OldIndex = 0;
+    size_t NewIndex = 0;
+
+    while (OldIndex < OldUnit->Count || NewIndex < NewUnit->Count) {
+        struct DiffEntity* OldEntity = OldIndex < OldUnit->Count ? &OldEntities[OldIndex] : 0;
+        struct DiffEntity* NewEntity = NewIndex < NewUnit->Count ? &NewEntities[NewIndex] : 0;
+        int Order = 0;
+
+        if (OldEntity == 0) {
+            Order = 1;
+        } else if (NewEntity == 0) {
+            Order = -1;
+        } else if (OldEntity->Tag != NewEntity->Tag) {
+            Order = OldEntity->Tag < NewEntity->Tag ? -1 : 1;
+        } else {
+            Order = strcmp(Old->Strings.Strings + OldEntity->Name, New->Strings.Strings + NewEntity->Name);
+        }
+
+        if (Order < 0) {
+            DiffReport(Output, '-', DiffEntityKind(OldEntity->Tag), Old->Strings.Strings + OldEntity->Name, Unit);
+            OldIndex++;
+            continue;
+        }
+        if (Order > 0) {
+            DiffReport(Output, '+', DiffEntityKind(NewEntity->Tag), New->Strings.Strings + NewEntity->Name, Unit);
+            NewIndex++;
+            continue;
+        }
+
+        // one tag and name, entries sorted by hash on both sides
+        size_t OldEnd = OldIndex;
+        size_t NewEnd = NewIndex;
+        while (OldEnd < OldUnit->Count && DiffSameName(Old, &OldEntities[OldEnd], OldEntity)) {
+            OldEnd++;
+        }
+        while (NewEnd < NewUnit->Count && DiffSameName(New, &NewEntities[NewEnd], NewEntity)) {
+            NewEnd++;
+        }
+
+        size_t OldUnmatched = 0;
+        size_t NewUnmatched = 0;
+        while (OldIndex < OldEnd || NewIndex < NewEnd) {
+            if (NewIndex == NewEnd || (OldIndex < OldEnd && OldEntities[OldIndex].Hash < NewEntities[NewIndex].Hash)) {
+                OldUnmatched++;
+                OldIndex++;
+            } else if (OldIndex == OldEnd || NewEntities[NewIndex].Hash < OldEntities[OldIndex].Hash) {
+                NewUnmatched++;
+                NewIndex++;
+            } else {
+                OldIndex++;
+                NewIndex++;
+            }
+        }
+
+        const char* Kind = DiffEntityKind(NewEntity->Tag);
+        const char* Name = New->Strings.Strings + NewEntity->Name;
+        for (; OldUnmatched > 0 && NewUnmatched > 0; OldUnmatched--, NewUnmatched--) {
+            DiffReport(Output, '~', Kind, Name, Unit);
+        }
+        for (; OldUnmatched > 0; OldUnmatched--) {
+            DiffReport(Output, '-', Kind, Name, Unit);
+        }
+        for (; NewUnmatched > 0; NewUnmatched--) {
+            DiffReport(Output, '+', Kind, Name, Unit);
+        }
+    }
+}
+
+// both files are hashed at the same time, the second one on its own thread
+int DwarfDiffFiles(const char* OldPath, const char* NewPath, struct Output* Output)
+{
+    struct DiffSide Old = { .Path = OldPath };
+    struct DiffSide New = { .Path = NewPath };
+    pthread_t Worker;
+
+    int Threaded = pthread_create(&Worker, 0, DiffSideLoad, &New) == 0;
+    DiffSideLoad(&Old);
+    if (Threaded) {
+        pthread_join(Worker, 0);
+    } else {
+        DiffSideLoad(&New);
+    }
+
+    int Result = Old.Result != 0 || New.Result != 0 ? -1 : 0;
+    struct DiffSide* Sides[] = { &Old, &New };
+
+    for (int Index = 0; Index < 2 && Result == 0; Index++) {
+        struct DiffSide* Side = Sides[Index];
+        DiffSortBase = Side;
+        qsort(Side->Units, Side->UnitCount, sizeof(struct DiffUnit), DiffUnitCompare);
+        for (size_t Unit = 0; Unit < Side->UnitCount; Unit++) {
+            qsort(&Side->Entities[Side->Units[Unit].First], Side->Units[Unit].Count, sizeof(struct DiffEntity), DiffEntityCompare);
+        }
+    }
+
+    size_t OldIndex = 0;
+    size_t NewIndex = 0;
+    size_t Identical = 0;
+    size_t Changed = 0;
+
+    while (Result == 0 && (OldIndex < Old.UnitCount || NewIndex < New.UnitCount)) {
+        struct DiffUnit* OldUnit = OldIndex < Old.UnitCount ? &Old.Units[OldIndex] : 0;
+        struct DiffUnit* NewUnit = NewIndex < New.UnitCount ? &New.Units[NewIndex] : 0;
+        int Order = OldUnit == 0 ? 1 : NewUnit == 0 ? -1 : strcmp(Old.Strings.Strings + OldUnit->Name, New.Strings.Strings + NewUnit->Name);
+
+        if (Order < 0) {
+            DiffReport(Output, '-', "cu", Old.Strings.Strings + OldUnit->Name, 0);
+            OldIndex++;
+        } else if (Order > 0) {
+            DiffReport(Output, '+', "cu", New.Strings.Strings + NewUnit->Name, 0);
+            NewIndex++;
+        } else {
+            if (OldUnit->Hash == NewUnit->Hash) {
+                Identical++;
+            } else {
+                Changed++;
+                DiffUnits(&Old, OldUnit, &New, NewUnit, Output);
+            }
+            OldIndex++;
+            NewIndex++;
+        }
+    }
+
+    if (Result == 0) {
+        fprintf(stderr, "diff: %zu CUs identical, %zu changed, %zu only in %s, %zu only in %s\n", Identical, Changed,
+                Old.UnitCount - Identical - Changed, OldPath, New.UnitCount - Identical - Changed, NewPath);
+    }
+
+    DiffSideFree(&Old);
+    DiffSideFree(&New);
+
+    if (OutputFlush(Output) != 0) {
+        fprintf(stderr, "write() error: %s\n", strerror(Output->Error));
+        Result = -1;
+    }
+
+    return Result;
+}
+
+// builds the index single threaded, then answers the addresses of Input batch by batch
+int DwarfSymbolizeFile(const char* Path, const char* InputPath, struct Output* Output)
+{
+    struct DwarfContext Context;
+    struct SymbolIndex Index;
+    struct Array Offsets;
+
+    FILE* Input = strcmp(InputPath, "-") == 0 ? stdin : fopen(InputPath, "r");
+    if (Input == 0) {
+        fprintf(stderr, "fopen() error: %s: %s\n", InputPath, strerror(errno));
+        return -1;
+    }
+
+    if (DwarfContextOpen(&Context, Path, Output) != 0) {
+        if (Input != stdin) {
+            fclose(Input);
+        }
+        return -1;
+    }
+
+    SymbolIndexInit(&Index);
+    Context.Symbols = &Index;
+
+    ArrayInit(&Offsets, 64);
+    DwarfEnumerateCompilationUnits(&Context, &Offsets);
+
+    for (size_t Count = 0; Count < Offsets.used; Count++) {
+        DwarfPrintCompilationUnitAt(&Context, Offsets.array[Count]);
+    }
+
+    ArrayFree(&Offsets);
+    SymbolIndexFinish(&Index);
+
+    struct SymbolQuery* Queries = (struct SymbolQuery*)malloc(SYMBOLIZE_BATCH * sizeof(struct SymbolQuery));
+    Dwarf_Addr* Addresses = (Dwarf_Addr*)malloc(SYMBOLIZE_BATCH * sizeof(Dwarf_Addr));
+    size_t* Results = (size_t*)malloc(SYMBOLIZE_BATCH * sizeof(size_t));
+    size_t Count = 0;
+
+    while ((Count = SymbolQueryRead(Input, Queries, SYMBOLIZE_BATCH)) > 0) {
+        for (size_t Query = 0; Query < Count; Query++) {
+            Addresses[Query] = Queries[Query].Address;
+        }
+
+        SymbolIndexResolve(&Index, Queries, Count, Results);
+
+        for (size_t Query = 0; Query < Count; Query++) {
+            SymbolIndexPrint(&Index, Output, Addresses[Query], Results[Query]);
+        }
+    }
+
+    free(Queries);
+    free(Addresses);
+    free(Results);
+    SymbolIndexFree(&Index);
+
+    if (Input != stdin) {
+        fclose(Input);
+    }
+
+    int Result = DwarfContextClose(&Context);
+    if (OutputFlush(Output) != 0) {
+        fprintf(stderr, "write() error: %s\n", strerror(Output->Error));
+        Result = -1;
+    }
+
+    return Result;
+}
+
+// --find: DIEs named Name from .debug_pubnames and .debug_pubtypes, -1 when the file has neither
+int DwarfFindGlobals(struct DwarfContext* Context, const char* Name, struct Array* Dies, struct Array* Units)
+{
+    Dwarf_Global* Globals = 0;
+    Dwarf_Type* Types = 0;
+    Dwarf_Signed Count = 0;
+    int Present = 0;
+
+    if (dwarf_get_globals(Context->Debug, &Globals, &Count, &Context->Error) == DW_DLV_OK) {
+        for (Dwarf_Signed Index = 0; Index < Count; Index++) {
+            char* GlobalName = 0;
+            Dwarf_Off Die = 0;
+            Dwarf_Off Unit = 0;
+
+            if (dwarf_global_name_offsets(Globals[Index], &GlobalName, &Die, &Unit, 0) == DW_DLV_OK) {
+                if (strcmp(GlobalName, Name) == 0) {
+                    ArrayInsert(Dies, Die);
+                    ArrayInsert(Units, Unit);
+                }
+                dwarf_dealloc(Context->Debug, GlobalName, DW_DLA_STRING);
+            }
+        }
+        dwarf_globals_dealloc(Context->Debug, Globals, Count);
+        Present = 1;
+    }
+
+    if (dwarf_get_pubtypes(Context->Debug, &Types, &Count, &Context->Error) == DW_DLV_OK) {
+        for (Dwarf_Signed Index = 0; Index < Count; Index++) {
+            char* TypeName = 0;
+            Dwarf_Off Die = 0;
+            Dwarf_Off Unit = 0;
+
+            if (dwarf_pubtype_name_offsets(Types[Index], &TypeName, &Die, &Unit, 0) == DW_DLV_OK) {
+                if (strcmp(TypeName, Name) == 0) {
+                    ArrayInsert(Dies, Die);
+                    ArrayInsert(Units, Unit);
+                }
+                dwarf_dealloc(Context->Debug, TypeName, DW_DLA_STRING);
+            }
+        }
+        dwarf_types_dealloc(Context->Debug, Types, Count);
+        Present = 1;
+    }
+
+    return Present ? 0 : -1;
+}
+
+// the name tables only list external names, statics and anything missing from them are
+// looked up in an index of every named DIE
+void DwarfFindName(struct DwarfContext* Context, const char* Name, struct Array* Dies, struct Array* Units)
+{
+    if (DwarfFindGlobals(Context, Name, Dies, Units) == 0 && Dies->used > 0) {
+        return;
+    }
+
+    struct NameIndex Index;
+    struct Array Offsets;
+
+    NameIndexInit(&Index);
+    Context->Names = &Index;
+
+    ArrayInit(&Offsets, 64);
+    DwarfEnumerateCompilationUnits(Context, &Offsets);
+    for (size_t Count = 0; Count < Offsets.used; Count++) {
+        DwarfPrintCompilationUnitAt(Context, Offsets.array[Count]);
+    }
+    ArrayFree(&Offsets);
+
+    Context->Names = 0;
+    NameIndexFind(&Index, Name, Dies, Units);
+    NameIndexFree(&Index);
+}
+
+// prints the DIE at Offset and its subtree, with the file names of the CU at Unit
+void DwarfPrintDieAt(struct DwarfContext* Context, Dwarf_Off Offset, Dwarf_Off Unit)
+{
+    Dwarf_Die CUDie = 0;
+    Dwarf_Die Die = 0;
+
+    if (dwarf_offdie_b(Context->Debug, Unit, 1, &CUDie, &Context->Error) != DW_DLV_OK) {
+        fprintf(stderr, "dwarf_offdie_b() error: %s\n", dwarf_errmsg(Context->Error));
+        return;
+    }
+
+    Context->UnitOffset = Unit;
+    DwarfLoadSourceFiles(Context, CUDie);
+
+    if (dwarf_offdie_b(Context->Debug, Offset, 1, &Die, &Context->Error) == DW_DLV_OK) {
+        DwarfWalkDies(Context, Die, Unit, 0);
+    } else {
+        fprintf(stderr, "dwarf_offdie_b() error: %s\n", dwarf_errmsg(Context->Error));
+    }
+
+    DwarfReleaseCompilationUnit(Context, CUDie);
+}
+
+// --find-addr: only the CU .debug_aranges maps the address to is read, every CU without it
+// the CU .debug_aranges names for Address, or every CU when the table is missing, does not cover
+// the address (units built without -gdwarf-aranges, assembler units) or names a CU without it
+void DwarfFindAddress(struct DwarfContext* Context, Dwarf_Addr Address, struct Output* Output)
+{
+    struct SymbolIndex Index;
+    Dwarf_Arange* Aranges = 0;
+    Dwarf_Signed Count = 0;
+    size_t Result = 0;
+
+    SymbolIndexInit(&Index);
+    Context->Symbols = &Index;
+
+    if (dwarf_get_aranges(Context->Debug, &Aranges, &Count, &Context->Error) == DW_DLV_OK) {
+        Dwarf_Arange Found = 0;
+        Dwarf_Off Unit = 0;
+
+        if (dwarf_get_arange(Aranges, Count, Address, &Found, 0) == DW_DLV_OK && dwarf_get_cu_die_offset(Found, &Unit, 0) == DW_DLV_OK) {
+            DwarfPrintCompilationUnitAt(Context, Unit);
+            SymbolIndexFinish(&Index);
+
+            struct SymbolQuery Query = { Address, 0 };
+            SymbolIndexResolve(&Index, &Query, 1, &Result);
+        }
+
+        for (Dwarf_Signed Range = 0; Range < Count; Range++) {
+            dwarf_dealloc(Context->Debug, Aranges[Range], DW_DLA_ARANGE);
+        }
+        dwarf_dealloc(Context->Debug, Aranges, DW_DLA_LIST);
+    }
+
+    if (Result == 0) {
+        struct Array Offsets;
+
+        SymbolIndexFree(&Index);
+        SymbolIndexInit(&Index);
+
+        ArrayInit(&Offsets, 64);
+        DwarfEnumerateCompilationUnits(Context, &Offsets);
+        for (size_t Unit = 0; Unit < Offsets.used; Unit++) {
+            DwarfPrintCompilationUnitAt(Context, Offsets.array[Unit]);
+        }
+        ArrayFree(&Offsets);
+
+        SymbolIndexFinish(&Index);
+
+        struct SymbolQuery Query = { Address, 0 };
+        SymbolIndexResolve(&Index, &Query, 1, &Result);
+    }
+
+    Context->Symbols = 0;
+    SymbolIndexPrint(&Index, Output, Address, Result);
+
+    SymbolIndexFree(&Index);
+}
+
+int DwarfFindFile(const char* Path, struct Output* Output)
+{
+    struct DwarfContext Context;
+    int Result = 0;
+
+    if (DwarfContextOpen(&Context, Path, Output) != 0) {
+        return -1;
+    }
+
+    if (GlobalOptions.FindName != 0) {
+        struct Array Dies;
+        struct Array Units;
+
+        ArrayInit(&Dies, 16);
+        ArrayInit(&Units, 16);
+        DwarfFindName(&Context, GlobalOptions.FindName, &Dies, &Units);
+
+        for (size_t Index = 0; Index < Dies.used; Index++) {
+            DwarfPrintDieAt(&Context, Dies.array[Index], Units.array[Index]);
+        }
+
+        if (Dies.used == 0) {
+            fprintf(stderr, "%s: not found\n", GlobalOptions.FindName);
+            Result = -1;
+        }
+
+        ArrayFree(&Dies);
+        ArrayFree(&Units);
+    } else {
+        DwarfFindAddress(&Context, strtoull(GlobalOptions.FindAddress, 0, 16), Output);
+    }
+
+    if (DwarfContextClose(&Context) != 0) {
+        Result = -1;
+    }
+    if (OutputFlush(Output) != 0) {
+        fprintf(stderr, "write() error: %s\n", strerror(Output->Error));
+        Result = -1;
+    }
+
+    return Result;
+}
+
+// FILE matches a line table file of the same name or ending in "/FILE"
+int LineFileMatches(const char* Name, const char* File, size_t FileLength)
+{
+    size_t Length = strlen(Name);
+    if (Length < FileLength || strcmp(Name + Length - FileLength, File) != 0) {
+        return 0;
+    }
+
+    return Length == FileLength || Name[Length - FileLength - 1] == '/';
+}
+
+void DwarfLineToAddress(struct LineTable* Table, const char* Query, struct Output* Output)
+{
+    const char* Colon = strrchr(Query, ':');
+    if (Colon == 0) {
+        fprintf(stderr, "--line2addr expects FILE:LINE, got %s\n", Query);
+        return;
+    }
+
+    size_t FileLength = Colon - Query;
+    char* File = strndup(Query, FileLength);
+    uint32_t Line = (uint32_t)strtoul(Colon + 1, 0, 10);
+
+    // the string table only holds file names
+    for (size_t Offset = 1; Offset < Table->Strings.Used; Offset += strlen(Table->Strings.Strings + Offset) + 1) {
+        if (!LineFileMatches(Table->Strings.Strings + Offset, File, FileLength)) {
             continue;
         }
 
-        dwarf_get_MACRO_name(MacroOperator, &MacroName);
-
-        switch (MacroOperator) {
-            case 0:
-                break;
-            case DW_MACRO_define:
-            case DW_MACRO_undef:
-            case DW_MACRO_define_strp:
-            case DW_MACRO_undef_strp:
-            case DW_MACRO_define_strx:
-            case DW_MACRO_undef_strx:
-            case DW_MACRO_define_sup:
-            case DW_MACRO_undef_sup:
-                HandleMacroDefUndef(MacroContext, MacroOperator, Index, MacroName);
-                break;
-            case DW_MACRO_start_file:
-                HandleMacroStartFile(MacroContext, MacroOperator, Index, MacroName);
-                break;
-            case DW_MACRO_end_file:
-                HandleMacroEndFile(MacroContext, MacroOperator, Index, MacroName);
-                break;
-            case DW_MACRO_import:
-                HandleMacroImport(MacroContext, MacroOperator, Index, MacroName);
-                break;
+        size_t First = 0;
+        size_t End = LineTableFindLine(Table, (uint32_t)Offset, Line, &First);
+        for (size_t Index = First; Index < End; Index++) {
+            OutputLineRow(Output, Table, &Table->Rows[Table->ByLine[Index]], 0);
         }
     }
 
-    dwarf_dealloc_macro_context(MacroContext);
+    free(File);
 }
 
-void HandleDwarfSourceLines(Dwarf_Die CUDie)
+// reads only the line tables of the file, then answers --addr2line or --line2addr
+int DwarfLineQueryFile(const char* Path, struct Output* Output)
 {
-    const char* SectionName = 0;
-    int Result = 0;
+    struct DwarfContext Context;
+    struct LineTable Table;
+    struct Array Offsets;
+    FILE* Input = 0;
+
+    if (GlobalOptions.AddressToLinePath != 0) {
+        Input = strcmp(GlobalOptions.AddressToLinePath, "-") == 0 ? stdin : fopen(GlobalOptions.AddressToLinePath, "r");
+        if (Input == 0) {
+            fprintf(stderr, "fopen() error: %s: %s\n", GlobalOptions.AddressToLinePath, strerror(errno));
+            return -1;
+        }
+    }
+
+    if (DwarfContextOpen(&Context, Path, Output) != 0) {
+        if (Input != 0 && Input != stdin) {
+            fclose(Input);
+        }
+        return -1;
+    }
+
+    LineTableInit(&Table);
+    Context.Lines = &Table;
+
+    Dwarf_Unsigned Start = TimingNow();
+
+    ArrayInit(&Offsets, 64);
+    DwarfEnumerateCompilationUnits(&Context, &Offsets);
+
+    for (size_t Index = 0; Index < Offsets.used; Index++) {
+        DwarfPrintCompilationUnitAt(&Context, Offsets.array[Index]);
+    }
 
-    Result = dwarf_get_line_section_name_from_die(CUDie, &SectionName, &GlobalDwarfError);
+    ArrayFree(&Offsets);
+    LineTableFinish(&Table);
+
+    __atomic_fetch_add(&GlobalTimingStats.LineNanoseconds, TimingNow() - Start, __ATOMIC_RELAXED);
+
+    if (Input != 0) {
+        struct SymbolQuery* Queries = (struct SymbolQuery*)malloc(SYMBOLIZE_BATCH * sizeof(struct SymbolQuery));
+        size_t Count = 0;
+
+        while ((Count = SymbolQueryRead(Input, Queries, SYMBOLIZE_BATCH)) > 0) {
+            for (size_t Query = 0; Query < Count; Query++) {
+                struct LineRow* Row = LineTableFindAddress(&Table, Queries[Query].Address);
+                struct LineRow Match = { 0 };
+                if (Row != 0) {
+                    Match = *Row;
+                    Match.Flags = 0;
+                }
+
+                Match.Address = Queries[Query].Address;
+                OutputLineRow(Output, &Table, &Match, 0);
+            }
+        }
+
+        free(Queries);
+        if (Input != stdin) {
+            fclose(Input);
+        }
+    }
+
+    if (GlobalOptions.LineToAddress != 0) {
+        DwarfLineToAddress(&Table, GlobalOptions.LineToAddress, Output);
+    }
+
+    LineTableFree(&Table);
+
+    int Result = DwarfContextClose(&Context);
+    if (OutputFlush(Output) != 0) {
+        fprintf(stderr, "write() error: %s\n", strerror(Output->Error));
+        Result = -1;
+    }
+
+    return Result;
 }
 
-void HandleDwarfDebugStr()
+// the self-symbolizer of selfsym.h: functions and line rows of the running executable packed
+// into one read-only mapping, searched without allocating, locking or touching stdio
+struct SelfFunction {
+    uint64_t Low;
+    uint64_t High;
+    uint32_t Name; // offset into the index's strings, 0 for none
+};
+
+struct SelfLine {
+    uint64_t Address;
+    uint32_t File;
+    uint32_t Line; // 0 ends a sequence
+};
+
+struct SelfIndex {
+    size_t Size; // of the mapping, this header included
+    uintptr_t Bias; // load address of the executable, 0 unless it is position independent
+    size_t FunctionCount;
+    size_t LineCount;
+    const struct SelfFunction* Functions;
+    const struct SelfLine* Lines;
+    const char* Strings;
+};
+
+// published once complete, a handler sees either nothing or the whole index
+static struct SelfIndex* GlobalSelfIndex;
+
+struct SelfObject {
+    const char* Path; // real path of the loaded object to find, 0 for the executable
+    uintptr_t Bias;
+};
+
+int SelfObjectBias(struct dl_phdr_info* Info, size_t Size, void* Data)
 {
-    const char* SectionName = 0;
+    struct SelfObject* Object = (struct SelfObject*)Data;
+    char Loaded[PATH_MAX];
 
-    Dwarf_Off StringOffset = 0;
-    char* StringName = 0;
-    Dwarf_Signed StringLength = 0;
+    (void)Size;
 
-    int Index = 0;
-    int Result = 0;
+    // the executable comes first and has no name
+    const char* Name = Info->dlpi_name[0] != 0 ? Info->dlpi_name : "/proc/self/exe";
+    if (Object->Path == 0 || (realpath(Name, Loaded) != 0 && strcmp(Loaded, Object->Path) == 0)) {
+        Object->Bias = Info->dlpi_addr;
+        return 1;
+    }
 
-    Result = dwarf_get_string_section_name(GlobalDwarfDebug, &SectionName, &GlobalDwarfError);
-    if (Result != DW_DLV_OK) {
-        exit(1);
+    return 0;
+}
+
+// one mapping holding header, functions, line rows and both string tables; rows that would not
+// change a lookup result are dropped on the way
+struct SelfIndex* SelfIndexPack(struct SymbolIndex* Symbols, struct LineTable* Lines, uintptr_t Bias)
+{
+    size_t LineCount = Lines->Count;
+    size_t Size = sizeof(struct SelfIndex) + Symbols->SegmentCount * sizeof(struct SelfFunction) + LineCount * sizeof(struct SelfLine)
+        + Symbols->Strings.Used + Lines->Strings.Used;
+
+    void* Mapping = mmap(0, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (Mapping == MAP_FAILED) {
+        return 0;
     }
 
-    fprintf(stdout, "String Section Name: %s\n", SectionName);
+    struct SelfIndex* Self = (struct SelfIndex*)Mapping;
+    struct SelfFunction* Functions = (struct SelfFunction*)(Self + 1);
+    struct SelfLine* Rows = (struct SelfLine*)(Functions + Symbols->SegmentCount);
+    char* Strings = (char*)(Rows + LineCount);
+    uint32_t LineStrings = (uint32_t)Symbols->Strings.Used;
 
-    Result = dwarf_get_str(GlobalDwarfDebug, StringOffset, &StringName, &StringLength, &GlobalDwarfError);
-    for (Index = 0; Result == DW_DLV_OK; Index++) {
-        fprintf(stdout, "name at offset 0x%0.8x, length %llu is '%s'\n", StringOffset, StringLength, StringName);
+    memcpy(Strings, Symbols->Strings.Strings, Symbols->Strings.Used);
+    memcpy(Strings + LineStrings, Lines->Strings.Strings, Lines->Strings.Used);
 
-        StringOffset += StringLength + 1;
-        Result = dwarf_get_str(GlobalDwarfDebug, StringOffset, &StringName, &StringLength, &GlobalDwarfError);
+    for (size_t Index = 0; Index < Symbols->SegmentCount; Index++) {
+        Functions[Index].Low = Symbols->Segments[Index].Low;
+        Functions[Index].High = Symbols->Segments[Index].High;
+        Functions[Index].Name = (uint32_t)Symbols->Segments[Index].Name;
+    }
+
+    size_t Count = 0;
+    for (size_t Index = 0; Index < Lines->Count; Index++) {
+        struct LineRow* Row = &Lines->Rows[Index];
+        int End = (Row->Flags & LINE_END_SEQUENCE) != 0;
+        uint32_t File = End ? 0 : LineStrings + Row->File;
+        uint32_t Line = End ? 0 : (Row->Line == 0 ? 1 : Row->Line);
+
+        // a later row at the same address wins the lookup, an unchanged file and line adds nothing
+        if (Count > 0 && Rows[Count - 1].Address == Row->Address) {
+            Count--;
+        } else if (Count > 0 && Rows[Count - 1].File == File && Rows[Count - 1].Line == Line) {
+            continue;
+        }
+
+        Rows[Count].Address = Row->Address;
+        Rows[Count].File = File;
+        Rows[Count].Line = Line;
+        Count++;
     }
+
+    Self->Size = Size;
+    Self->FunctionCount = Symbols->SegmentCount;
+    Self->LineCount = Count;
+    Self->Functions = Functions;
+    Self->Lines = Rows;
+    Self->Strings = Strings;
+    Self->Bias = Bias;
+
+    mprotect(Mapping, Size, PROT_READ);
+    return Self;
 }
 
-void HandleDwarfCompilationUnitMacrosByOffset(Dwarf_Die CUDie, Dwarf_Unsigned Offset)
+int SelfSymbolizerInit(const char* Path)
 {
-    Dwarf_Unsigned Version = 0;
-    Dwarf_Macro_Context MacroContext = 0;
-    Dwarf_Unsigned MacroOpsCount = 0;
-    Dwarf_Unsigned MacroOpsDataLength = 0;
+    struct DwarfContext Context;
+    struct SymbolIndex Symbols;
+    struct LineTable Lines;
+    struct Array Offsets;
 
-    int Result = dwarf_get_macro_context_by_offset(CUDie, Offset, &Version, &MacroContext, &MacroOpsCount, &MacroOpsDataLength, 0);
-    if (Result != DW_DLV_OK) {
-        fprintf(stderr, "dwarf_get_macro_context() error\n");
-        exit(1);
+    if (GlobalSelfIndex != 0) {
+        return 0;
     }
 
-    fprintf(stdout, "Macro data from CU-DIE at .debug_info offset 0x%0.8x:\n"
-                    "Macro Version: %d\n"
-                    "MacroInformationEntries count: %d, bytes length: %d\n",
-            Offset, Version, MacroOpsCount, MacroOpsDataLength);
+    elf_version(EV_CURRENT);
 
-    for (int Index = 0; Index < MacroOpsCount; Index++) {
-        Dwarf_Unsigned SectionOffset = 0;
-        Dwarf_Half MacroOperator = 0;
-        Dwarf_Half FormsCount = 0;
-        const Dwarf_Small* FormCodeArray = 0;
-        const char* MacroName = 0;
+    if (DwarfContextOpen(&Context, Path != 0 ? Path : "/proc/self/exe", 0) != 0) {
+        return -1;
+    }
 
-        Result = dwarf_get_macro_op(MacroContext, Index, &SectionOffset, &MacroOperator, &FormsCount, &FormCodeArray, 0);
-        if (Result != DW_DLV_OK) {
-            continue;
+    SymbolIndexInit(&Symbols);
+    LineTableInit(&Lines);
+    Context.Symbols = &Symbols;
+    Context.Lines = &Lines;
+
+    ArrayInit(&Offsets, 64);
+    DwarfEnumerateCompilationUnits(&Context, &Offsets);
+    for (size_t Index = 0; Index < Offsets.used && !Context.Failed; Index++) {
+        DwarfPrintCompilationUnitAt(&Context, Offsets.array[Index]);
+    }
+    ArrayFree(&Offsets);
+
+    // DWARF the walk could not get through gives no index rather than a partial one
+    if (Context.Failed) {
+        SymbolIndexFree(&Symbols);
+        LineTableFree(&Lines);
+        DwarfContextClose(&Context);
+        return -1;
+    }
+
+    SymbolIndexFinish(&Symbols);
+    LineTableFinish(&Lines);
+
+    // a Path that is not loaded in this process, like a copy of the executable, stands for the executable
+    char Resolved[PATH_MAX];
+    struct SelfObject Object = { 0, 0 };
+    if (Path != 0 && realpath(Path, Resolved) != 0) {
+        Object.Path = Resolved;
+    }
+    if (dl_iterate_phdr(SelfObjectBias, &Object) == 0) {
+        Object.Path = 0;
+        dl_iterate_phdr(SelfObjectBias, &Object);
+    }
+
+    struct SelfIndex* Self = SelfIndexPack(&Symbols, &Lines, Object.Bias);
+
+    SymbolIndexFree(&Symbols);
+    LineTableFree(&Lines);
+    DwarfContextClose(&Context);
+
+    if (Self == 0) {
+        return -1;
+    }
+
+    __atomic_store_n(&GlobalSelfIndex, Self, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int SelfSymbolize(uintptr_t Address, struct SelfSymbol* Symbol)
+{
+    const struct SelfIndex* Self = __atomic_load_n(&GlobalSelfIndex, __ATOMIC_ACQUIRE);
+
+    Symbol->Function = 0;
+    Symbol->File = 0;
+    Symbol->Line = 0;
+    Symbol->FunctionOffset = 0;
+
+    if (Self == 0) {
+        return -1;
+    }
+
+    uint64_t Target = Address - Self->Bias;
+    size_t Low = 0;
+    size_t High = Self->FunctionCount;
+
+    // last function starting at or before Target
+    while (Low < High) {
+        size_t Middle = Low + (High - Low) / 2;
+        if (Self->Functions[Middle].Low <= Target) {
+            Low = Middle + 1;
+        } else {
+            High = Middle;
         }
+    }
 
-        dwarf_get_MACRO_name(MacroOperator, &MacroName);
+    if (Low > 0 && Target < Self->Functions[Low - 1].High) {
+        const struct SelfFunction* Function = &Self->Functions[Low - 1];
+        Symbol->Function = Function->Name == 0 ? 0 : Self->Strings + Function->Name;
+        Symbol->FunctionOffset = Target - Function->Low;
+    }
 
-        switch (MacroOperator) {
-            case 0:
-                break;
-            case DW_MACRO_define:
-            case DW_MACRO_undef:
-            case DW_MACRO_define_strp:
-            case DW_MACRO_undef_strp:
-            case DW_MACRO_define_strx:
-            case DW_MACRO_undef_strx:
-            case DW_MACRO_define_sup:
-            case DW_MACRO_undef_sup:
-                HandleMacroDefUndef(MacroContext, MacroOperator, Index, MacroName);
-                break;
-            case DW_MACRO_start_file:
-                HandleMacroStartFile(MacroContext, MacroOperator, Index, MacroName);
-                break;
-            case DW_MACRO_end_file:
-                HandleMacroEndFile(MacroContext, MacroOperator, Index, MacroName);
-                break;
-            case DW_MACRO_import:
-                HandleMacroImport(MacroContext, MacroOperator, Index, MacroName);
-                break;
+    Low = 0;
+    High = Self->LineCount;
+    while (Low < High) {
+        size_t Middle = Low + (High - Low) / 2;
+        if (Self->Lines[Middle].Address <= Target) {
+            Low = Middle + 1;
+        } else {
+            High = Middle;
         }
     }
 
-    dwarf_dealloc_macro_context(MacroContext);
+    if (Low > 0 && Self->Lines[Low - 1].Line != 0) {
+        Symbol->File = Self->Strings + Self->Lines[Low - 1].File;
+        Symbol->Line = Self->Lines[Low - 1].Line;
+    }
+
+    return Symbol->Function != 0 || Symbol->File != 0 ? 0 : -1;
 }
 
-void DwarfPrintFunctionInfo()
+void SelfSymbolizerFree(void)
 {
-    int Result = 0;
-    int CUResult = 0;
+    struct SelfIndex* Self = __atomic_exchange_n(&GlobalSelfIndex, 0, __ATOMIC_ACQ_REL);
+    if (Self != 0) {
+        munmap(Self, Self->Size);
+    }
+}
+
+// batch mode stuff
+struct PathList {
+    char** Paths;
+    size_t Size;
+    size_t Used;
+};
+
+void PathListInsert(struct PathList* List, const char* Path)
+{
+    if (List->Used == List->Size) {
+        List->Size = List->Size == 0 ? 16 : List->Size * 2;
+        List->Paths = (char**)realloc(List->Paths, List->Size * sizeof(char*));
+    }
 
-    CUResult = dwarf_next_cu_header_c(GlobalDwarfDebug, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    List->Paths[List->Used++] = strdup(Path);
+}
 
-    while (CUResult == DW_DLV_OK) {
-        Dwarf_Die CUDie;
-        Dwarf_Die ChildDie;
+void PathListFree(struct PathList* List)
+{
+    for (size_t Index = 0; Index < List->Used; Index++) {
+        free(List->Paths[Index]);
+    }
 
-        Result = dwarf_siblingof_b(GlobalDwarfDebug, 0, 1, &CUDie, &GlobalDwarfError);
-        if (Result != DW_DLV_OK) {
-            fprintf(stderr, "dwarf_siblingof() error: %s\n", dwarf_errmsg(GlobalDwarfError));
-            exit(1);
+    free(List->Paths);
+    List->Paths = 0;
+    List->Used = 0;
+    List->Size = 0;
+}
+
+void PathListReadStream(struct PathList* List, FILE* Stream)
+{
+    char* Line = 0;
+    size_t LineSize = 0;
+    ssize_t Length = 0;
+
+    while ((Length = getline(&Line, &LineSize, Stream)) != -1) {
+        while (Length > 0 && (Line[Length - 1] == '\n' || Line[Length - 1] == '\r')) {
+            Line[--Length] = 0;
+        }
+
+        if (Length > 0) {
+            PathListInsert(List, Line);
         }
+    }
+
+    free(Line);
+}
 
-        GetAllSourceFiles(CUDie);
-        fprintf(stdout, "\n\n");
+struct BatchQueue {
+    struct PathList* Inputs;
+    const char* OutputDirectory;
+    size_t Next;
+    int Failures;
+    pthread_mutex_t Lock;
+};
 
-        HandleDwarfCompilationUnit(CUDie);
-        fprintf(stdout, "\n\n");
+// "/usr/lib/libfoo.so" -> "<dir>/usr_lib_libfoo.so.dwarf", so equal basenames never collide
+char* BatchOutputPath(const char* OutputDirectory, const char* Input)
+{
+    while (*Input == '/') {
+        Input++;
+    }
 
-        HandleDwarfCompilationUnitMacros(CUDie);
-        fprintf(stdout, "\n");
+    size_t Length = strlen(OutputDirectory) + strlen(Input) + sizeof("/.dwarf");
+    char* Path = (char*)malloc(Length);
+    snprintf(Path, Length, "%s/%s.dwarf", OutputDirectory, Input);
 
-        for (int Index = 0; Index < GlobalArray.used; Index++) {
-            HandleDwarfCompilationUnitMacrosByOffset(CUDie, GlobalArray.array[Index]);
-            fprintf(stdout, "\n");
+    for (char* Cursor = Path + strlen(OutputDirectory) + 1; *Cursor; Cursor++) {
+        if (*Cursor == '/') {
+            *Cursor = '_';
         }
+    }
 
-        fprintf(stdout, "\n");
+    return Path;
+}
 
-        HandleDwarfDebugStr();
+void* BatchWorker(void* Argument)
+{
+    struct BatchQueue* Queue = (struct BatchQueue*)Argument;
 
-        fprintf(stdout, "\n");
+    for (;;) {
+        pthread_mutex_lock(&Queue->Lock);
+        size_t Index = Queue->Next++;
+        pthread_mutex_unlock(&Queue->Lock);
 
-        if (dwarf_child(CUDie, &ChildDie, &GlobalDwarfError) != DW_DLV_OK) {
-            fprintf(stdout, "dwarf_child() NOK: %s\n", dwarf_errmsg(GlobalDwarfError));
-            continue;
+        if (Index >= Queue->Inputs->Used) {
+            break;
         }
 
-        do {
-            Dwarf_Half Tag;
-            Result = dwarf_tag(ChildDie, &Tag, &GlobalDwarfError);
-            if (Result != DW_DLV_OK) {
-                fprintf(stdout, "dwarf_tag() error: %s\n", dwarf_errmsg(GlobalDwarfError));
-                exit(1);
+        const char* Input = Queue->Inputs->Paths[Index];
+        char* OutputPath = BatchOutputPath(Queue->OutputDirectory, Input);
+        int Result = -1;
+
+        int FileDescriptor = open(OutputPath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (FileDescriptor < 0) {
+            fprintf(stderr, "open() error: %s: %s\n", OutputPath, strerror(errno));
+        } else {
+            struct Output Output;
+            OutputInit(&Output, FileDescriptor);
+            Result = DwarfDumpFileCached(Input, &Output, 1);
+            StatsCountOutput(&Output);
+            OutputFree(&Output);
+            if (close(FileDescriptor) != 0) {
+                Result = -1;
             }
+        }
 
-            switch (Tag) {
-                case DW_TAG_enumeration_type:
-                case DW_TAG_enumerator:
-                case DW_TAG_subprogram:
-                case DW_TAG_variable:
-                case DW_TAG_formal_parameter:
-                case DW_TAG_lexical_block:
-                case DW_TAG_structure_type:
-                case DW_TAG_member:
-                case DW_TAG_array_type:
-                case DW_TAG_subrange_type:
-                case DW_TAG_pointer_type:
-                case DW_TAG_subroutine_type:
-                case DW_TAG_typedef:
-                case DW_TAG_base_type:
-                    TagFunctions[Tag](ChildDie);
-                    break;
-                default:
-                    break;
-            }
-        } while (dwarf_siblingof(GlobalDwarfDebug, ChildDie, &ChildDie, 0) == 0);
+        if (Result != 0) {
+            pthread_mutex_lock(&Queue->Lock);
+            Queue->Failures++;
+            pthread_mutex_unlock(&Queue->Lock);
+        }
+
+        free(OutputPath);
+    }
+
+    return 0;
+}
+
+int DwarfDumpBatch(struct PathList* Inputs, const char* OutputDirectory, int Jobs)
+{
+    struct BatchQueue Queue = { 0 };
+    Queue.Inputs = Inputs;
+    Queue.OutputDirectory = OutputDirectory;
+    pthread_mutex_init(&Queue.Lock, 0);
+
+    if (mkdir(OutputDirectory, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "mkdir() error: %s: %s\n", OutputDirectory, strerror(errno));
+        return -1;
+    }
+
+    if (Jobs > (int)Inputs->Used) {
+        Jobs = (int)Inputs->Used;
+    }
 
-        CUResult = dwarf_next_cu_header_c(GlobalDwarfDebug, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    pthread_t* Workers = (pthread_t*)calloc(Jobs, sizeof(pthread_t));
+    for (int Index = 0; Index < Jobs; Index++) {
+        pthread_create(&Workers[Index], 0, BatchWorker, &Queue);
     }
+
+    for (int Index = 0; Index < Jobs; Index++) {
+        pthread_join(Workers[Index], 0);
+    }
+
+    free(Workers);
+    pthread_mutex_destroy(&Queue.Lock);
+
+    return Queue.Failures == 0 ? 0 : -1;
 }
 
+void PrintUsage(const char* Program)
+{
+    fprintf(stderr, "Usage: %s [options] [file... | -]\n"
+                    "       %s [options] diff OLD NEW\n"
+                    "\tWithout files, dumps its own DWARF information.\n"
+                    "\tdiff reports the functions, variables and types added, removed or changed between two builds.\n"
+                    "\t-\tread the list of files from stdin, one per line\n"
+                    "\t-j\tnumber of worker threads, spread over the files or over the CUs of a single file (default: number of CPUs)\n"
+                    "\t-o\tdirectory for the per-file dumps, required for more than one file\n"
+                    "\t--no-strings\tdo not dump the .debug_str section\n"
+                    "\t--memory-budget=MB\tstart over with a fresh libdwarf handle whenever RSS grows past MB after a CU\n"
+                    "\t--peak-rss\tprint the peak RSS to stderr when done\n"
+                    "\t--max-depth=N\tdo not descend into DIEs nested deeper than N levels (default: 256)\n"
+                    "\t--format=text|ndjson\tndjson prints one JSON object per DIE, CU, source file, macro and string\n"
+                    "\t--symbolize=FILE\tresolve the hex addresses in FILE (- for stdin) to function, decl file and line\n"
+                    "\t--lines\tdecode and print the line table of every CU\n"
+                    "\t--addr2line=FILE\tresolve the hex addresses in FILE (- for stdin) to file, line and column\n"
+                    "\t--line2addr=FILE:LINE\tprint the addresses generated for a source line\n"
+                    "\t--timing\tprint the time spent walking DIEs and decoding line tables to stderr\n"
+                    "\t--resolve-types\tprint the C declaration of every DW_AT_type next to its offset\n"
+                    "\t--decode-locations\tprint DW_AT_location and DW_AT_frame_base as DW_OP expressions and location lists\n"
+                    "\t--dedup-types\tprint every later copy of a type another CU already printed as a reference to the first one\n"
+                    "\t--layout\treport the padding holes, trailing padding and cache line crossings of every struct, most wasted bytes first\n"
+                    "\t--find=NAME\tprint the DIEs named NAME, through .debug_pubnames/.debug_pubtypes when present\n"
+                    "\t--find-addr=ADDR\tresolve one hex address, reading only the CU .debug_aranges maps it to\n"
+                    "\t--stats[=json]\tprint time per phase, DIEs per tag, attribute and libdwarf call counts and bytes written to stderr\n"
+                    "\t--debug-dir=DIR\tlook for the debug files of stripped binaries under DIR (default: /usr/lib/debug)\n"
+                    "\t--tag=TAG[,TAG...]\tonly print DIEs with one of these tags, with or without the DW_TAG_ prefix\n"
+                    "\t--name=GLOB\tonly print DIEs whose DW_AT_name matches GLOB\n"
+                    "\t--name-regex=RE\tonly print DIEs whose DW_AT_name matches the extended regular expression RE\n"
+                    "\t--cu=GLOB\tonly visit CUs whose DW_AT_name matches GLOB\n"
+                    "\t--cache-dir=DIR\tkeep rendered dumps in DIR, keyed by build-id, and serve repeated runs from there\n"
+                    "\t--columns=FILE\twrite the DIE table to FILE as fixed-width columns instead of dumping text\n",
+            Program, Program);
+}
+
+#ifndef SELFDWARF_LIBRARY
 int main(int argc, char** argv)
 {
-    int FileDescriptor;
-    Dwarf_Handler DwarfHandler;
-    Dwarf_Ptr DwarfErrArg;
-    Dwarf_Error DwarfError;
+    int Jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int JobsGiven = 0;
+    const char* OutputDirectory = 0;
+    struct PathList Inputs = { 0 };
+    int Option = 0;
+
+    static const struct option LongOptions[] = {
+        { "no-strings", no_argument, 0, 'S' },
+        { "memory-budget", required_argument, 0, 'M' },
+        { "peak-rss", no_argument, 0, 'R' },
+        { "max-depth", required_argument, 0, 'D' },
+        { "columns", required_argument, 0, 'C' },
+        { "format", required_argument, 0, 'F' },
+        { "symbolize", required_argument, 0, 'Y' },
+        { "lines", no_argument, 0, 'L' },
+        { "addr2line", required_argument, 0, 'A' },
+        { "line2addr", required_argument, 0, 'N' },
+        { "timing", no_argument, 0, 'T' },
+        { "resolve-types", no_argument, 0, 'P' },
+        { "decode-locations", no_argument, 0, 'V' },
+        { "layout", no_argument, 0, 'Z' },
+        { "dedup-types", no_argument, 0, 'H' },
+        { "cache-dir", required_argument, 0, 'K' },
+        { "find", required_argument, 0, 'I' },
+        { "find-addr", required_argument, 0, 'W' },
+        { "stats", optional_argument, 0, 'Q' },
+        { "debug-dir", required_argument, 0, 'B' },
+        { "tag", required_argument, 0, 'G' },
+        { "name", required_argument, 0, 'E' },
+        { "name-regex", required_argument, 0, 'X' },
+        { "cu", required_argument, 0, 'U' },
+        { "help", no_argument, 0, 'h' },
+        { 0, 0, 0, 0 },
+    };
+
+    while ((Option = getopt_long(argc, argv, "j:o:h", LongOptions, 0)) != -1) {
+        switch (Option) {
+            case 'S':
+                GlobalOptions.SkipStrings = 1;
+                break;
+            case 'M':
+                GlobalOptions.MemoryBudget = (size_t)strtoull(optarg, 0, 10) << 20;
+                break;
+            case 'R':
+                GlobalOptions.ReportPeakRSS = 1;
+                break;
+            case 'D':
+                GlobalOptions.MaxDepth = atoi(optarg);
+                break;
+            case 'C':
+                GlobalOptions.ColumnsPath = optarg;
+                break;
+            case 'Y':
+                GlobalOptions.SymbolizePath = optarg;
+                break;
+            case 'L':
+                GlobalOptions.PrintLines = 1;
+                break;
+            case 'A':
+                GlobalOptions.AddressToLinePath = optarg;
+                break;
+            case 'N':
+                GlobalOptions.LineToAddress = optarg;
+                break;
+            case 'T':
+                GlobalOptions.ReportTiming = 1;
+                break;
+            case 'P':
+                GlobalOptions.ResolveTypes = 1;
+                break;
+            case 'V':
+                GlobalOptions.DecodeLocations = 1;
+                break;
+            case 'Z':
+                GlobalOptions.Layout = 1;
+                break;
+            case 'H':
+                GlobalOptions.DedupTypes = 1;
+                break;
+            case 'K':
+                GlobalOptions.CacheDirectory = optarg;
+                break;
+            case 'I':
+                GlobalOptions.FindName = optarg;
+                break;
+            case 'W':
+                GlobalOptions.FindAddress = optarg;
+                break;
+            case 'Q':
+                if (optarg == 0 || strcmp(optarg, "text") == 0) {
+                    GlobalOptions.Stats = 1;
+                } else if (strcmp(optarg, "json") == 0) {
+                    GlobalOptions.Stats = 2;
+                } else {
+                    fprintf(stderr, "Unknown stats format: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'B':
+                GlobalOptions.DebugDirectory = optarg;
+                break;
+            case 'G':
+                GlobalFilter.TagList = optarg;
+                break;
+            case 'E':
+                GlobalFilter.NamePattern = optarg;
+                break;
+            case 'X':
+                GlobalFilter.NameRegexPattern = optarg;
+                break;
+            case 'U':
+                GlobalFilter.UnitPattern = optarg;
+                break;
+            case 'F':
+                if (strcmp(optarg, "ndjson") == 0) {
+                    GlobalOptions.Format = FORMAT_NDJSON;
+                } else if (strcmp(optarg, "text") == 0) {
+                    GlobalOptions.Format = FORMAT_TEXT;
+                } else {
+                    fprintf(stderr, "Unknown format: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'j':
+                Jobs = atoi(optarg);
+                JobsGiven = 1;
+                break;
+            case 'o':
+                OutputDirectory = optarg;
+                break;
+            default:
+                PrintUsage(argv[0]);
+                return Option == 'h' ? 0 : 1;
+        }
+    }
 
-    ArrayInit(&GlobalArray, 1);
+    if (Jobs < 1) {
+        Jobs = 1;
+    }
 
-    FileDescriptor = open(argv[0], O_RDONLY);
+    if (GlobalOptions.MaxDepth < 1) {
+        GlobalOptions.MaxDepth = 1;
+    }
 
-    int DwarfInitResult = dwarf_init(FileDescriptor, DW_DLC_READ, DwarfHandler, DwarfErrArg, &GlobalDwarfDebug, &DwarfError);
-    if (DwarfInitResult != DW_DLV_OK) {
-        fprintf(stderr, "dwarf_init() error.\n");
-        exit(-1);
+    if (DieFilterInit(&GlobalFilter) != 0) {
+        return 1;
     }
 
-    DwarfPrintFunctionInfo();
+    elf_version(EV_CURRENT);
 
-    ArrayFree(&GlobalArray);
+    int Diff = optind < argc && strcmp(argv[optind], "diff") == 0;
+    if (Diff) {
+        optind++;
+    }
 
-    int DwarfFinishResult = dwarf_finish(GlobalDwarfDebug, &DwarfError);
-    if (DwarfFinishResult != DW_DLV_OK) {
-        fprintf(stderr, "dwarf_init() error.\n");
-        exit(-1);
+    for (int Index = optind; Index < argc; Index++) {
+        if (strcmp(argv[Index], "-") == 0) {
+            PathListReadStream(&Inputs, stdin);
+        } else {
+            PathListInsert(&Inputs, argv[Index]);
+        }
     }
 
-    return 0;
+    if (Inputs.Used == 0 && optind == argc) {
+        PathListInsert(&Inputs, argv[0]);
+    }
+
+    int Result = 0;
+    int LineQuery = GlobalOptions.AddressToLinePath != 0 || GlobalOptions.LineToAddress != 0;
+    int FindQuery = GlobalOptions.FindName != 0 || GlobalOptions.FindAddress != 0;
+    if (Diff && Inputs.Used == 2) {
+        struct Output Output;
+        OutputInit(&Output, STDOUT_FILENO);
+        Result = DwarfDiffFiles(Inputs.Paths[0], Inputs.Paths[1], &Output);
+        StatsCountOutput(&Output);
+        OutputFree(&Output);
+    } else if (Diff) {
+        fprintf(stderr, "diff takes exactly two files.\n");
+        Result = -1;
+    } else if (FindQuery && Inputs.Used == 1) {
+        struct Output Output;
+        OutputInit(&Output, STDOUT_FILENO);
+        Result = DwarfFindFile(Inputs.Paths[0], &Output);
+        StatsCountOutput(&Output);
+        OutputFree(&Output);
+    } else if (FindQuery) {
+        fprintf(stderr, "--find and --find-addr take exactly one file.\n");
+        Result = -1;
+    } else if (LineQuery && Inputs.Used == 1) {
+        struct Output Output;
+        OutputInit(&Output, STDOUT_FILENO);
+        Result = DwarfLineQueryFile(Inputs.Paths[0], &Output);
+        StatsCountOutput(&Output);
+        OutputFree(&Output);
+    } else if (LineQuery) {
+        fprintf(stderr, "--addr2line and --line2addr take exactly one file.\n");
+        Result = -1;
+    } else if (GlobalOptions.SymbolizePath != 0 && Inputs.Used == 1) {
+        struct Output Output;
+        OutputInit(&Output, STDOUT_FILENO);
+        Result = DwarfSymbolizeFile(Inputs.Paths[0], GlobalOptions.SymbolizePath, &Output);
+        StatsCountOutput(&Output);
+        OutputFree(&Output);
+    } else if (GlobalOptions.SymbolizePath != 0) {
+        fprintf(stderr, "--symbolize takes exactly one file.\n");
+        Result = -1;
+    } else if (GlobalOptions.Layout && Inputs.Used == 1) {
+        struct Output Output;
+        OutputInit(&Output, STDOUT_FILENO);
+        Result = DwarfLayoutFile(Inputs.Paths[0], &Output);
+        StatsCountOutput(&Output);
+        OutputFree(&Output);
+    } else if (GlobalOptions.Layout) {
+        fprintf(stderr, "--layout takes exactly one file.\n");
+        Result = -1;
+    } else if (GlobalOptions.ColumnsPath != 0 && Inputs.Used == 1) {
+        Result = DwarfExportFile(Inputs.Paths[0], GlobalOptions.ColumnsPath);
+    } else if (GlobalOptions.ColumnsPath != 0) {
+        fprintf(stderr, "--columns takes exactly one file.\n");
+        Result = -1;
+    } else if (OutputDirectory != 0) {
+        Result = DwarfDumpBatch(&Inputs, OutputDirectory, Jobs);
+    } else if (Inputs.Used == 1) {
+        // the first copy of a type has to be printed before any later one, so one thread walks
+        if (GlobalOptions.DedupTypes && JobsGiven && Jobs > 1) {
+            fprintf(stderr, "--dedup-types dumps on one thread, -j %d is ignored.\n", Jobs);
+        }
+
+        struct Output Output;
+        OutputInit(&Output, STDOUT_FILENO);
+        Result = DwarfDumpFileCached(Inputs.Paths[0], &Output, Jobs);
+        StatsCountOutput(&Output);
+        OutputFree(&Output);
+    } else if (Inputs.Used == 0) {
+        fprintf(stderr, "No files to dump.\n");
+        Result = -1;
+    } else {
+        fprintf(stderr, "%zu files given, -o is required to dump more than one file.\n", Inputs.Used);
+        Result = -1;
+    }
+
+    PathListFree(&Inputs);
+    DieFilterFree(&GlobalFilter);
+
+    if (GlobalOptions.ReportPeakRSS) {
+        struct rusage Usage;
+        getrusage(RUSAGE_SELF, &Usage);
+        fprintf(stderr, "Peak RSS: %ld kB, libdwarf handles recycled: %d\n", Usage.ru_maxrss, GlobalMemoryStats.Recycles);
+    }
+
+    if (GlobalOptions.ReportTiming) {
+        fprintf(stderr, "DIE walk: %.3f s, line tables: %.3f s for %llu rows\n",
+                GlobalTimingStats.WalkNanoseconds / 1e9, GlobalTimingStats.LineNanoseconds / 1e9, GlobalTimingStats.LineRows);
+    }
+
+    if (GlobalOptions.Stats) {
+        StatsPrint(&GlobalStats, GlobalOptions.Stats == 2);
+    }
+
+    return Result == 0 ? 0 : 1;
 }
+#endif
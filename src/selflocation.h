@@ -0,0 +1,47 @@
+#ifndef SELFLOCATION_H
+#define SELFLOCATION_H
+
+#include <libdwarf/libdwarf.h>
+#include <stddef.h>
+
+#include "selfsym.h"
+
+// evaluation of the DW_AT_location and DW_AT_frame_base op arrays compiled by the location cache,
+// each list is decoded once and can then be run against any number of register and memory
+// snapshots
+
+// compiled DW_OP expression or location list, owned by the location cache
+struct LocationList;
+
+enum LocationKind {
+    LOCATION_MEMORY, // Value is an address
+    LOCATION_REGISTER, // Value is a DWARF register number
+    LOCATION_VALUE, // Value is the value itself, DW_OP_stack_value or DW_OP_implicit_value
+};
+
+// what an evaluation may look at; FrameBase is the result of LocationFrameBase() for the function
+struct LocationFrame {
+    const Dwarf_Unsigned* Registers; // indexed by DWARF register number
+    size_t RegisterCount;
+    Dwarf_Addr FrameBase;
+    Dwarf_Addr CallFrameCFA;
+    int AddressSize; // bytes read by DW_OP_deref, 8 when 0
+    int (*ReadMemory)(void* Data, Dwarf_Addr Address, void* Buffer, size_t Size); // 0 on success
+    void* Data;
+};
+
+struct LocationResult {
+    enum LocationKind Kind;
+    Dwarf_Unsigned Value;
+};
+
+// runs the expression covering PC, -1 when none does or it needs something Frame cannot give:
+// an unknown op, a register or memory read that fails, a stack that over- or underflows or a
+// branch loop running past 65536 ops.
+// A composite location evaluates to its first piece.
+SELFSYM_EXPORT int LocationEvaluate(const struct LocationList* List, Dwarf_Addr PC, const struct LocationFrame* Frame, struct LocationResult* Result);
+
+// DW_AT_frame_base as the address DW_OP_fbreg is relative to, a register holding it is read
+SELFSYM_EXPORT int LocationFrameBase(const struct LocationList* FrameBase, Dwarf_Addr PC, const struct LocationFrame* Frame, Dwarf_Addr* Base);
+
+#endif
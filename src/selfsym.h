@@ -0,0 +1,35 @@
+#ifndef SELFSYM_H
+#define SELFSYM_H
+
+#include <stdint.h>
+
+// libselfdwarf.a is built with -fvisibility=hidden and its hidden symbols localized, the functions
+// marked with this here and in selflocation.h are all it exports
+#define SELFSYM_EXPORT __attribute__((visibility("default")))
+
+// in-process symbolizer over the executable's own DWARF, for crash handlers: the index is built
+// once at startup, lookups after that are async-signal-safe
+
+// what SelfSymbolize() found for an address, the strings live as long as the index
+struct SelfSymbol {
+    const char* Function; // 0 outside of every function
+    const char* File; // from the line table, 0 without a row for the address
+    unsigned Line;
+    uintptr_t FunctionOffset; // bytes from the start of the function
+};
+
+// builds the function and line index of the running executable, read from Path or from
+// /proc/self/exe when Path is 0; a Path naming a shared object loaded in the process indexes that
+// object at its load address, any other Path is taken as a copy of the executable;
+// -1 when the file can't be opened or its DWARF fails to read;
+// allocates and reads files, so not from a signal handler
+SELFSYM_EXPORT int SelfSymbolizerInit(const char* Path);
+
+// no allocation, no locks, no stdio: safe in a SIGSEGV handler once SelfSymbolizerInit() returned;
+// -1 before that or when neither a function nor a line covers Address
+SELFSYM_EXPORT int SelfSymbolize(uintptr_t Address, struct SelfSymbol* Symbol);
+
+// not while another thread may still be in SelfSymbolize()
+SELFSYM_EXPORT void SelfSymbolizerFree(void);
+
+#endif